@@ -51,3 +51,31 @@ enet_free (void * memory)
    callbacks.free (memory);
 }
 
+
+/** Allocates memory with an allocator, or with the global callbacks if allocator is NULL. */
+void *
+enet_allocator_malloc (const ENetAllocator * allocator, size_t size)
+{
+   void * memory;
+
+   if (allocator == NULL)
+     return enet_malloc (size);
+
+   memory = allocator -> malloc (allocator -> context, size);
+
+   if (memory == NULL)
+     callbacks.no_memory ();
+
+   return memory;
+}
+
+/** Frees memory allocated with enet_allocator_malloc() with the same allocator. */
+void
+enet_allocator_free (const ENetAllocator * allocator, void * memory)
+{
+   if (allocator == NULL)
+     enet_free (memory);
+   else
+     allocator -> free (allocator -> context, memory);
+}
+
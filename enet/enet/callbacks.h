@@ -14,12 +14,23 @@ typedef struct _ENetCallbacks
     void (ENET_CALLBACK * no_memory) (void);
 } ENetCallbacks;
 
+/** Allocator used by a host in place of the global callbacks, see enet_host_create_with_allocator().
+    The functions must behave as malloc and free, and are passed the context first. */
+typedef struct _ENetAllocator
+{
+    void * context;
+    void * (ENET_CALLBACK * malloc) (void * context, size_t size);
+    void (ENET_CALLBACK * free) (void * context, void * memory);
+} ENetAllocator;
+
 /** @defgroup callbacks ENet internal callbacks
     @{
     @ingroup private
 */
 extern void * enet_malloc (size_t);
 extern void   enet_free (void *);
+extern void * enet_allocator_malloc (const ENetAllocator *, size_t);
+extern void   enet_allocator_free (const ENetAllocator *, void *);
 
 /** @} */
 
@@ -37,6 +37,8 @@ typedef enet_uint32 ENetVersion;
 struct _ENetHost;
 struct _ENetEvent;
 struct _ENetPacket;
+struct _ENetFec;
+struct _ENetPeer;
 
 typedef enum _ENetSocketType
 {
@@ -60,7 +62,8 @@ typedef enum _ENetSocketOption
    ENET_SOCKOPT_SNDBUF    = 4,
    ENET_SOCKOPT_REUSEADDR = 5,
    ENET_SOCKOPT_RCVTIMEO  = 6,
-   ENET_SOCKOPT_SNDTIMEO  = 7
+   ENET_SOCKOPT_SNDTIMEO  = 7,
+   ENET_SOCKOPT_DONTFRAGMENT = 8
 } ENetSocketOption;
 
 typedef enum _ENetSocketShutdown
@@ -117,6 +120,9 @@ typedef enum _ENetPacketFlag
    /** packet will be fragmented using unreliable (instead of reliable) sends
      * if it exceeds the MTU */
    ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT = (1 << 3),
+   /** packet is a chunk of a stream sent with enet_peer_stream(), the last chunk
+     * of a stream being empty */
+   ENET_PACKET_FLAG_STREAM = (1 << 4),
 
    /** whether the packet has been sent from all queues it has been entered into */
    ENET_PACKET_FLAG_SENT = (1<<8)
@@ -140,6 +146,11 @@ typedef void (ENET_CALLBACK * ENetPacketFreeCallback) (struct _ENetPacket *);
  *    (not supported for reliable packets)
  *
  *    ENET_PACKET_FLAG_NO_ALLOCATE - packet will not allocate data, and user must supply it instead
+ *
+ *    ENET_PACKET_FLAG_STREAM - packet is a chunk of a stream, see enet_peer_stream()
+ *
+ * A packet created with enet_packet_create_segments references the buffers of
+ * the user through the segments field instead, and its data field is NULL.
  
    @sa ENetPacketFlag
  */
@@ -151,15 +162,59 @@ typedef struct _ENetPacket
    size_t                   dataLength;      /**< length of data */
    ENetPacketFreeCallback   freeCallback;    /**< function to be called when the packet is no longer in use */
    void *                   userData;        /**< application private data, may be freely modified */
+   ENetBuffer *             segments;        /**< buffers holding the data of a packet made of several segments, NULL if the data is contiguous */
+   size_t                   segmentCount;    /**< number of segments */
+   const ENetAllocator *    allocator;       /**< allocator of the packet and its data, NULL for the global callbacks */
+   struct _ENetFragmentTable * fragmentTables; /**< internal use only */
 } ENetPacket;
 
 typedef struct _ENetAcknowledgement
 {
    ENetListNode acknowledgementList;
    enet_uint32  sentTime;
+   enet_uint32  queueTime;
    ENetProtocol command;
 } ENetAcknowledgement;
 
+/** Fragment headers of a packet split at a given fragment length.  A table is built once per packet
+    and fragment length, and shared by all the peers the packet is sent to at that length: only the
+    command, channel and sequence numbers of a header are filled in for each peer when it is sent. */
+typedef struct _ENetFragmentTable
+{
+   struct _ENetFragmentTable * next;
+   enet_uint32  fragmentLength;
+   enet_uint32  fragmentCount;
+   ENetProtocolSendFragment fragments [1];
+} ENetFragmentTable;
+
+typedef enum _ENetOutgoingFragmentState
+{
+   ENET_OUTGOING_FRAGMENT_STATE_QUEUED       = 0,   /**< not sent yet, or lost and to be sent again */
+   ENET_OUTGOING_FRAGMENT_STATE_IN_TRANSIT   = 1,
+   ENET_OUTGOING_FRAGMENT_STATE_ACKNOWLEDGED = 2
+} ENetOutgoingFragmentState;
+
+/** Retransmission state of a fragment of a reliable packet sent to a peer. */
+typedef struct _ENetOutgoingFragment
+{
+   enet_uint32  sentTime;
+   enet_uint32  roundTripTimeout;
+   enet_uint32  roundTripTimeoutLimit;
+   enet_uint16  sendAttempts;
+   enet_uint16  state;
+} ENetOutgoingFragment;
+
+/** Fragments of a packet sent to a peer by a single outgoing command, allocated along with it. */
+typedef struct _ENetOutgoingFragments
+{
+   ENetFragmentTable *    table;                    /**< shared with the other peers, freed along with the packet */
+   enet_uint32            fragmentCount;
+   enet_uint32            sentFragments;            /**< fragments sent at least once, in order */
+   enet_uint32            acknowledgedFragments;    /**< leading fragments all acknowledged, reliable packets only */
+   enet_uint32            lostFragments;            /**< fragments lost and waiting to be sent again, reliable packets only */
+   ENetOutgoingFragment * states;                   /**< state of each fragment, reliable packets only */
+} ENetOutgoingFragments;
+
 typedef struct _ENetOutgoingCommand
 {
    ENetListNode outgoingCommandList;
@@ -171,8 +226,11 @@ typedef struct _ENetOutgoingCommand
    enet_uint32  fragmentOffset;
    enet_uint16  fragmentLength;
    enet_uint16  sendAttempts;
+   ENetOutgoingFragments * fragments;   /**< fragments of the packet, NULL if it fits in one command */
    ENetProtocol command;
    ENetPacket * packet;
+   enet_uint32  coalesceKey;
+   enet_uint32  queueTime;
 } ENetOutgoingCommand;
 
 typedef struct _ENetIncomingCommand
@@ -211,6 +269,11 @@ enum
    ENET_HOST_SEND_BUFFER_SIZE             = 256 * 1024,
    ENET_HOST_BANDWIDTH_THROTTLE_INTERVAL  = 1000,
    ENET_HOST_DEFAULT_MTU                  = 1400,
+   ENET_HOST_CONNECT_COOKIE_INTERVAL      = 10000,
+   ENET_HOST_CONNECT_COOKIE_KEY_SIZE      = 8,
+   ENET_HOST_SOURCE_LIMIT_SIZE            = 1024,
+   ENET_HOST_SOURCE_LIMIT_SCALE           = 1000,
+   ENET_HOST_PEER_BLOCK_SIZE              = 32,
 
    ENET_PEER_DEFAULT_ROUND_TRIP_TIME      = 500,
    ENET_PEER_DEFAULT_PACKET_THROTTLE      = 32,
@@ -231,7 +294,12 @@ enum
    ENET_PEER_FREE_UNSEQUENCED_WINDOWS     = 32,
    ENET_PEER_RELIABLE_WINDOWS             = 16,
    ENET_PEER_RELIABLE_WINDOW_SIZE         = 0x1000,
-   ENET_PEER_FREE_RELIABLE_WINDOWS        = 8
+   ENET_PEER_FREE_RELIABLE_WINDOWS        = 8,
+   ENET_PEER_FEC_MAXIMUM_GROUP_SIZE       = 32,
+   ENET_PEER_MTU_PROBE_PRECISION          = 16,
+   ENET_PEER_MTU_PROBE_ATTEMPTS           = 3,
+   ENET_PEER_MTU_PROBE_TIMEOUT            = 100,
+   ENET_PEER_CHANNEL_MASK_SIZE            = (ENET_PROTOCOL_MAXIMUM_CHANNEL_COUNT + 31) / 32
 };
 
 typedef struct _ENetChannel
@@ -244,8 +312,35 @@ typedef struct _ENetChannel
    enet_uint16  incomingUnreliableSequenceNumber;
    ENetList     incomingReliableCommands;
    ENetList     incomingUnreliableCommands;
+   struct _ENetFec * fec;
+   ENetList     outgoingReliableCommands;
+   ENetList     outgoingUnreliableCommands;
+   ENetOutgoingCommand * outgoingFragmentedCommand;   /**< reliable fragmented command with fragments left to send after its first */
+   enet_uint8   outgoingPriority;            /**< channels of higher priority are always served first, defaults to 0 */
+   enet_uint16  outgoingWeight;              /**< share of the datagrams, in MTUs per round, among channels of equal priority, defaults to 1 */
+   enet_uint32  outgoingReliableDeficit;
+   enet_uint32  outgoingUnreliableDeficit;
+   enet_uint32  outgoingLifetime;            /**< milliseconds after which unsent unreliable packets are dropped, 0 to never drop them */
 } ENetChannel;
 
+/** Callback supplying the chunks of a stream sent with enet_peer_stream().  Writes at most
+    dataLength bytes to data and returns how many were written, 0 at the end of the stream, or
+    < 0 if no data is available yet.  It is called a last time with a NULL data once the stream
+    has ended or has been discarded with the peer, so that userData can be released. */
+typedef int (ENET_CALLBACK * ENetStreamCallback) (struct _ENetPeer * peer, enet_uint8 channelID, enet_uint8 * data, size_t dataLength, void * userData);
+
+typedef struct _ENetStream
+{
+   ENetListNode       streamList;
+   enet_uint8         channelID;
+   ENetStreamCallback callback;
+   void *             userData;
+   size_t             referenceCount;
+   size_t             queuedLength;     /**< bytes of the chunks queued or in transit */
+   struct _ENetPacket * packet;         /**< chunk supplied by the callback that could not be queued yet */
+   const ENetAllocator * allocator;
+} ENetStream;
+
 /**
  * An ENet peer which data packets may be sent or received from. 
  *
@@ -253,41 +348,62 @@ typedef struct _ENetChannel
  */
 typedef struct _ENetPeer
 { 
+   /* fields used by every service pass of an active peer come first, to share cache lines */
    ENetListNode  dispatchList;
    struct _ENetHost * host;
+   ENetPeerState state;
+   int           needsDispatch;
    enet_uint16   outgoingPeerID;
    enet_uint16   incomingPeerID;
    enet_uint32   connectID;
    enet_uint8    outgoingSessionID;
    enet_uint8    incomingSessionID;
    ENetAddress   address;            /**< Internet address of the peer */
-   void *        data;               /**< Application private data, may be freely modified */
-   ENetPeerState state;
-   ENetChannel * channels;
-   size_t        channelCount;       /**< Number of channels allocated for communication with peer */
+   enet_uint32   lastSendTime;
+   enet_uint32   lastReceiveTime;
+   enet_uint32   nextTimeout;
+   enet_uint32   earliestTimeout;
+   enet_uint32   pingInterval;
+   enet_uint32   mtu;
+   ENetList      acknowledgements;
+   ENetList      sentReliableCommands;
+   ENetList      sentUnreliableCommands;
+   ENetList      outgoingReliableCommands;
+   ENetList      outgoingUnreliableCommands;
+   ENetList      outgoingStreams;
    enet_uint32   incomingBandwidth;  /**< Downstream bandwidth of the client in bytes/second */
    enet_uint32   outgoingBandwidth;  /**< Upstream bandwidth of the client in bytes/second */
    enet_uint32   incomingBandwidthThrottleEpoch;
    enet_uint32   outgoingBandwidthThrottleEpoch;
    enet_uint32   incomingDataTotal;
    enet_uint32   outgoingDataTotal;
-   enet_uint32   lastSendTime;
-   enet_uint32   lastReceiveTime;
-   enet_uint32   nextTimeout;
-   enet_uint32   earliestTimeout;
+   enet_uint32   packetThrottle;
+   enet_uint32   packetThrottleLimit;
    enet_uint32   packetLossEpoch;
    enet_uint32   packetsSent;
    enet_uint32   packetsLost;
+   ENetChannel * channels;
+   size_t        channelCount;       /**< Number of channels allocated for communication with peer */
+   enet_uint32   outgoingReliableChannels [ENET_PEER_CHANNEL_MASK_SIZE];
+   enet_uint32   outgoingUnreliableChannels [ENET_PEER_CHANNEL_MASK_SIZE];
+   size_t        nextReliableChannel;
+   size_t        nextUnreliableChannel;
+   enet_uint32   windowSize;
+   enet_uint32   reliableDataInTransit;
+   enet_uint32   lostFragments;            /**< fragments of reliable packets lost and waiting to be sent again */
+   enet_uint16   outgoingReliableSequenceNumber;
+   size_t        queuedLength;             /**< packet data sent to the peer and not yet released, whether queued or in transit */
+   size_t        queuedCommands;           /**< commands sent to the peer and not yet released */
+
+   /* statistics, configuration and state used on specific events only */
+   void *        data;               /**< Application private data, may be freely modified */
    enet_uint32   packetLoss;          /**< mean packet loss of reliable packets as a ratio with respect to the constant ENET_PEER_PACKET_LOSS_SCALE */
    enet_uint32   packetLossVariance;
-   enet_uint32   packetThrottle;
-   enet_uint32   packetThrottleLimit;
    enet_uint32   packetThrottleCounter;
    enet_uint32   packetThrottleEpoch;
    enet_uint32   packetThrottleAcceleration;
    enet_uint32   packetThrottleDeceleration;
    enet_uint32   packetThrottleInterval;
-   enet_uint32   pingInterval;
    enet_uint32   timeoutLimit;
    enet_uint32   timeoutMinimum;
    enet_uint32   timeoutMaximum;
@@ -297,23 +413,51 @@ typedef struct _ENetPeer
    enet_uint32   highestRoundTripTimeVariance;
    enet_uint32   roundTripTime;            /**< mean round trip time (RTT), in milliseconds, between sending a reliable packet and receiving its acknowledgement */
    enet_uint32   roundTripTimeVariance;
-   enet_uint32   mtu;
-   enet_uint32   windowSize;
-   enet_uint32   reliableDataInTransit;
-   enet_uint16   outgoingReliableSequenceNumber;
-   ENetList      acknowledgements;
-   ENetList      sentReliableCommands;
-   ENetList      sentUnreliableCommands;
-   ENetList      outgoingReliableCommands;
-   ENetList      outgoingUnreliableCommands;
    ENetList      dispatchedCommands;
-   int           needsDispatch;
    enet_uint16   incomingUnsequencedGroup;
    enet_uint16   outgoingUnsequencedGroup;
    enet_uint32   unsequencedWindow [ENET_PEER_UNSEQUENCED_WINDOW_SIZE / 32]; 
    enet_uint32   eventData;
+   enet_uint8    connectCookie [ENET_PROTOCOL_CONNECT_COOKIE_SIZE];
+   enet_uint32   capabilities;             /**< protocol extensions supported by the remote peer, see ENetProtocolCapability */
+   enet_uint32   mtuProbeLimit;            /**< smallest datagram size known not to reach the peer while probing its path MTU, 0 once done */
+   enet_uint32   mtuProbeSize;
+   enet_uint32   mtuProbeTime;
+   enet_uint32   mtuProbeAttempts;
+   enet_uint16   mtuProbeAnswer;
+   size_t        queueLengthLimit;         /**< maximum of queuedLength, 0 if unlimited, see enet_peer_queue_limit() */
+   size_t        queueCommandLimit;        /**< maximum of queuedCommands, 0 if unlimited */
+   int           queueBlocked;             /**< a packet was refused because a queue was full, ENET_EVENT_TYPE_WRITABLE is pending */
+   int           shed;                     /**< shed to free memory, disconnected once its DISCONNECT is flushed */
+   size_t        memoryUsage;              /**< memory held for the peer: commands, acknowledgements, fragment bitmaps, channels and received packets, see enet_host_memory_budget() */
 } ENetPeer;
 
+/** Options of a host, see enet_host_create_ex(). */
+typedef enum _ENetHostFlag
+{
+   ENET_HOST_FLAG_LAZY_PEERS = (1 << 0)   /**< commit memory to peers as they are needed rather than up front */
+} ENetHostFlag;
+
+/** Reasons received datagrams are dropped before any command is handled, indexing
+    ENetHost::droppedDatagrams.
+ */
+typedef enum _ENetDropReason
+{
+   ENET_DROP_REASON_MALFORMED    = 0,   /**< too short to hold a header */
+   ENET_DROP_REASON_SOURCE_LIMIT = 1,   /**< source exceeded its rate, see enet_host_source_limit() */
+   ENET_DROP_REASON_UNKNOWN_PEER = 2,   /**< addressed to a peer that is not connected, or from another address or session */
+   ENET_DROP_REASON_DECOMPRESS   = 3,   /**< could not be decompressed */
+   ENET_DROP_REASON_CHECKSUM     = 4,   /**< checksum mismatch */
+   ENET_DROP_REASON_COUNT        = 5
+} ENetDropReason;
+
+/** Token bucket of the sources whose addresses hash to one entry of ENetHost::sourceLimits. */
+typedef struct _ENetSourceLimit
+{
+   enet_uint32 time;
+   enet_uint32 tokens;
+} ENetSourceLimit;
+
 /** An ENet packet compressor for compressing UDP packets before socket sends or receives.
  */
 typedef struct _ENetCompressor
@@ -333,12 +477,18 @@ typedef enet_uint32 (ENET_CALLBACK * ENetChecksumCallback) (const ENetBuffer * b
 
 /** Callback for intercepting received raw UDP packets. Should return 1 to intercept, 0 to ignore, or -1 to propagate an error. */
 typedef int (ENET_CALLBACK * ENetInterceptCallback) (struct _ENetHost * host, struct _ENetEvent * event);
+
+/** Callback for handling a received single-datagram unreliable or unsequenced packet in place, before any packet is allocated for it.
+    The data points into the receive buffer of the host and is only valid during the call.  Should return 1 if the packet was consumed, or 0 to have it queued as usual. */
+typedef int (ENET_CALLBACK * ENetReceiveCallback) (struct _ENetHost * host, ENetPeer * peer, enet_uint8 channelID, const enet_uint8 * data, size_t dataLength);
  
 /** An ENet host for communicating with peers.
   *
   * No fields should be modified unless otherwise stated.
 
     @sa enet_host_create()
+    @sa enet_host_create_ex()
+    @sa enet_host_create_with_allocator()
     @sa enet_host_destroy()
     @sa enet_host_connect()
     @sa enet_host_service()
@@ -349,6 +499,11 @@ typedef int (ENET_CALLBACK * ENetInterceptCallback) (struct _ENetHost * host, st
     @sa enet_host_channel_limit()
     @sa enet_host_bandwidth_limit()
     @sa enet_host_bandwidth_throttle()
+    @sa enet_host_acknowledgement_delay()
+    @sa enet_host_connect_cookies()
+    @sa enet_host_source_limit()
+    @sa enet_host_queue_limit()
+    @sa enet_host_memory_budget()
   */
 typedef struct _ENetHost
 {
@@ -357,11 +512,15 @@ typedef struct _ENetHost
    enet_uint32          incomingBandwidth;           /**< downstream bandwidth of the host */
    enet_uint32          outgoingBandwidth;           /**< upstream bandwidth of the host */
    enet_uint32          bandwidthThrottleEpoch;
-   enet_uint32          mtu;
+   enet_uint32          mtu;                         /**< MTU offered to peers, see enet_host_mtu() */
+   int                  mtuProbe;
    enet_uint32          randomSeed;
    int                  recalculateBandwidthLimits;
    ENetPeer *           peers;                       /**< array of peers allocated for this host */
    size_t               peerCount;                   /**< number of peers allocated for this host */
+   size_t               maximumPeerCount;            /**< number of peers the host may allocate, peerCount only grows up to it with ENET_HOST_FLAG_LAZY_PEERS */
+   enet_uint32          flags;                       /**< ENetHostFlag options the host was created with */
+   enet_uint8 *         peerStates;                  /**< ENetPeerState of each peer, packed so loops over the peers can skip idle ones without touching them */
    size_t               channelLimit;                /**< maximum number of channels allowed for connected peers */
    enet_uint32          serviceTime;
    ENetList             dispatchQueue;
@@ -375,6 +534,8 @@ typedef struct _ENetHost
    ENetChecksumCallback checksum;                    /**< callback the user can set to enable packet checksums for this host */
    ENetCompressor       compressor;
    enet_uint8           packetData [2][ENET_PROTOCOL_MAXIMUM_MTU];
+   enet_uint8           bounceData [ENET_PROTOCOL_MAXIMUM_MTU]; /**< data of the datagram being built gathered from packets with more segments than buffers left */
+   size_t               bounceLength;
    ENetAddress          receivedAddress;
    enet_uint8 *         receivedData;
    size_t               receivedDataLength;
@@ -385,8 +546,38 @@ typedef struct _ENetHost
    ENetInterceptCallback intercept;                  /**< callback the user can set to intercept received raw UDP packets */
    size_t               connectedPeers;
    size_t               bandwidthLimitedPeers;
+   enet_uint32          acknowledgementDelay;        /**< maximum time, in milliseconds, acknowledgements may be held back to share a datagram with outgoing data */
+   enet_uint32          nextAcknowledgementTime;
+   int                  connectCookies;
+   enet_uint8           connectCookieKey [ENET_HOST_CONNECT_COOKIE_KEY_SIZE];
+   ENetSourceLimit *    sourceLimits;
+   enet_uint32          sourceLimitRate;
+   enet_uint32          sourceLimitBurst;
+   enet_uint32          sourceLimitSeed;
+   enet_uint32          droppedDatagrams [ENET_DROP_REASON_COUNT]; /**< datagrams dropped on receive, by ENetDropReason, user should reset to 0 as needed to prevent overflow */
+   ENetReceiveCallback  receive;                     /**< callback the user can set to receive small unreliable packets without allocation */
+   size_t               queuedLength;                /**< packet data sent to all peers and not yet released */
+   size_t               queuedCommands;              /**< commands sent to all peers and not yet released */
+   size_t               queueLengthLimit;            /**< maximum of queuedLength, 0 if unlimited, see enet_host_queue_limit() */
+   size_t               queueCommandLimit;           /**< maximum of queuedCommands, 0 if unlimited */
+   size_t               memoryUsage;                 /**< memory held by the host, including that of its peers */
+   size_t               memoryBudget;                /**< maximum of memoryUsage, 0 if unlimited, see enet_host_memory_budget() */
+   size_t               peerMemoryBudget;            /**< maximum of ENetPeer::memoryUsage, 0 if unlimited */
+   int                  memoryOverBudget;
+   enet_uint32          shedPeers;                   /**< peers disconnected to keep within the memory budgets, user should reset to 0 as needed to prevent overflow */
+   const ENetAllocator * allocator;                  /**< allocator of the host, its peers and the packets it creates, NULL for the global callbacks */
+   void *               data;                        /**< Application private data, may be freely modified */
 } ENetHost;
 
+/** Reads the state of a peer of a host from the packed state array of the host. */
+#define ENET_PEER_STATE(host, peer) ((ENetPeerState) (host) -> peerStates [(peer) - (host) -> peers])
+
+/** Whether the datagrams sent to a peer carry its peer ID in the extended datagram header, which
+    takes sizeof (enet_uint16) more bytes. */
+#define ENET_PEER_EXTENDED_ID(peer) ((peer) -> outgoingPeerID >= ENET_PROTOCOL_EXTENDED_PEER_ID && \
+                                     (peer) -> outgoingPeerID < ENET_PROTOCOL_MAXIMUM_EXTENDED_PEER_ID && \
+                                     ((peer) -> capabilities & ENET_PROTOCOL_CAPABILITY_EXTENDED_PEER_ID))
+
 /**
  * An ENet event type, as specified in @ref ENetEvent.
  */
@@ -415,7 +606,13 @@ typedef enum _ENetEventType
      * the packet that was received; this packet must be destroyed with
      * enet_packet_destroy after use.
      */
-   ENET_EVENT_TYPE_RECEIVE    = 3
+   ENET_EVENT_TYPE_RECEIVE    = 3,
+
+   /** a peer refused a packet with enet_peer_send because its outgoing queue, or 
+     * that of its host, was full, and both have since drained below half of their
+     * limits.  The peer field contains the peer which may be sent to again.
+     */
+   ENET_EVENT_TYPE_WRITABLE   = 4
 } ENetEventType;
 
 /**
@@ -478,6 +675,21 @@ ENET_API enet_uint32 enet_time_get (void);
   */
 ENET_API void enet_time_set (enet_uint32);
 
+/**
+  Reserves size bytes of address space without committing memory to it.
+  Returns NULL on failure.
+  */
+extern void * enet_memory_reserve (size_t);
+/**
+  Commits memory to the pages holding the given range of a reserved region,
+  which then reads as zeros.  Returns 0 on success, < 0 on failure.
+  */
+extern int enet_memory_commit (void *, size_t);
+/**
+  Releases a region of the given size obtained from enet_memory_reserve().
+  */
+extern void enet_memory_release (void *, size_t);
+
 /** @defgroup socket ENet socket functions
     @{
 */
@@ -533,24 +745,45 @@ ENET_API int enet_address_get_host (const ENetAddress * address, char * hostName
 /** @} */
 
 ENET_API ENetPacket * enet_packet_create (const void *, size_t, enet_uint32);
+ENET_API ENetPacket * enet_packet_create_with_allocator (const ENetAllocator *, const void *, size_t, enet_uint32);
 ENET_API void         enet_packet_destroy (ENetPacket *);
+ENET_API ENetPacket * enet_packet_create_segments (const ENetBuffer *, size_t, enet_uint32);
 ENET_API int          enet_packet_resize  (ENetPacket *, size_t);
+extern   size_t       enet_packet_get_buffers (const ENetPacket *, size_t, size_t, ENetBuffer *, size_t);
+extern   void         enet_packet_copy_data (const ENetPacket *, size_t, size_t, void *);
+extern   ENetFragmentTable * enet_packet_fragment_table (ENetPacket *, enet_uint32);
 ENET_API enet_uint32  enet_crc32 (const ENetBuffer *, size_t);
                 
 ENET_API ENetHost * enet_host_create (const ENetAddress *, size_t, size_t, enet_uint32, enet_uint32);
+ENET_API ENetHost * enet_host_create_ex (const ENetAddress *, size_t, size_t, enet_uint32, enet_uint32, enet_uint32);
+ENET_API ENetHost * enet_host_create_with_allocator (const ENetAddress *, size_t, size_t, enet_uint32, enet_uint32, enet_uint32, const ENetAllocator *);
 ENET_API void       enet_host_destroy (ENetHost *);
 ENET_API ENetPeer * enet_host_connect (ENetHost *, const ENetAddress *, size_t, enet_uint32);
 ENET_API int        enet_host_check_events (ENetHost *, ENetEvent *);
 ENET_API int        enet_host_service (ENetHost *, ENetEvent *, enet_uint32);
 ENET_API void       enet_host_flush (ENetHost *);
 ENET_API void       enet_host_broadcast (ENetHost *, enet_uint8, ENetPacket *);
+ENET_API void       enet_host_broadcast_peers (ENetHost *, ENetPeer **, size_t, enet_uint8, ENetPacket *);
 ENET_API void       enet_host_compress (ENetHost *, const ENetCompressor *);
 ENET_API int        enet_host_compress_with_range_coder (ENetHost * host);
 ENET_API void       enet_host_channel_limit (ENetHost *, size_t);
 ENET_API void       enet_host_bandwidth_limit (ENetHost *, enet_uint32, enet_uint32);
+ENET_API void       enet_host_acknowledgement_delay (ENetHost *, enet_uint32);
+ENET_API void       enet_host_connect_cookies (ENetHost *, int, const enet_uint8 *);
+ENET_API int        enet_host_source_limit (ENetHost *, enet_uint32, enet_uint32);
+ENET_API void       enet_host_mtu (ENetHost *, enet_uint32, int);
+ENET_API void       enet_host_queue_limit (ENetHost *, size_t, size_t);
+ENET_API int        enet_host_memory_budget (ENetHost *, size_t, size_t);
 extern   void       enet_host_bandwidth_throttle (ENetHost *);
+extern   ENetPeer * enet_host_commit_peers (ENetHost *);
+extern   void *     enet_host_malloc (ENetHost *, ENetPeer *, size_t);
+extern   void       enet_host_free (ENetHost *, ENetPeer *, void *, size_t);
+extern   size_t     enet_host_fixed_memory (ENetHost *);
+extern   void       enet_host_charge_memory (ENetHost *, ENetPeer *, size_t);
+extern   void       enet_host_release_memory (ENetHost *, ENetPeer *, size_t);
 
 ENET_API int                 enet_peer_send (ENetPeer *, enet_uint8, ENetPacket *);
+ENET_API int                 enet_peer_send_coalesced (ENetPeer *, enet_uint8, ENetPacket *, enet_uint32);
 ENET_API ENetPacket *        enet_peer_receive (ENetPeer *, enet_uint8 * channelID);
 ENET_API void                enet_peer_ping (ENetPeer *);
 ENET_API void                enet_peer_ping_interval (ENetPeer *, enet_uint32);
@@ -560,16 +793,33 @@ ENET_API void                enet_peer_disconnect (ENetPeer *, enet_uint32);
 ENET_API void                enet_peer_disconnect_now (ENetPeer *, enet_uint32);
 ENET_API void                enet_peer_disconnect_later (ENetPeer *, enet_uint32);
 ENET_API void                enet_peer_throttle_configure (ENetPeer *, enet_uint32, enet_uint32, enet_uint32);
+ENET_API int                 enet_peer_fec_configure (ENetPeer *, enet_uint8, enet_uint32);
+ENET_API int                 enet_peer_channel_configure (ENetPeer *, enet_uint8, enet_uint8, enet_uint16);
+ENET_API int                 enet_peer_channel_lifetime (ENetPeer *, enet_uint8, enet_uint32);
+ENET_API int                 enet_peer_stream (ENetPeer *, enet_uint8, ENetStreamCallback, void *);
+ENET_API void                enet_peer_queue_limit (ENetPeer *, size_t, size_t);
+ENET_API int                 enet_peer_queue_room (ENetPeer *, size_t);
+ENET_API size_t              enet_peer_fragment_length (ENetPeer *);
 extern int                   enet_peer_throttle (ENetPeer *, enet_uint32);
 extern void                  enet_peer_reset_queues (ENetPeer *);
+extern void                  enet_peer_set_state (ENetPeer *, ENetPeerState);
+extern int                   enet_peer_has_outgoing_commands (ENetPeer *);
 extern void                  enet_peer_setup_outgoing_command (ENetPeer *, ENetOutgoingCommand *);
+extern void                  enet_peer_release_outgoing_command (ENetPeer *, const ENetOutgoingCommand *);
 extern ENetOutgoingCommand * enet_peer_queue_outgoing_command (ENetPeer *, const ENetProtocol *, ENetPacket *, enet_uint32, enet_uint16);
+extern void                  enet_peer_free_outgoing_command (ENetPeer *, ENetOutgoingCommand *);
 extern ENetIncomingCommand * enet_peer_queue_incoming_command (ENetPeer *, const ENetProtocol *, ENetPacket *, enet_uint32);
 extern ENetAcknowledgement * enet_peer_queue_acknowledgement (ENetPeer *, const ENetProtocol *, enet_uint16);
 extern void                  enet_peer_dispatch_incoming_unreliable_commands (ENetPeer *, ENetChannel *);
 extern void                  enet_peer_dispatch_incoming_reliable_commands (ENetPeer *, ENetChannel *);
 extern void                  enet_peer_on_connect (ENetPeer *);
 extern void                  enet_peer_on_disconnect (ENetPeer *);
+extern void                  enet_peer_fec_encode (ENetPeer *, enet_uint8, const ENetOutgoingCommand *);
+extern void                  enet_peer_fec_store (ENetChannel *, const ENetProtocol *, const enet_uint8 *, size_t);
+extern ENetPacket *          enet_peer_fec_recover (ENetPeer *, ENetChannel *, const ENetProtocol *, const enet_uint8 *, ENetProtocol *);
+extern void                  enet_peer_fec_destroy (ENetPeer *, ENetChannel *);
+extern void                  enet_peer_pull_streams (ENetPeer *);
+extern void                  enet_peer_drop_unreliable (ENetPeer *);
 
 ENET_API void * enet_range_coder_create (void);
 ENET_API void   enet_range_coder_destroy (void *);
@@ -10,15 +10,18 @@
 enum
 {
    ENET_PROTOCOL_MINIMUM_MTU             = 576,
-   ENET_PROTOCOL_MAXIMUM_MTU             = 4096,
+   ENET_PROTOCOL_MAXIMUM_MTU             = 9000,
    ENET_PROTOCOL_MAXIMUM_PACKET_COMMANDS = 32,
    ENET_PROTOCOL_MINIMUM_WINDOW_SIZE     = 4096,
    ENET_PROTOCOL_MAXIMUM_WINDOW_SIZE     = 32768,
    ENET_PROTOCOL_MINIMUM_CHANNEL_COUNT   = 1,
    ENET_PROTOCOL_MAXIMUM_CHANNEL_COUNT   = 255,
    ENET_PROTOCOL_MAXIMUM_PEER_ID         = 0xFFF,
+   ENET_PROTOCOL_EXTENDED_PEER_ID        = 0xFFE,
+   ENET_PROTOCOL_MAXIMUM_EXTENDED_PEER_ID = 0xFFFF,
    ENET_PROTOCOL_MAXIMUM_PACKET_SIZE     = 1024 * 1024 * 1024,
-   ENET_PROTOCOL_MAXIMUM_FRAGMENT_COUNT  = 1024 * 1024
+   ENET_PROTOCOL_MAXIMUM_FRAGMENT_COUNT  = 1024 * 1024,
+   ENET_PROTOCOL_CONNECT_COOKIE_SIZE     = 8
 };
 
 typedef enum _ENetProtocolCommand
@@ -36,7 +39,10 @@ typedef enum _ENetProtocolCommand
    ENET_PROTOCOL_COMMAND_BANDWIDTH_LIMIT    = 10,
    ENET_PROTOCOL_COMMAND_THROTTLE_CONFIGURE = 11,
    ENET_PROTOCOL_COMMAND_SEND_UNRELIABLE_FRAGMENT = 12,
-   ENET_PROTOCOL_COMMAND_COUNT              = 13,
+   ENET_PROTOCOL_COMMAND_SEND_PARITY        = 13,
+   ENET_PROTOCOL_COMMAND_CONNECT_EXTENSION  = 14,
+   ENET_PROTOCOL_COMMAND_MTU_PROBE          = 15,
+   ENET_PROTOCOL_COMMAND_COUNT              = 16,
 
    ENET_PROTOCOL_COMMAND_MASK               = 0x0F
 } ENetProtocolCommand;
@@ -45,6 +51,7 @@ typedef enum _ENetProtocolFlag
 {
    ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE = (1 << 7),
    ENET_PROTOCOL_COMMAND_FLAG_UNSEQUENCED = (1 << 6),
+   ENET_PROTOCOL_COMMAND_FLAG_STREAM      = (1 << 5),
 
    ENET_PROTOCOL_HEADER_FLAG_COMPRESSED = (1 << 14),
    ENET_PROTOCOL_HEADER_FLAG_SENT_TIME  = (1 << 15),
@@ -54,6 +61,17 @@ typedef enum _ENetProtocolFlag
    ENET_PROTOCOL_HEADER_SESSION_SHIFT   = 12
 } ENetProtocolFlag;
 
+typedef enum _ENetProtocolCapability
+{
+   ENET_PROTOCOL_CAPABILITY_CONNECT_COOKIE = (1 << 0),
+   ENET_PROTOCOL_CAPABILITY_EXTENDED_PEER_ID = (1 << 1),
+   ENET_PROTOCOL_CAPABILITY_MTU_PROBE      = (1 << 2),
+   ENET_PROTOCOL_CAPABILITY_STREAM         = (1 << 3),
+   ENET_PROTOCOL_CAPABILITY_FEC            = (1 << 4),
+   ENET_PROTOCOL_CAPABILITY_MASK           = ENET_PROTOCOL_CAPABILITY_CONNECT_COOKIE | ENET_PROTOCOL_CAPABILITY_EXTENDED_PEER_ID | ENET_PROTOCOL_CAPABILITY_MTU_PROBE |
+                                             ENET_PROTOCOL_CAPABILITY_STREAM | ENET_PROTOCOL_CAPABILITY_FEC
+} ENetProtocolCapability;
+
 #ifdef _MSC_VER_
 #pragma pack(push, 1)
 #define ENET_PACKED
@@ -175,6 +193,42 @@ typedef struct _ENetProtocolSendFragment
    enet_uint32 fragmentOffset;
 } ENET_PACKED ENetProtocolSendFragment;
 
+typedef struct _ENetProtocolSendParity
+{
+   ENetProtocolCommandHeader header;
+   enet_uint16 startSequenceNumber;
+   enet_uint16 lengthParity;
+   enet_uint32 groupMask;
+   enet_uint16 dataLength;
+} ENET_PACKED ENetProtocolSendParity;
+
+/** Sent by a client right after each of its CONNECT commands to advertise the protocol
+    extensions it supports, by a host using connection cookies in its stateless reply to a
+    CONNECT, and by a host right after its VERIFY_CONNECT to a client that advertised extensions.
+    Hosts that predate it stop parsing the datagram at this command, after the CONNECT.
+
+    With ENET_PROTOCOL_CAPABILITY_EXTENDED_PEER_ID, the peer ID of a datagram header may be
+    ENET_PROTOCOL_EXTENDED_PEER_ID, in which case the actual 16-bit peer ID follows it, before the
+    sent time and checksum.  Peers only send such headers to peers that advertised it.
+*/
+typedef struct _ENetProtocolConnectExtension
+{
+   ENetProtocolCommandHeader header;
+   enet_uint32 capabilities;
+   enet_uint8 cookie [ENET_PROTOCOL_CONNECT_COOKIE_SIZE];
+} ENET_PACKED ENetProtocolConnectExtension;
+
+/** Probes the path MTU to a peer that advertised ENET_PROTOCOL_CAPABILITY_MTU_PROBE.  A probe is
+    followed by paddingLength bytes so that its datagram is mtu bytes long, and is answered by an
+    MTU_PROBE with the same mtu and no padding.  Neither is acknowledged nor retransmitted.
+*/
+typedef struct _ENetProtocolMTUProbe
+{
+   ENetProtocolCommandHeader header;
+   enet_uint16 mtu;
+   enet_uint16 paddingLength;
+} ENET_PACKED ENetProtocolMTUProbe;
+
 typedef union _ENetProtocol
 {
    ENetProtocolCommandHeader header;
@@ -187,6 +241,9 @@ typedef union _ENetProtocol
    ENetProtocolSendUnreliable sendUnreliable;
    ENetProtocolSendUnsequenced sendUnsequenced;
    ENetProtocolSendFragment sendFragment;
+   ENetProtocolSendParity sendParity;
+   ENetProtocolConnectExtension connectExtension;
+   ENetProtocolMTUProbe mtuProbe;
    ENetProtocolBandwidthLimit bandwidthLimit;
    ENetProtocolThrottleConfigure throttleConfigure;
 } ENET_PACKED ENetProtocol;
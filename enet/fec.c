@@ -0,0 +1,455 @@
+/**
+ @file  fec.c
+ @brief ENet forward error correction for unreliable channels
+*/
+#include <string.h>
+#define ENET_BUILDING_LIB 1
+#include "enet/utility.h"
+#include "enet/enet.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ENET_FEC_SSE2
+#endif
+
+enum
+{
+   ENET_FEC_SLOT_VALID       = (1 << 0),
+   ENET_FEC_SLOT_UNSEQUENCED = (1 << 1)
+};
+
+typedef struct _ENetFecSlot
+{
+   enet_uint16 reliableSequenceNumber;
+   enet_uint16 sequenceNumber;
+   enet_uint16 dataLength;
+   enet_uint16 flags;
+} ENetFecSlot;
+
+typedef struct _ENetFec
+{
+   enet_uint32  groupSize;
+   enet_uint32  groupCount;
+   enet_uint32  groupMask;
+   enet_uint16  groupReliableSequenceNumber;
+   enet_uint16  groupStartSequenceNumber;
+   enet_uint16  groupLengthParity;
+   enet_uint16  groupDataLength;
+   int          groupUnsequenced;
+   size_t       parityCapacity;
+   enet_uint8 * parity;
+   size_t       windowCapacity;
+   enet_uint8 * windowData;
+   ENetFecSlot  window [ENET_PEER_FEC_MAXIMUM_GROUP_SIZE];
+} ENetFec;
+
+/** @defgroup fec ENet forward error correction functions
+    @{
+*/
+
+static void
+enet_fec_xor (enet_uint8 * destination, const enet_uint8 * source, size_t length)
+{
+#ifdef ENET_FEC_SSE2
+    for (; length >= 64; destination += 64, source += 64, length -= 64)
+    {
+        __m128i a0 = _mm_loadu_si128 ((const __m128i *) destination),
+                a1 = _mm_loadu_si128 ((const __m128i *) (destination + 16)),
+                a2 = _mm_loadu_si128 ((const __m128i *) (destination + 32)),
+                a3 = _mm_loadu_si128 ((const __m128i *) (destination + 48));
+
+        a0 = _mm_xor_si128 (a0, _mm_loadu_si128 ((const __m128i *) source));
+        a1 = _mm_xor_si128 (a1, _mm_loadu_si128 ((const __m128i *) (source + 16)));
+        a2 = _mm_xor_si128 (a2, _mm_loadu_si128 ((const __m128i *) (source + 32)));
+        a3 = _mm_xor_si128 (a3, _mm_loadu_si128 ((const __m128i *) (source + 48)));
+
+        _mm_storeu_si128 ((__m128i *) destination, a0);
+        _mm_storeu_si128 ((__m128i *) (destination + 16), a1);
+        _mm_storeu_si128 ((__m128i *) (destination + 32), a2);
+        _mm_storeu_si128 ((__m128i *) (destination + 48), a3);
+    }
+
+    for (; length >= 16; destination += 16, source += 16, length -= 16)
+      _mm_storeu_si128 ((__m128i *) destination,
+                        _mm_xor_si128 (_mm_loadu_si128 ((const __m128i *) destination), _mm_loadu_si128 ((const __m128i *) source)));
+#endif
+
+    for (; length >= sizeof (size_t); destination += sizeof (size_t), source += sizeof (size_t), length -= sizeof (size_t))
+    {
+        size_t a, b;
+
+        memcpy (& a, destination, sizeof (size_t));
+        memcpy (& b, source, sizeof (size_t));
+        a ^= b;
+        memcpy (destination, & a, sizeof (size_t));
+    }
+
+    for (; length > 0; -- length)
+      * destination ++ ^= * source ++;
+}
+
+static ENetFec *
+enet_fec_create (ENetPeer * peer, ENetChannel * channel)
+{
+    ENetFec * fec = channel -> fec;
+
+    if (fec != NULL)
+      return fec;
+
+    fec = (ENetFec *) enet_host_malloc (peer -> host, peer, sizeof (ENetFec));
+    if (fec == NULL)
+      return NULL;
+
+    memset (fec, 0, sizeof (ENetFec));
+
+    channel -> fec = fec;
+
+    return fec;
+}
+
+/* Parity and window buffers are sized for the largest MTU the peer may reach, the one it
+   negotiated while its path is still being probed, so they never have to grow. */
+static size_t
+enet_fec_capacity (ENetPeer * peer)
+{
+    if (peer -> mtuProbeLimit > peer -> mtu)
+      return peer -> mtuProbeLimit - 1;
+
+    return peer -> mtu;
+}
+
+static int
+enet_fec_create_window (ENetPeer * peer, ENetFec * fec)
+{
+    size_t capacity;
+
+    if (fec -> windowData != NULL)
+      return 0;
+
+    capacity = enet_fec_capacity (peer);
+
+    fec -> windowData = (enet_uint8 *) enet_host_malloc (peer -> host, peer, ENET_PEER_FEC_MAXIMUM_GROUP_SIZE * capacity);
+    if (fec -> windowData == NULL)
+      return -1;
+
+    fec -> windowCapacity = capacity;
+
+    memset (fec -> window, 0, sizeof (fec -> window));
+
+    return 0;
+}
+
+void
+enet_peer_fec_destroy (ENetPeer * peer, ENetChannel * channel)
+{
+    ENetFec * fec = channel -> fec;
+
+    if (fec == NULL)
+      return;
+
+    if (fec -> parity != NULL)
+      enet_host_free (peer -> host, peer, fec -> parity, fec -> parityCapacity);
+
+    if (fec -> windowData != NULL)
+      enet_host_free (peer -> host, peer, fec -> windowData, ENET_PEER_FEC_MAXIMUM_GROUP_SIZE * fec -> windowCapacity);
+
+    enet_host_free (peer -> host, peer, fec, sizeof (ENetFec));
+
+    channel -> fec = NULL;
+}
+
+static void
+enet_peer_fec_flush (ENetPeer * peer, enet_uint8 channelID, ENetFec * fec)
+{
+    ENetProtocol command;
+    ENetPacket * packet;
+
+    if (fec -> groupCount < 2)
+    {
+        fec -> groupCount = 0;
+
+        return;
+    }
+
+    fec -> groupCount = 0;
+
+    packet = enet_packet_create_with_allocator (peer -> host -> allocator, fec -> parity, fec -> groupDataLength, 0);
+    if (packet == NULL)
+      return;
+
+    command.header.command = ENET_PROTOCOL_COMMAND_SEND_PARITY;
+    if (fec -> groupUnsequenced)
+      command.header.command |= ENET_PROTOCOL_COMMAND_FLAG_UNSEQUENCED;
+    command.header.channelID = channelID;
+    command.header.reliableSequenceNumber = fec -> groupReliableSequenceNumber;
+    command.sendParity.startSequenceNumber = ENET_HOST_TO_NET_16 (fec -> groupStartSequenceNumber);
+    command.sendParity.lengthParity = ENET_HOST_TO_NET_16 (fec -> groupLengthParity);
+    command.sendParity.groupMask = ENET_HOST_TO_NET_32 (fec -> groupMask);
+    command.sendParity.dataLength = ENET_HOST_TO_NET_16 (fec -> groupDataLength);
+
+    if (enet_peer_queue_outgoing_command (peer, & command, packet, 0, fec -> groupDataLength) == NULL)
+      enet_packet_destroy (packet);
+}
+
+/** Configures forward error correction for an unreliable channel of a peer.
+
+    After every groupSize unreliable or unsequenced packets sent on the channel that fit
+    within a single fragment, an additional parity datagram is sent that is the XOR of
+    the group.  A receiver that lost exactly one packet of the group rebuilds it from the
+    parity and the packets it did receive.  Unsequenced packets are always recovered;
+    sequenced unreliable packets are only recovered if no later packet of the channel
+    has been delivered yet.  Parity is only sent once the peer has agreed to
+    ENET_PROTOCOL_CAPABILITY_FEC while connecting.
+
+    A configured channel also keeps the packets it receives, so it recovers parity sent by
+    the peer from the first group on.  A channel that was not configured starts keeping them
+    when the first parity datagram arrives, and cannot recover that first group.
+
+    @param peer peer to configure
+    @param channelID channel on which to send and receive parity datagrams
+    @param groupSize number of packets covered by each parity datagram, between 2 and ENET_PEER_FEC_MAXIMUM_GROUP_SIZE, or 0 to only receive them
+    @retval 0 on success
+    @retval < 0 on failure, or if the peer is connected and does not understand parity datagrams
+*/
+int
+enet_peer_fec_configure (ENetPeer * peer, enet_uint8 channelID, enet_uint32 groupSize)
+{
+    ENetChannel * channel;
+    ENetFec * fec;
+
+    if (channelID >= peer -> channelCount ||
+        (groupSize != 0 && (groupSize < 2 || groupSize > ENET_PEER_FEC_MAXIMUM_GROUP_SIZE)) ||
+        (peer -> state == ENET_PEER_STATE_CONNECTED && ! (peer -> capabilities & ENET_PROTOCOL_CAPABILITY_FEC)))
+      return -1;
+
+    channel = & peer -> channels [channelID];
+
+    fec = enet_fec_create (peer, channel);
+    if (fec == NULL ||
+        enet_fec_create_window (peer, fec) < 0)
+      return -1;
+
+    if (groupSize != 0 && fec -> parity == NULL)
+    {
+        size_t capacity = enet_fec_capacity (peer);
+
+        fec -> parity = (enet_uint8 *) enet_host_malloc (peer -> host, peer, capacity);
+        if (fec -> parity == NULL)
+          return -1;
+
+        fec -> parityCapacity = capacity;
+    }
+
+    fec -> groupSize = groupSize;
+    fec -> groupCount = 0;
+
+    return 0;
+}
+
+void
+enet_peer_fec_encode (ENetPeer * peer, enet_uint8 channelID, const ENetOutgoingCommand * outgoingCommand)
+{
+    ENetFec * fec = peer -> channels [channelID].fec;
+    enet_uint16 sequenceNumber;
+    size_t dataLength = outgoingCommand -> fragmentLength, dataOffset;
+    ENetBuffer segment;
+    int unsequenced;
+
+    if (fec == NULL || fec -> groupSize == 0 ||
+        ! (peer -> capabilities & ENET_PROTOCOL_CAPABILITY_FEC))
+      return;
+
+    switch (outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK)
+    {
+    case ENET_PROTOCOL_COMMAND_SEND_UNSEQUENCED:
+        unsequenced = 1;
+        sequenceNumber = ENET_NET_TO_HOST_16 (outgoingCommand -> command.sendUnsequenced.unsequencedGroup);
+        break;
+
+    case ENET_PROTOCOL_COMMAND_SEND_UNRELIABLE:
+        unsequenced = 0;
+        sequenceNumber = outgoingCommand -> unreliableSequenceNumber;
+        break;
+
+    default:
+        enet_peer_fec_flush (peer, channelID, fec);
+        return;
+    }
+
+    if (fec -> groupCount > 0 &&
+        (unsequenced != fec -> groupUnsequenced ||
+          (! unsequenced && outgoingCommand -> reliableSequenceNumber != fec -> groupReliableSequenceNumber) ||
+          (enet_uint16) (sequenceNumber - fec -> groupStartSequenceNumber) >= ENET_PEER_FEC_MAXIMUM_GROUP_SIZE))
+      enet_peer_fec_flush (peer, channelID, fec);
+
+    if (dataLength > fec -> parityCapacity)
+    {
+        enet_peer_fec_flush (peer, channelID, fec);
+
+        return;
+    }
+
+    if (fec -> groupCount == 0)
+    {
+        fec -> groupUnsequenced = unsequenced;
+        fec -> groupReliableSequenceNumber = unsequenced ? 0 : outgoingCommand -> reliableSequenceNumber;
+        fec -> groupStartSequenceNumber = sequenceNumber;
+        fec -> groupMask = 0;
+        fec -> groupLengthParity = 0;
+        fec -> groupDataLength = 0;
+    }
+
+    if (dataLength > fec -> groupDataLength)
+    {
+        memset (fec -> parity + fec -> groupDataLength, 0, dataLength - fec -> groupDataLength);
+
+        fec -> groupDataLength = dataLength;
+    }
+
+    for (dataOffset = 0; dataOffset < dataLength; dataOffset += segment.dataLength)
+    {
+        enet_packet_get_buffers (outgoingCommand -> packet, outgoingCommand -> fragmentOffset + dataOffset, dataLength - dataOffset, & segment, 1);
+        if (segment.dataLength == 0)
+          break;
+
+        enet_fec_xor (fec -> parity + dataOffset, (const enet_uint8 *) segment.data, segment.dataLength);
+    }
+
+    fec -> groupLengthParity ^= dataLength;
+    fec -> groupMask |= 1 << (enet_uint16) (sequenceNumber - fec -> groupStartSequenceNumber);
+
+    if (++ fec -> groupCount >= fec -> groupSize)
+      enet_peer_fec_flush (peer, channelID, fec);
+}
+
+void
+enet_peer_fec_store (ENetChannel * channel, const ENetProtocol * command, const enet_uint8 * data, size_t dataLength)
+{
+    ENetFec * fec = channel -> fec;
+    ENetFecSlot * slot;
+    enet_uint16 sequenceNumber, flags = ENET_FEC_SLOT_VALID;
+
+    if (fec == NULL || fec -> windowData == NULL)
+      return;
+
+    if ((command -> header.command & ENET_PROTOCOL_COMMAND_MASK) == ENET_PROTOCOL_COMMAND_SEND_UNSEQUENCED)
+    {
+        sequenceNumber = ENET_NET_TO_HOST_16 (command -> sendUnsequenced.unsequencedGroup);
+        flags |= ENET_FEC_SLOT_UNSEQUENCED;
+    }
+    else
+      sequenceNumber = ENET_NET_TO_HOST_16 (command -> sendUnreliable.unreliableSequenceNumber);
+
+    slot = & fec -> window [sequenceNumber % ENET_PEER_FEC_MAXIMUM_GROUP_SIZE];
+
+    if (dataLength > fec -> windowCapacity)
+    {
+        slot -> flags = 0;
+
+        return;
+    }
+
+    slot -> reliableSequenceNumber = command -> header.reliableSequenceNumber;
+    slot -> sequenceNumber = sequenceNumber;
+    slot -> dataLength = dataLength;
+    slot -> flags = flags;
+
+    memcpy (fec -> windowData + (sequenceNumber % ENET_PEER_FEC_MAXIMUM_GROUP_SIZE) * fec -> windowCapacity, data, dataLength);
+}
+
+ENetPacket *
+enet_peer_fec_recover (ENetPeer * peer, ENetChannel * channel, const ENetProtocol * command, const enet_uint8 * parity, ENetProtocol * recoveredCommand)
+{
+    ENetFec * fec = enet_fec_create (peer, channel);
+    ENetPacket * packet;
+    enet_uint16 startSequenceNumber, sequenceNumber, slotFlags, dataLength, recoveredLength;
+    enet_uint32 groupMask, member, missing = ENET_PEER_FEC_MAXIMUM_GROUP_SIZE;
+    int unsequenced;
+
+    if (fec == NULL)
+      return NULL;
+
+    if (fec -> windowData == NULL)
+    {
+        enet_fec_create_window (peer, fec);
+
+        return NULL;
+    }
+
+    unsequenced = (command -> header.command & ENET_PROTOCOL_COMMAND_FLAG_UNSEQUENCED) != 0;
+    slotFlags = ENET_FEC_SLOT_VALID | (unsequenced ? ENET_FEC_SLOT_UNSEQUENCED : 0);
+    startSequenceNumber = ENET_NET_TO_HOST_16 (command -> sendParity.startSequenceNumber);
+    recoveredLength = ENET_NET_TO_HOST_16 (command -> sendParity.lengthParity);
+    groupMask = ENET_NET_TO_HOST_32 (command -> sendParity.groupMask);
+    dataLength = ENET_NET_TO_HOST_16 (command -> sendParity.dataLength);
+
+    for (member = 0; member < ENET_PEER_FEC_MAXIMUM_GROUP_SIZE; ++ member)
+    {
+        ENetFecSlot * slot;
+
+        if (! (groupMask & (1 << member)))
+          continue;
+
+        sequenceNumber = startSequenceNumber + member;
+        slot = & fec -> window [sequenceNumber % ENET_PEER_FEC_MAXIMUM_GROUP_SIZE];
+
+        if (slot -> flags == slotFlags &&
+            slot -> sequenceNumber == sequenceNumber &&
+            (unsequenced || slot -> reliableSequenceNumber == command -> header.reliableSequenceNumber))
+        {
+            recoveredLength ^= slot -> dataLength;
+
+            continue;
+        }
+
+        if (missing < ENET_PEER_FEC_MAXIMUM_GROUP_SIZE)
+          return NULL;
+
+        missing = member;
+    }
+
+    if (missing >= ENET_PEER_FEC_MAXIMUM_GROUP_SIZE || recoveredLength > dataLength)
+      return NULL;
+
+    packet = enet_packet_create_with_allocator (peer -> host -> allocator, parity, recoveredLength, unsequenced ? ENET_PACKET_FLAG_UNSEQUENCED : 0);
+    if (packet == NULL)
+      return NULL;
+
+    for (member = 0; member < ENET_PEER_FEC_MAXIMUM_GROUP_SIZE; ++ member)
+    {
+        ENetFecSlot * slot;
+
+        if (member == missing || ! (groupMask & (1 << member)))
+          continue;
+
+        sequenceNumber = startSequenceNumber + member;
+        slot = & fec -> window [sequenceNumber % ENET_PEER_FEC_MAXIMUM_GROUP_SIZE];
+
+        enet_fec_xor (packet -> data,
+                      fec -> windowData + (sequenceNumber % ENET_PEER_FEC_MAXIMUM_GROUP_SIZE) * fec -> windowCapacity,
+                      ENET_MIN (slot -> dataLength, recoveredLength));
+    }
+
+    sequenceNumber = startSequenceNumber + missing;
+
+    recoveredCommand -> header.channelID = command -> header.channelID;
+    if (unsequenced)
+    {
+        recoveredCommand -> header.command = ENET_PROTOCOL_COMMAND_SEND_UNSEQUENCED | ENET_PROTOCOL_COMMAND_FLAG_UNSEQUENCED;
+        recoveredCommand -> header.reliableSequenceNumber = 0;
+        recoveredCommand -> sendUnsequenced.unsequencedGroup = ENET_HOST_TO_NET_16 (sequenceNumber);
+        recoveredCommand -> sendUnsequenced.dataLength = ENET_HOST_TO_NET_16 (recoveredLength);
+    }
+    else
+    {
+        recoveredCommand -> header.command = ENET_PROTOCOL_COMMAND_SEND_UNRELIABLE;
+        recoveredCommand -> header.reliableSequenceNumber = command -> header.reliableSequenceNumber;
+        recoveredCommand -> sendUnreliable.unreliableSequenceNumber = ENET_HOST_TO_NET_16 (sequenceNumber);
+        recoveredCommand -> sendUnreliable.dataLength = ENET_HOST_TO_NET_16 (recoveredLength);
+    }
+
+    return packet;
+}
+
+/** @} */
+
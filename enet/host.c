@@ -5,6 +5,7 @@
 #define ENET_BUILDING_LIB 1
 #include <string.h>
 #include <time.h>
+#include "enet/utility.h"
 #include "enet/enet.h"
 
 /** @defgroup host ENet host functions
@@ -29,25 +30,128 @@
 ENetHost *
 enet_host_create (const ENetAddress * address, size_t peerCount, size_t channelLimit, enet_uint32 incomingBandwidth, enet_uint32 outgoingBandwidth)
 {
-    ENetHost * host;
+    return enet_host_create_ex (address, peerCount, channelLimit, incomingBandwidth, outgoingBandwidth, 0);
+}
+
+static void
+enet_host_setup_peers (ENetHost * host, ENetPeer * firstPeer, ENetPeer * lastPeer)
+{
     ENetPeer * currentPeer;
 
-    if (peerCount > ENET_PROTOCOL_MAXIMUM_PEER_ID)
+    for (currentPeer = firstPeer;
+         currentPeer < lastPeer;
+         ++ currentPeer)
+    {
+       currentPeer -> host = host;
+       currentPeer -> incomingPeerID = currentPeer - host -> peers;
+       currentPeer -> outgoingSessionID = currentPeer -> incomingSessionID = 0xFF;
+       currentPeer -> data = NULL;
+       currentPeer -> queuedLength = 0;
+       currentPeer -> queuedCommands = 0;
+       currentPeer -> memoryUsage = 0;
+       currentPeer -> shed = 0;
+
+       enet_list_clear (& currentPeer -> acknowledgements);
+       enet_list_clear (& currentPeer -> sentReliableCommands);
+       enet_list_clear (& currentPeer -> sentUnreliableCommands);
+       enet_list_clear (& currentPeer -> outgoingReliableCommands);
+       enet_list_clear (& currentPeer -> outgoingUnreliableCommands);
+       enet_list_clear (& currentPeer -> outgoingStreams);
+       enet_list_clear (& currentPeer -> dispatchedCommands);
+
+       enet_peer_reset (currentPeer);
+    }
+}
+
+static void
+enet_host_free_peers (ENetHost * host)
+{
+    if (host -> peerStates != NULL)
+      enet_allocator_free (host -> allocator, host -> peerStates);
+
+    if (host -> flags & ENET_HOST_FLAG_LAZY_PEERS)
+      enet_memory_release (host -> peers, ENET_MAX (host -> maximumPeerCount, 1) * sizeof (ENetPeer));
+    else
+      enet_allocator_free (host -> allocator, host -> peers);
+}
+
+/** Creates a host for communicating to peers, with options.
+
+    @param address   the address at which other peers may connect to this host.  If NULL, then no peers may connect to the host.
+    @param peerCount the maximum number of peers that should be allocated for the host.
+    @param channelLimit the maximum number of channels allowed; if 0, then this is equivalent to ENET_PROTOCOL_MAXIMUM_CHANNEL_COUNT
+    @param incomingBandwidth downstream bandwidth of the host in bytes/second; if 0, ENet will assume unlimited bandwidth.
+    @param outgoingBandwidth upstream bandwidth of the host in bytes/second; if 0, ENet will assume unlimited bandwidth.
+    @param flags ENetHostFlag options of the host
+
+    @returns the host on success and NULL on failure
+
+    @remarks With ENET_HOST_FLAG_LAZY_PEERS, address space is reserved for peerCount peers but memory
+    is only committed to them ENET_HOST_PEER_BLOCK_SIZE peers at a time, once all the previous peers
+    are in use.  host->peerCount then grows up to host->maximumPeerCount, peers never move and keep
+    their IDs, and the memory of the host follows the highest number of peers it has had at once
+    rather than its capacity.
+    @remarks A host may have up to ENET_PROTOCOL_MAXIMUM_EXTENDED_PEER_ID peers.  The peer IDs from
+    ENET_PROTOCOL_EXTENDED_PEER_ID up are carried in an extended datagram header that older versions
+    of ENet do not understand, so incoming connections from such versions only get the lower peers.
+    @sa enet_host_create()
+*/
+ENetHost *
+enet_host_create_ex (const ENetAddress * address, size_t peerCount, size_t channelLimit, enet_uint32 incomingBandwidth, enet_uint32 outgoingBandwidth, enet_uint32 flags)
+{
+    return enet_host_create_with_allocator (address, peerCount, channelLimit, incomingBandwidth, outgoingBandwidth, flags, NULL);
+}
+
+/** Creates a host whose memory is allocated with an allocator rather than the global callbacks.
+
+    The allocator is used for the host, its peers, their channels and commands, and the packets the
+    host creates for received data, so that hosts serviced from different threads may each use their
+    own arena.  It is only ever called from the functions of the host, never concurrently for one host.
+    @param allocator allocator of the host, NULL for the global callbacks; it must remain valid until the host and all the packets it created are destroyed
+    @remarks The other parameters are those of enet_host_create_ex().  Lazy peers are still reserved
+    with enet_memory_reserve(), and the range coder of enet_host_compress_with_range_coder() as well
+    as packets created by the user with enet_packet_create() use the global callbacks.
+    @sa enet_packet_create_with_allocator()
+*/
+ENetHost *
+enet_host_create_with_allocator (const ENetAddress * address, size_t peerCount, size_t channelLimit, enet_uint32 incomingBandwidth, enet_uint32 outgoingBandwidth, enet_uint32 flags, const ENetAllocator * allocator)
+{
+    ENetHost * host;
+
+    if (peerCount > ENET_PROTOCOL_MAXIMUM_EXTENDED_PEER_ID)
       return NULL;
 
-    host = (ENetHost *) enet_malloc (sizeof (ENetHost));
+    host = (ENetHost *) enet_allocator_malloc (allocator, sizeof (ENetHost));
     if (host == NULL)
       return NULL;
     memset (host, 0, sizeof (ENetHost));
 
-    host -> peers = (ENetPeer *) enet_malloc (peerCount * sizeof (ENetPeer));
+    host -> allocator = allocator;
+    host -> flags = flags;
+    host -> maximumPeerCount = peerCount;
+
+    if (flags & ENET_HOST_FLAG_LAZY_PEERS)
+      host -> peers = (ENetPeer *) enet_memory_reserve (ENET_MAX (peerCount, 1) * sizeof (ENetPeer));
+    else
+      host -> peers = (ENetPeer *) enet_allocator_malloc (allocator, peerCount * sizeof (ENetPeer));
     if (host -> peers == NULL)
     {
-       enet_free (host);
+       enet_allocator_free (allocator, host);
 
        return NULL;
     }
-    memset (host -> peers, 0, peerCount * sizeof (ENetPeer));
+    if (! (flags & ENET_HOST_FLAG_LAZY_PEERS))
+      memset (host -> peers, 0, peerCount * sizeof (ENetPeer));
+
+    host -> peerStates = (enet_uint8 *) enet_allocator_malloc (allocator, ENET_MAX (peerCount, 1));
+    if (host -> peerStates == NULL)
+    {
+       enet_host_free_peers (host);
+       enet_allocator_free (allocator, host);
+
+       return NULL;
+    }
+    memset (host -> peerStates, ENET_PEER_STATE_DISCONNECTED, ENET_MAX (peerCount, 1));
 
     host -> socket = enet_socket_create (ENET_SOCKET_TYPE_DATAGRAM);
     if (host -> socket == ENET_SOCKET_NULL || (address != NULL && enet_socket_bind (host -> socket, address) < 0))
@@ -55,8 +159,8 @@ enet_host_create (const ENetAddress * address, size_t peerCount, size_t channelL
        if (host -> socket != ENET_SOCKET_NULL)
          enet_socket_destroy (host -> socket);
 
-       enet_free (host -> peers);
-       enet_free (host);
+       enet_host_free_peers (host);
+       enet_allocator_free (allocator, host);
 
        return NULL;
     }
@@ -88,7 +192,8 @@ enet_host_create (const ENetAddress * address, size_t peerCount, size_t channelL
     host -> bandwidthThrottleEpoch = 0;
     host -> recalculateBandwidthLimits = 0;
     host -> mtu = ENET_HOST_DEFAULT_MTU;
-    host -> peerCount = peerCount;
+    host -> mtuProbe = 0;
+    host -> peerCount = flags & ENET_HOST_FLAG_LAZY_PEERS ? 0 : peerCount;
     host -> commandCount = 0;
     host -> bufferCount = 0;
     host -> checksum = NULL;
@@ -105,33 +210,41 @@ enet_host_create (const ENetAddress * address, size_t peerCount, size_t channelL
     host -> connectedPeers = 0;
     host -> bandwidthLimitedPeers = 0;
 
+    host -> acknowledgementDelay = 0;
+    host -> nextAcknowledgementTime = 0;
+
+    host -> connectCookies = 0;
+    memset (host -> connectCookieKey, 0, sizeof (host -> connectCookieKey));
+
+    host -> sourceLimits = NULL;
+    host -> sourceLimitRate = 0;
+    host -> sourceLimitBurst = 0;
+    host -> sourceLimitSeed = 0;
+    memset (host -> droppedDatagrams, 0, sizeof (host -> droppedDatagrams));
+
     host -> compressor.context = NULL;
     host -> compressor.compress = NULL;
     host -> compressor.decompress = NULL;
     host -> compressor.destroy = NULL;
 
     host -> intercept = NULL;
+    host -> receive = NULL;
+    host -> queuedLength = 0;
+    host -> queuedCommands = 0;
+    host -> queueLengthLimit = 0;
+    host -> queueCommandLimit = 0;
+    host -> memoryUsage = sizeof (ENetHost) + ENET_MAX (peerCount, 1);
+    if (! (flags & ENET_HOST_FLAG_LAZY_PEERS))
+      host -> memoryUsage += peerCount * sizeof (ENetPeer);
+    host -> memoryBudget = 0;
+    host -> peerMemoryBudget = 0;
+    host -> memoryOverBudget = 0;
+    host -> shedPeers = 0;
+    host -> data = NULL;
 
     enet_list_clear (& host -> dispatchQueue);
 
-    for (currentPeer = host -> peers;
-         currentPeer < & host -> peers [host -> peerCount];
-         ++ currentPeer)
-    {
-       currentPeer -> host = host;
-       currentPeer -> incomingPeerID = currentPeer - host -> peers;
-       currentPeer -> outgoingSessionID = currentPeer -> incomingSessionID = 0xFF;
-       currentPeer -> data = NULL;
-
-       enet_list_clear (& currentPeer -> acknowledgements);
-       enet_list_clear (& currentPeer -> sentReliableCommands);
-       enet_list_clear (& currentPeer -> sentUnreliableCommands);
-       enet_list_clear (& currentPeer -> outgoingReliableCommands);
-       enet_list_clear (& currentPeer -> outgoingUnreliableCommands);
-       enet_list_clear (& currentPeer -> dispatchedCommands);
-
-       enet_peer_reset (currentPeer);
-    }
+    enet_host_setup_peers (host, host -> peers, & host -> peers [host -> peerCount]);
 
     return host;
 }
@@ -159,8 +272,42 @@ enet_host_destroy (ENetHost * host)
     if (host -> compressor.context != NULL && host -> compressor.destroy)
       (* host -> compressor.destroy) (host -> compressor.context);
 
-    enet_free (host -> peers);
-    enet_free (host);
+    if (host -> sourceLimits != NULL)
+      enet_host_free (host, NULL, host -> sourceLimits, ENET_HOST_SOURCE_LIMIT_SIZE * sizeof (ENetSourceLimit));
+
+    enet_host_free_peers (host);
+    enet_allocator_free (host -> allocator, host);
+}
+
+/** Commits memory to the next peers of a host created with ENET_HOST_FLAG_LAZY_PEERS and sets them up.
+    @returns the first of the new peers, or NULL if the host has no more peers or the memory could not be committed
+*/
+ENetPeer *
+enet_host_commit_peers (ENetHost * host)
+{
+    ENetPeer * firstPeer = & host -> peers [host -> peerCount];
+    size_t peerCount = host -> peerCount + ENET_HOST_PEER_BLOCK_SIZE;
+
+    if (! (host -> flags & ENET_HOST_FLAG_LAZY_PEERS) ||
+        host -> peerCount >= host -> maximumPeerCount)
+      return NULL;
+
+    if (peerCount > host -> maximumPeerCount)
+      peerCount = host -> maximumPeerCount;
+
+    if (host -> memoryBudget != 0 &&
+        enet_host_fixed_memory (host) + (peerCount - host -> peerCount) * sizeof (ENetPeer) >= host -> memoryBudget)
+      return NULL;
+
+    if (enet_memory_commit (firstPeer, (peerCount - host -> peerCount) * sizeof (ENetPeer)) < 0)
+      return NULL;
+
+    enet_host_setup_peers (host, firstPeer, & host -> peers [peerCount]);
+
+    host -> memoryUsage += (peerCount - host -> peerCount) * sizeof (ENetPeer);
+    host -> peerCount = peerCount;
+
+    return firstPeer;
 }
 
 /** Initiates a connection to a foreign host.
@@ -171,6 +318,8 @@ enet_host_destroy (ENetHost * host)
     @returns a peer representing the foreign host on success, NULL on failure
     @remarks The peer returned will have not completed the connection until enet_host_service()
     notifies of an ENET_EVENT_TYPE_CONNECT event for the peer.
+    @remarks The lowest free peer is used.  Hosts running older versions of ENet cannot be connected
+    to from peers with IDs of ENET_PROTOCOL_EXTENDED_PEER_ID and up.
 */
 ENetPeer *
 enet_host_connect (ENetHost * host, const ENetAddress * address, size_t channelCount, enet_uint32 data)
@@ -189,19 +338,24 @@ enet_host_connect (ENetHost * host, const ENetAddress * address, size_t channelC
          currentPeer < & host -> peers [host -> peerCount];
          ++ currentPeer)
     {
-       if (currentPeer -> state == ENET_PEER_STATE_DISCONNECTED)
+       if (ENET_PEER_STATE (host, currentPeer) == ENET_PEER_STATE_DISCONNECTED)
          break;
     }
 
     if (currentPeer >= & host -> peers [host -> peerCount])
-      return NULL;
+    {
+       currentPeer = enet_host_commit_peers (host);
+       if (currentPeer == NULL)
+         return NULL;
+    }
 
-    currentPeer -> channels = (ENetChannel *) enet_malloc (channelCount * sizeof (ENetChannel));
+    currentPeer -> channels = (ENetChannel *) enet_host_malloc (host, currentPeer, channelCount * sizeof (ENetChannel));
     if (currentPeer -> channels == NULL)
       return NULL;
     currentPeer -> channelCount = channelCount;
-    currentPeer -> state = ENET_PEER_STATE_CONNECTING;
+    enet_peer_set_state (currentPeer, ENET_PEER_STATE_CONNECTING);
     currentPeer -> address = * address;
+    currentPeer -> mtu = host -> mtu;
     currentPeer -> connectID = ++ host -> randomSeed;
 
     if (host -> outgoingBandwidth == 0)
@@ -228,7 +382,16 @@ enet_host_connect (ENetHost * host, const ENetAddress * address, size_t channelC
 
         enet_list_clear (& channel -> incomingReliableCommands);
         enet_list_clear (& channel -> incomingUnreliableCommands);
-
+        enet_list_clear (& channel -> outgoingReliableCommands);
+        enet_list_clear (& channel -> outgoingUnreliableCommands);
+
+        channel -> outgoingFragmentedCommand = NULL;
+        channel -> fec = NULL;
+        channel -> outgoingPriority = 0;
+        channel -> outgoingWeight = 1;
+        channel -> outgoingReliableDeficit = 0;
+        channel -> outgoingUnreliableDeficit = 0;
+        channel -> outgoingLifetime = 0;
         channel -> usedReliableWindows = 0;
         memset (channel -> reliableWindows, 0, sizeof (channel -> reliableWindows));
     }
@@ -258,6 +421,9 @@ enet_host_connect (ENetHost * host, const ENetAddress * address, size_t channelC
     @param host host on which to broadcast the packet
     @param channelID channel on which to broadcast
     @param packet packet to broadcast
+    @remarks The packet data is shared, and so are its fragment headers if it is fragmented: the packet
+    is split once per fragment length in use, and each peer queues a single command for it that only
+    holds its own sequence numbers and the retransmission state of each fragment.
 */
 void
 enet_host_broadcast (ENetHost * host, enet_uint8 channelID, ENetPacket * packet)
@@ -268,7 +434,7 @@ enet_host_broadcast (ENetHost * host, enet_uint8 channelID, ENetPacket * packet)
          currentPeer < & host -> peers [host -> peerCount];
          ++ currentPeer)
     {
-       if (currentPeer -> state != ENET_PEER_STATE_CONNECTED)
+       if (ENET_PEER_STATE (host, currentPeer) != ENET_PEER_STATE_CONNECTED)
          continue;
 
        enet_peer_send (currentPeer, channelID, packet);
@@ -278,6 +444,31 @@ enet_host_broadcast (ENetHost * host, enet_uint8 channelID, ENetPacket * packet)
       enet_packet_destroy (packet);
 }
 
+/** Queues a packet to be sent to a set of peers, sharing the packet between them.
+    @param host host on which to send the packet
+    @param peers array of peers to send the packet to; peers that are not connected are skipped
+    @param peerCount number of peers in the array
+    @param channelID channel on which to send
+    @param packet packet to send
+*/
+void
+enet_host_broadcast_peers (ENetHost * host, ENetPeer ** peers, size_t peerCount, enet_uint8 channelID, ENetPacket * packet)
+{
+    size_t i;
+
+    for (i = 0; i < peerCount; ++ i)
+    {
+       if (peers [i] -> host != host ||
+           peers [i] -> state != ENET_PEER_STATE_CONNECTED)
+         continue;
+
+       enet_peer_send (peers [i], channelID, packet);
+    }
+
+    if (packet -> referenceCount == 0)
+      enet_packet_destroy (packet);
+}
+
 /** Sets the packet compressor the host should use to compress and decompress packets.
     @param host host to enable or disable compression for
     @param compressor callbacks for for the packet compressor; if NULL, then compression is disabled
@@ -326,6 +517,265 @@ enet_host_bandwidth_limit (ENetHost * host, enet_uint32 incomingBandwidth, enet_
     host -> recalculateBandwidthLimits = 1;
 }
 
+/** Allows acknowledgements to be held back so they can share a datagram with outgoing data.
+
+    Acknowledgements are normally sent on the next call to enet_host_service() or enet_host_flush(),
+    often in a datagram of their own.  With a delay set, acknowledgements for a connected peer are
+    held until outgoing data is queued for that peer or the oldest of them has waited for the given
+    number of milliseconds.  The time an acknowledgement was held is credited back in the timestamp
+    it echoes, so the round trip time measured by the foreign host is not inflated by the delay.
+    The delay should be kept well below the retransmission timeout of the foreign host.
+
+    @param host host to configure
+    @param delay maximum time, in milliseconds, to hold acknowledgements; 0 sends them immediately
+*/
+void
+enet_host_acknowledgement_delay (ENetHost * host, enet_uint32 delay)
+{
+    host -> acknowledgementDelay = delay;
+}
+
+/** Limits the rate of datagrams accepted from each source address that is not a connected peer.
+
+    Datagrams that do not belong to a connected peer, such as connection requests and junk, are
+    charged to a token bucket picked by hashing their source IP address into a fixed table of
+    ENET_HOST_SOURCE_LIMIT_SIZE entries, right after they are received and before they are
+    decompressed, checksummed or parsed.  A datagram finding its bucket empty is dropped and counted
+    in host->droppedDatagrams [ENET_DROP_REASON_SOURCE_LIMIT].  Sources hashing to the same entry
+    share their bucket, and the hash is seeded per host so the collisions cannot be predicted.
+
+    @param host host to configure
+    @param rate datagrams per second accepted from each source, 0 to remove the limit
+    @param burst datagrams a source may send at once after being idle, at least 1 and at most 65535
+    @returns 0 on success, < 0 on failure
+*/
+int
+enet_host_source_limit (ENetHost * host, enet_uint32 rate, enet_uint32 burst)
+{
+    size_t i;
+
+    if (rate == 0)
+    {
+       if (host -> sourceLimits != NULL)
+       {
+          enet_host_free (host, NULL, host -> sourceLimits, ENET_HOST_SOURCE_LIMIT_SIZE * sizeof (ENetSourceLimit));
+          host -> sourceLimits = NULL;
+       }
+       host -> sourceLimitRate = 0;
+       host -> sourceLimitBurst = 0;
+       return 0;
+    }
+
+    if (burst < 1)
+      burst = 1;
+    else
+    if (burst > 0xFFFF)
+      burst = 0xFFFF;
+
+    if (host -> sourceLimits == NULL)
+    {
+       host -> sourceLimits = (ENetSourceLimit *) enet_host_malloc (host, NULL, ENET_HOST_SOURCE_LIMIT_SIZE * sizeof (ENetSourceLimit));
+       if (host -> sourceLimits == NULL)
+         return -1;
+
+       host -> randomSeed = host -> randomSeed * 1103515245 + 12345 + enet_time_get ();
+       host -> sourceLimitSeed = host -> randomSeed;
+    }
+
+    host -> sourceLimitRate = rate;
+    host -> sourceLimitBurst = burst;
+
+    for (i = 0; i < ENET_HOST_SOURCE_LIMIT_SIZE; ++ i)
+    {
+       host -> sourceLimits [i].time = host -> serviceTime;
+       host -> sourceLimits [i].tokens = burst * ENET_HOST_SOURCE_LIMIT_SCALE;
+    }
+
+    return 0;
+}
+
+/** Enables or disables stateless connection cookies on a host.
+
+    With cookies enabled, no peer is allocated for a connection request until the client has
+    echoed a cookie the host sent back to it without keeping any state.  The cookie is a keyed hash
+    of the client address, its connect ID and the current ENET_HOST_CONNECT_COOKIE_INTERVAL, so a
+    flood of spoofed requests costs neither peers, channels nor retransmissions.  Clients advertise
+    cookie support with each request; requests from clients that do not are dropped while cookies
+    are enabled.
+
+    @param host host to configure
+    @param enable 1 to enable cookies, 0 to disable them
+    @param key ENET_HOST_CONNECT_COOKIE_KEY_SIZE secret bytes to compute cookies with, or NULL to
+    derive a key from the random seed of the host and the current time
+*/
+void
+enet_host_connect_cookies (ENetHost * host, int enable, const enet_uint8 * key)
+{
+    host -> connectCookies = enable;
+    if (! enable)
+      return;
+
+    if (key != NULL)
+      memcpy (host -> connectCookieKey, key, sizeof (host -> connectCookieKey));
+    else
+    {
+       size_t i;
+
+       for (i = 0; i < sizeof (host -> connectCookieKey); ++ i)
+       {
+          host -> randomSeed = host -> randomSeed * 1103515245 + 12345 + enet_time_get ();
+          host -> connectCookieKey [i] = (enet_uint8) (host -> randomSeed >> 16);
+       }
+    }
+}
+
+/** Sets the MTU a host offers to the peers it connects to or accepts from then on.
+
+    A connection uses the smaller of the MTUs offered by both of its ends.  With probing, connections
+    to peers that support it rather start with at most ENET_HOST_DEFAULT_MTU, and send padded probes
+    of growing sizes to find the largest datagram that gets through, up to the MTU of the connection.
+    Fragmentation follows the MTU found.  Probing also sets the don't fragment flag on the socket of
+    the host where the platform allows it, so that oversized probes are dropped rather than
+    fragmented on the way.
+
+    @param host host to configure
+    @param mtu largest datagram size, between ENET_PROTOCOL_MINIMUM_MTU and ENET_PROTOCOL_MAXIMUM_MTU
+    @param probe 1 to probe the path MTU of new connections, 0 to use the MTU of the connection as is
+*/
+void
+enet_host_mtu (ENetHost * host, enet_uint32 mtu, int probe)
+{
+    if (mtu < ENET_PROTOCOL_MINIMUM_MTU)
+      mtu = ENET_PROTOCOL_MINIMUM_MTU;
+    else
+    if (mtu > ENET_PROTOCOL_MAXIMUM_MTU)
+      mtu = ENET_PROTOCOL_MAXIMUM_MTU;
+
+    host -> mtu = mtu;
+    host -> mtuProbe = probe;
+
+    enet_socket_set_option (host -> socket, ENET_SOCKOPT_DONTFRAGMENT, probe);
+}
+
+/** Limits the data a host holds for all of its peers together.
+
+    Packets sent to a peer are counted from the moment enet_peer_send() queues them until they are
+    acknowledged, dropped or sent unreliably.  Once the total would go over a limit, enet_peer_send()
+    refuses packets with -2 instead of queuing them, and broadcasts skip the peers they would be
+    refused to.  A packet is always accepted while nothing is held, however large it is.  Each peer
+    that refused a packet gets an ENET_EVENT_TYPE_WRITABLE event once the data held for it, and by
+    the host, have drained below half of the limits.
+
+    @param host host to configure
+    @param length maximum bytes of packet data held, 0 for no limit
+    @param commands maximum protocol commands held, 0 for no limit
+    @sa enet_peer_queue_limit()
+*/
+void
+enet_host_queue_limit (ENetHost * host, size_t length, size_t commands)
+{
+    host -> queueLengthLimit = length;
+    host -> queueCommandLimit = commands;
+}
+
+/** Limits the memory a host holds, for each of its peers and in total.
+
+    host->memoryUsage counts the host itself, its peers and everything allocated on their behalf,
+    and ENetPeer::memoryUsage the part held for one peer: its channels, protocol commands,
+    acknowledgements, fragment bitmaps, and the packets received from it until they are handed to
+    the user.  Packets sent are left out of the peers since they may be shared among them, see
+    enet_host_queue_limit() for those.  Once a budget is exceeded, enet_host_service() sheds memory
+    before sending: peers over their budget lose their unsent and undispatched unreliable data, and
+    are disconnected if that is not enough.  While the host is over its budget, every peer loses its
+    unreliable data, and then the peers holding the most memory are disconnected, with an
+    ENET_EVENT_TYPE_DISCONNECT event, until the host is back within its budget.  Shed peers are
+    counted in host->shedPeers.
+
+    The budget must exceed the memory the host holds for itself, see enet_host_fixed_memory(), or
+    it is rejected since no amount of shedding could meet it.  With ENET_HOST_FLAG_LAZY_PEERS, the
+    peer array is not grown past the budget, so connections beyond it are refused instead.
+
+    @param host host to configure
+    @param budget maximum memory of the host in bytes, 0 for no limit
+    @param peerBudget maximum memory of each peer in bytes, 0 for no limit
+    @returns 0 on success, < 0 if budget is too small for the host
+*/
+int
+enet_host_memory_budget (ENetHost * host, size_t budget, size_t peerBudget)
+{
+    if (budget != 0 && budget <= enet_host_fixed_memory (host))
+      return -1;
+
+    host -> memoryBudget = budget;
+    host -> peerMemoryBudget = peerBudget;
+    host -> memoryOverBudget = 1;
+
+    return 0;
+}
+
+/** Returns the memory a host holds for itself rather than for its peers: the host, its peer
+    array and tables.  Shedding peers never brings host->memoryUsage below it.
+*/
+size_t
+enet_host_fixed_memory (ENetHost * host)
+{
+    size_t peerMemory = 0;
+    ENetPeer * currentPeer;
+
+    for (currentPeer = host -> peers;
+         currentPeer < & host -> peers [host -> peerCount];
+         ++ currentPeer)
+      peerMemory += currentPeer -> memoryUsage;
+
+    return host -> memoryUsage - peerMemory;
+}
+
+/** Charges memory to a host, and to one of its peers unless peer is NULL. */
+void
+enet_host_charge_memory (ENetHost * host, ENetPeer * peer, size_t size)
+{
+    host -> memoryUsage += size;
+    if (host -> memoryBudget != 0 && host -> memoryUsage > host -> memoryBudget)
+      host -> memoryOverBudget = 1;
+
+    if (peer != NULL)
+    {
+       peer -> memoryUsage += size;
+       if (host -> peerMemoryBudget != 0 && peer -> memoryUsage > host -> peerMemoryBudget)
+         host -> memoryOverBudget = 1;
+    }
+}
+
+void
+enet_host_release_memory (ENetHost * host, ENetPeer * peer, size_t size)
+{
+    host -> memoryUsage -= size;
+
+    if (peer != NULL)
+      peer -> memoryUsage -= size;
+}
+
+/** Allocates memory charged to a host, and to one of its peers unless peer is NULL. */
+void *
+enet_host_malloc (ENetHost * host, ENetPeer * peer, size_t size)
+{
+    void * memory = enet_allocator_malloc (host -> allocator, size);
+
+    if (memory != NULL)
+      enet_host_charge_memory (host, peer, size);
+
+    return memory;
+}
+
+/** Frees memory allocated with enet_host_malloc() with the same host, peer and size. */
+void
+enet_host_free (ENetHost * host, ENetPeer * peer, void * memory, size_t size)
+{
+    enet_allocator_free (host -> allocator, memory);
+
+    enet_host_release_memory (host, peer, size);
+}
+
 void
 enet_host_bandwidth_throttle (ENetHost * host)
 {
@@ -357,7 +807,7 @@ enet_host_bandwidth_throttle (ENetHost * host)
              peer < & host -> peers [host -> peerCount];
             ++ peer)
         {
-            if (peer -> state != ENET_PEER_STATE_CONNECTED && peer -> state != ENET_PEER_STATE_DISCONNECT_LATER)
+            if (ENET_PEER_STATE (host, peer) != ENET_PEER_STATE_CONNECTED && ENET_PEER_STATE (host, peer) != ENET_PEER_STATE_DISCONNECT_LATER)
               continue;
 
             dataTotal += peer -> outgoingDataTotal;
@@ -379,7 +829,7 @@ enet_host_bandwidth_throttle (ENetHost * host)
         {
             enet_uint32 peerBandwidth;
             
-            if ((peer -> state != ENET_PEER_STATE_CONNECTED && peer -> state != ENET_PEER_STATE_DISCONNECT_LATER) ||
+            if ((ENET_PEER_STATE (host, peer) != ENET_PEER_STATE_CONNECTED && ENET_PEER_STATE (host, peer) != ENET_PEER_STATE_DISCONNECT_LATER) ||
                 peer -> incomingBandwidth == 0 ||
                 peer -> outgoingBandwidthThrottleEpoch == timeCurrent)
               continue;
@@ -420,7 +870,7 @@ enet_host_bandwidth_throttle (ENetHost * host)
              peer < & host -> peers [host -> peerCount];
              ++ peer)
         {
-            if ((peer -> state != ENET_PEER_STATE_CONNECTED && peer -> state != ENET_PEER_STATE_DISCONNECT_LATER) ||
+            if ((ENET_PEER_STATE (host, peer) != ENET_PEER_STATE_CONNECTED && ENET_PEER_STATE (host, peer) != ENET_PEER_STATE_DISCONNECT_LATER) ||
                 peer -> outgoingBandwidthThrottleEpoch == timeCurrent)
               continue;
 
@@ -454,7 +904,7 @@ enet_host_bandwidth_throttle (ENetHost * host)
                 peer < & host -> peers [host -> peerCount];
                 ++ peer)
            {
-               if ((peer -> state != ENET_PEER_STATE_CONNECTED && peer -> state != ENET_PEER_STATE_DISCONNECT_LATER) ||
+               if ((ENET_PEER_STATE (host, peer) != ENET_PEER_STATE_CONNECTED && ENET_PEER_STATE (host, peer) != ENET_PEER_STATE_DISCONNECT_LATER) ||
                    peer -> incomingBandwidthThrottleEpoch == timeCurrent)
                  continue;
 
@@ -474,7 +924,7 @@ enet_host_bandwidth_throttle (ENetHost * host)
             peer < & host -> peers [host -> peerCount];
             ++ peer)
        {
-           if (peer -> state != ENET_PEER_STATE_CONNECTED && peer -> state != ENET_PEER_STATE_DISCONNECT_LATER)
+           if (ENET_PEER_STATE (host, peer) != ENET_PEER_STATE_CONNECTED && ENET_PEER_STATE (host, peer) != ENET_PEER_STATE_DISCONNECT_LATER)
              continue;
 
            command.header.command = ENET_PROTOCOL_COMMAND_BANDWIDTH_LIMIT | ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE;
@@ -4,6 +4,7 @@
 */
 #include <string.h>
 #define ENET_BUILDING_LIB 1
+#include "enet/utility.h"
 #include "enet/enet.h"
 
 /** @defgroup Packet ENet packet functions 
@@ -19,7 +20,21 @@
 ENetPacket *
 enet_packet_create (const void * data, size_t dataLength, enet_uint32 flags)
 {
-    ENetPacket * packet = (ENetPacket *) enet_malloc (sizeof (ENetPacket));
+    return enet_packet_create_with_allocator (NULL, data, dataLength, flags);
+}
+
+/** Creates a packet whose memory is allocated with an allocator rather than the global callbacks.
+    @param allocator    allocator of the packet and its data, NULL for the global callbacks; it must remain valid until the packet is destroyed
+    @param dataContents initial contents of the packet's data; the packet's data will remain uninitialized if dataContents is NULL.
+    @param dataLength   size of the data allocated for this packet
+    @param flags        flags for this packet as described for the ENetPacket structure.
+    @returns the packet on success, NULL on failure
+    @sa enet_host_create_with_allocator()
+*/
+ENetPacket *
+enet_packet_create_with_allocator (const ENetAllocator * allocator, const void * data, size_t dataLength, enet_uint32 flags)
+{
+    ENetPacket * packet = (ENetPacket *) enet_allocator_malloc (allocator, sizeof (ENetPacket));
     if (packet == NULL)
       return NULL;
 
@@ -30,10 +45,10 @@ enet_packet_create (const void * data, size_t dataLength, enet_uint32 flags)
       packet -> data = NULL;
     else
     {
-       packet -> data = (enet_uint8 *) enet_malloc (dataLength);
+       packet -> data = (enet_uint8 *) enet_allocator_malloc (allocator, dataLength);
        if (packet -> data == NULL)
        {
-          enet_free (packet);
+          enet_allocator_free (allocator, packet);
           return NULL;
        }
 
@@ -46,10 +61,166 @@ enet_packet_create (const void * data, size_t dataLength, enet_uint32 flags)
     packet -> dataLength = dataLength;
     packet -> freeCallback = NULL;
     packet -> userData = NULL;
+    packet -> segments = NULL;
+    packet -> segmentCount = 0;
+    packet -> allocator = allocator;
+    packet -> fragmentTables = NULL;
 
     return packet;
 }
 
+/** Creates a packet whose data is made of several buffers, sent without being copied into one.
+    @param segments     buffers holding the packet data in order; the buffer descriptions are copied, but the data they point to is not and must remain valid until the packet is destroyed
+    @param segmentCount number of buffers
+    @param flags        flags for this packet as described for the ENetPacket structure; ENET_PACKET_FLAG_NO_ALLOCATE is implied.
+    @returns the packet on success, NULL on failure
+*/
+ENetPacket *
+enet_packet_create_segments (const ENetBuffer * segments, size_t segmentCount, enet_uint32 flags)
+{
+    ENetPacket * packet;
+    size_t segment, dataLength = 0;
+
+    if (segmentCount <= 1)
+      return enet_packet_create (segmentCount > 0 ? segments -> data : NULL, 
+                                 segmentCount > 0 ? segments -> dataLength : 0, 
+                                 flags | ENET_PACKET_FLAG_NO_ALLOCATE);
+
+    packet = (ENetPacket *) enet_malloc (sizeof (ENetPacket) + segmentCount * sizeof (ENetBuffer));
+    if (packet == NULL)
+      return NULL;
+
+    packet -> segments = (ENetBuffer *) (packet + 1);
+    packet -> segmentCount = segmentCount;
+
+    for (segment = 0; segment < segmentCount; ++ segment)
+    {
+       packet -> segments [segment] = segments [segment];
+
+       dataLength += segments [segment].dataLength;
+    }
+
+    packet -> referenceCount = 0;
+    packet -> flags = flags | ENET_PACKET_FLAG_NO_ALLOCATE;
+    packet -> data = NULL;
+    packet -> dataLength = dataLength;
+    packet -> freeCallback = NULL;
+    packet -> userData = NULL;
+    packet -> allocator = NULL;
+    packet -> fragmentTables = NULL;
+
+    return packet;
+}
+
+/** Describes a range of the data of a packet as a list of buffers.
+    @param packet      packet holding the data
+    @param offset      offset of the range in the packet data
+    @param length      length of the range
+    @param buffers     buffers to fill, at most bufferCount of them
+    @param bufferCount number of buffers available
+    @returns the number of buffers needed to describe the whole range, which may exceed bufferCount
+*/
+size_t
+enet_packet_get_buffers (const ENetPacket * packet, size_t offset, size_t length, ENetBuffer * buffers, size_t bufferCount)
+{
+    const ENetBuffer * segment, * segmentEnd;
+    size_t count = 0;
+
+    if (packet -> segments == NULL)
+    {
+       if (bufferCount > 0)
+       {
+          buffers -> data = packet -> data + offset;
+          buffers -> dataLength = length;
+       }
+
+       return 1;
+    }
+
+    segment = packet -> segments;
+    segmentEnd = & packet -> segments [packet -> segmentCount];
+
+    while (segment < segmentEnd && offset >= segment -> dataLength)
+    {
+       offset -= segment -> dataLength;
+       ++ segment;
+    }
+
+    for (; segment < segmentEnd && length > 0; ++ segment)
+    {
+       size_t segmentLength = segment -> dataLength - offset;
+
+       if (segmentLength > length)
+         segmentLength = length;
+
+       if (count < bufferCount)
+       {
+          buffers [count].data = (enet_uint8 *) segment -> data + offset;
+          buffers [count].dataLength = segmentLength;
+       }
+
+       ++ count;
+       length -= segmentLength;
+       offset = 0;
+    }
+
+    if (count == 0)
+    {
+       if (bufferCount > 0)
+       {
+          buffers -> data = NULL;
+          buffers -> dataLength = 0;
+       }
+
+       count = 1;
+    }
+
+    return count;
+}
+
+/** Copies a range of the data of a packet, whether it is contiguous or made of segments.
+    @param packet packet holding the data
+    @param offset offset of the range in the packet data
+    @param length length of the range
+    @param data   destination of the copy, at least length bytes
+*/
+void
+enet_packet_copy_data (const ENetPacket * packet, size_t offset, size_t length, void * data)
+{
+    enet_uint8 * destination = (enet_uint8 *) data;
+    const ENetBuffer * segment, * segmentEnd;
+
+    if (packet -> segments == NULL)
+    {
+       memcpy (destination, packet -> data + offset, length);
+
+       return;
+    }
+
+    segment = packet -> segments;
+    segmentEnd = & packet -> segments [packet -> segmentCount];
+
+    while (segment < segmentEnd && offset >= segment -> dataLength)
+    {
+       offset -= segment -> dataLength;
+       ++ segment;
+    }
+
+    for (; segment < segmentEnd && length > 0; ++ segment)
+    {
+       size_t segmentLength = segment -> dataLength - offset;
+
+       if (segmentLength > length)
+         segmentLength = length;
+
+       memcpy (destination, (const enet_uint8 *) segment -> data + offset, segmentLength);
+
+       destination += segmentLength;
+       length -= segmentLength;
+       offset = 0;
+    }
+}
+
 /** Destroys the packet and deallocates its data.
     @param packet packet to be destroyed
 */
@@ -61,10 +232,67 @@ enet_packet_destroy (ENetPacket * packet)
 
     if (packet -> freeCallback != NULL)
       (* packet -> freeCallback) (packet);
+    while (packet -> fragmentTables != NULL)
+    {
+       ENetFragmentTable * table = packet -> fragmentTables;
+
+       packet -> fragmentTables = table -> next;
+
+       enet_allocator_free (packet -> allocator, table);
+    }
     if (! (packet -> flags & ENET_PACKET_FLAG_NO_ALLOCATE) &&
         packet -> data != NULL)
-      enet_free (packet -> data);
-    enet_free (packet);
+      enet_allocator_free (packet -> allocator, packet -> data);
+    enet_allocator_free (packet -> allocator, packet);
+}
+
+/** Returns the fragment headers of a packet split at fragmentLength, building them the first time
+    the packet is sent at that length.  The table lives as long as the packet, so a packet broadcast
+    to many peers is only split once per fragment length in use.
+    @returns the table, or NULL if it could not be allocated
+*/
+ENetFragmentTable *
+enet_packet_fragment_table (ENetPacket * packet, enet_uint32 fragmentLength)
+{
+    ENetFragmentTable * table;
+    enet_uint32 fragmentCount = (packet -> dataLength + fragmentLength - 1) / fragmentLength,
+                fragmentNumber,
+                fragmentOffset;
+
+    for (table = packet -> fragmentTables; table != NULL; table = table -> next)
+    {
+       if (table -> fragmentLength == fragmentLength &&
+           table -> fragmentCount == fragmentCount &&
+           ENET_NET_TO_HOST_32 (table -> fragments [0].totalLength) == packet -> dataLength)
+         return table;
+    }
+
+    table = (ENetFragmentTable *) enet_allocator_malloc (packet -> allocator, sizeof (ENetFragmentTable) + (fragmentCount - 1) * sizeof (ENetProtocolSendFragment));
+    if (table == NULL)
+      return NULL;
+
+    table -> fragmentLength = fragmentLength;
+    table -> fragmentCount = fragmentCount;
+
+    for (fragmentNumber = 0, fragmentOffset = 0;
+         fragmentNumber < fragmentCount;
+         ++ fragmentNumber, fragmentOffset += fragmentLength)
+    {
+       ENetProtocolSendFragment * fragment = & table -> fragments [fragmentNumber];
+
+       memset (& fragment -> header, 0, sizeof (fragment -> header));
+       fragment -> startSequenceNumber = 0;
+       fragment -> dataLength = ENET_HOST_TO_NET_16 (ENET_MIN (fragmentLength, packet -> dataLength - fragmentOffset));
+       fragment -> fragmentCount = ENET_HOST_TO_NET_32 (fragmentCount);
+       fragment -> fragmentNumber = ENET_HOST_TO_NET_32 (fragmentNumber);
+       fragment -> totalLength = ENET_HOST_TO_NET_32 (packet -> dataLength);
+       fragment -> fragmentOffset = ENET_HOST_TO_NET_32 (fragmentOffset);
+    }
+
+    table -> next = packet -> fragmentTables;
+    packet -> fragmentTables = table;
+
+    return table;
 }
 
 /** Attempts to resize the data in the packet to length specified in the 
@@ -78,6 +306,9 @@ enet_packet_resize (ENetPacket * packet, size_t dataLength)
 {
     enet_uint8 * newData;
    
+    if (packet -> segments != NULL && dataLength > packet -> dataLength)
+      return -1;
+
     if (dataLength <= packet -> dataLength || (packet -> flags & ENET_PACKET_FLAG_NO_ALLOCATE))
     {
        packet -> dataLength = dataLength;
@@ -85,12 +316,12 @@ enet_packet_resize (ENetPacket * packet, size_t dataLength)
        return 0;
     }
 
-    newData = (enet_uint8 *) enet_malloc (dataLength);
+    newData = (enet_uint8 *) enet_allocator_malloc (packet -> allocator, dataLength);
     if (newData == NULL)
       return -1;
 
     memcpy (newData, packet -> data, packet -> dataLength);
-    enet_free (packet -> data);
+    enet_allocator_free (packet -> allocator, packet -> data);
     
     packet -> data = newData;
     packet -> dataLength = dataLength;
@@ -58,6 +58,60 @@ enet_peer_throttle_configure (ENetPeer * peer, enet_uint32 interval, enet_uint32
     enet_peer_queue_outgoing_command (peer, & command, NULL, 0, 0);
 }
 
+/** Configures how the outgoing packets of a channel share the datagrams sent to a peer.
+
+    Each datagram is filled first from the channels of the highest priority that have
+    packets ready to send.  Channels of equal priority share the datagram by deficit round
+    robin, each one sending about weight times the MTU of the peer per round, so that a
+    bulk transfer on one channel cannot starve small packets on another.  Retransmissions
+    and protocol commands are always sent before any channel.  The settings only affect
+    the local side and are reset when the peer disconnects.
+
+    @param peer peer to configure
+    @param channelID channel to configure
+    @param priority priority of the channel, higher priorities are sent first; the default value is 0.
+    @param weight share of the channel among channels of equal priority; the default value is 1.
+    @retval 0 on success
+    @retval < 0 on failure
+*/
+int
+enet_peer_channel_configure (ENetPeer * peer, enet_uint8 channelID, enet_uint8 priority, enet_uint16 weight)
+{
+    ENetChannel * channel;
+
+    if (channelID >= peer -> channelCount || weight == 0)
+      return -1;
+
+    channel = & peer -> channels [channelID];
+    channel -> outgoingPriority = priority;
+    channel -> outgoingWeight = weight;
+
+    return 0;
+}
+
+/** Sets how long unreliable packets of a channel may wait to be sent.
+
+    Unreliable and unsequenced packets still queued when their lifetime has passed are
+    dropped without being sent, so that a congested peer receives fresh data instead of
+    stale updates.  Reliable packets are never dropped.
+
+    @param peer peer to configure
+    @param channelID channel to configure
+    @param lifetime time, in milliseconds, after which an unsent packet is dropped, or 0 to never drop packets; the default value is 0.
+    @retval 0 on success
+    @retval < 0 on failure
+*/
+int
+enet_peer_channel_lifetime (ENetPeer * peer, enet_uint8 channelID, enet_uint32 lifetime)
+{
+    if (channelID >= peer -> channelCount)
+      return -1;
+
+    peer -> channels [channelID].outgoingLifetime = lifetime;
+
+    return 0;
+}
+
 int
 enet_peer_throttle (ENetPeer * peer, enet_uint32 rtt)
 {
@@ -89,11 +143,23 @@ enet_peer_throttle (ENetPeer * peer, enet_uint32 rtt)
     return 0;
 }
 
+static int
+enet_peer_queue_full (ENetPeer * peer, size_t dataLength)
+{
+   ENetHost * host = peer -> host;
+
+   return (peer -> queueLengthLimit != 0 && peer -> queuedLength != 0 && peer -> queuedLength + dataLength > peer -> queueLengthLimit) ||
+          (peer -> queueCommandLimit != 0 && peer -> queuedCommands >= peer -> queueCommandLimit) ||
+          (host -> queueLengthLimit != 0 && host -> queuedLength != 0 && host -> queuedLength + dataLength > host -> queueLengthLimit) ||
+          (host -> queueCommandLimit != 0 && host -> queuedCommands >= host -> queueCommandLimit);
+}
+
 /** Queues a packet to be sent.
     @param peer destination for the packet
     @param channelID channel on which to send
     @param packet packet to send
     @retval 0 on success
+    @retval -2 if the outgoing queue of the peer or its host is full, see enet_peer_queue_room()
     @retval < 0 on failure
 */
 int
@@ -101,6 +167,7 @@ enet_peer_send (ENetPeer * peer, enet_uint8 channelID, ENetPacket * packet)
 {
    ENetChannel * channel = & peer -> channels [channelID];
    ENetProtocol command;
+   ENetOutgoingCommand * outgoingCommand;
    size_t fragmentLength;
 
    if (peer -> state != ENET_PEER_STATE_CONNECTED ||
@@ -108,19 +175,25 @@ enet_peer_send (ENetPeer * peer, enet_uint8 channelID, ENetPacket * packet)
        packet -> dataLength > ENET_PROTOCOL_MAXIMUM_PACKET_SIZE)
      return -1;
 
-   fragmentLength = peer -> mtu - sizeof (ENetProtocolHeader) - sizeof (ENetProtocolSendFragment);
-   if (peer -> host -> checksum != NULL)
-     fragmentLength -= sizeof(enet_uint32);
+   if (enet_peer_queue_full (peer, packet -> dataLength))
+   {
+      /* streams retry on their own as the queues drain */
+      if (! (packet -> flags & ENET_PACKET_FLAG_STREAM))
+        peer -> queueBlocked = 1;
+
+      return -2;
+   }
+
+   fragmentLength = enet_peer_fragment_length (peer);
 
    if (packet -> dataLength > fragmentLength)
    {
-      enet_uint32 fragmentCount = (packet -> dataLength + fragmentLength - 1) / fragmentLength,
-             fragmentNumber,
-             fragmentOffset;
+      enet_uint32 fragmentCount = (packet -> dataLength + fragmentLength - 1) / fragmentLength;
       enet_uint8 commandNumber;
       enet_uint16 startSequenceNumber; 
-      ENetList fragments;
-      ENetOutgoingCommand * fragment;
+      ENetFragmentTable * table;
+      ENetOutgoingFragments * fragments;
+      size_t stateCount;
 
       if (fragmentCount > ENET_PROTOCOL_MAXIMUM_FRAGMENT_COUNT)
         return -1;
@@ -136,55 +209,45 @@ enet_peer_send (ENetPeer * peer, enet_uint8 channelID, ENetPacket * packet)
          commandNumber = ENET_PROTOCOL_COMMAND_SEND_FRAGMENT | ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE;
          startSequenceNumber = ENET_HOST_TO_NET_16 (channel -> outgoingReliableSequenceNumber + 1);
       }
-        
-      enet_list_clear (& fragments);
 
-      for (fragmentNumber = 0,
-             fragmentOffset = 0;
-           fragmentOffset < packet -> dataLength;
-           ++ fragmentNumber,
-             fragmentOffset += fragmentLength)
-      {
-         if (packet -> dataLength - fragmentOffset < fragmentLength)
-           fragmentLength = packet -> dataLength - fragmentOffset;
+      table = enet_packet_fragment_table (packet, fragmentLength);
+      if (table == NULL)
+        return -1;
 
-         fragment = (ENetOutgoingCommand *) enet_malloc (sizeof (ENetOutgoingCommand));
-         if (fragment == NULL)
-         {
-            while (! enet_list_empty (& fragments))
-            {
-               fragment = (ENetOutgoingCommand *) enet_list_remove (enet_list_begin (& fragments));
-               
-               enet_free (fragment);
-            }
-            
-            return -1;
-         }
-         
-         fragment -> fragmentOffset = fragmentOffset;
-         fragment -> fragmentLength = fragmentLength;
-         fragment -> packet = packet;
-         fragment -> command.header.command = commandNumber;
-         fragment -> command.header.channelID = channelID;
-         fragment -> command.sendFragment.startSequenceNumber = startSequenceNumber;
-         fragment -> command.sendFragment.dataLength = ENET_HOST_TO_NET_16 (fragmentLength);
-         fragment -> command.sendFragment.fragmentCount = ENET_HOST_TO_NET_32 (fragmentCount);
-         fragment -> command.sendFragment.fragmentNumber = ENET_HOST_TO_NET_32 (fragmentNumber);
-         fragment -> command.sendFragment.totalLength = ENET_HOST_TO_NET_32 (packet -> dataLength);
-         fragment -> command.sendFragment.fragmentOffset = ENET_NET_TO_HOST_32 (fragmentOffset);
-        
-         enet_list_insert (enet_list_end (& fragments), fragment);
-      }
+      /* the fragments share the headers of the table; only a reliable packet needs a state per fragment */
+      stateCount = commandNumber & ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE ? fragmentCount : 0;
 
-      packet -> referenceCount += fragmentNumber;
+      outgoingCommand = (ENetOutgoingCommand *) enet_host_malloc (peer -> host, peer, sizeof (ENetOutgoingCommand) + sizeof (ENetOutgoingFragments) + stateCount * sizeof (ENetOutgoingFragment));
+      if (outgoingCommand == NULL)
+        return -1;
 
-      while (! enet_list_empty (& fragments))
+      fragments = (ENetOutgoingFragments *) (outgoingCommand + 1);
+      fragments -> table = table;
+      fragments -> fragmentCount = fragmentCount;
+      fragments -> sentFragments = 0;
+      fragments -> acknowledgedFragments = 0;
+      fragments -> lostFragments = 0;
+      fragments -> states = NULL;
+      if (stateCount > 0)
       {
-         fragment = (ENetOutgoingCommand *) enet_list_remove (enet_list_begin (& fragments));
- 
-         enet_peer_setup_outgoing_command (peer, fragment);
+         fragments -> states = (ENetOutgoingFragment *) (fragments + 1);
+
+         memset (fragments -> states, 0, stateCount * sizeof (ENetOutgoingFragment));
       }
 
+      outgoingCommand -> fragmentOffset = 0;
+      outgoingCommand -> fragmentLength = fragmentLength;
+      outgoingCommand -> fragments = fragments;
+      outgoingCommand -> packet = packet;
+      outgoingCommand -> command.sendFragment = table -> fragments [0];
+      outgoingCommand -> command.header.command = commandNumber;
+      outgoingCommand -> command.header.channelID = channelID;
+      outgoingCommand -> command.sendFragment.startSequenceNumber = startSequenceNumber;
+
+      ++ packet -> referenceCount;
+
+      enet_peer_setup_outgoing_command (peer, outgoingCommand);
+
       return 0;
    }
 
@@ -199,6 +262,8 @@ enet_peer_send (ENetPeer * peer, enet_uint8 channelID, ENetPacket * packet)
    if (packet -> flags & ENET_PACKET_FLAG_RELIABLE || channel -> outgoingUnreliableSequenceNumber >= 0xFFFF)
    {
       command.header.command = ENET_PROTOCOL_COMMAND_SEND_RELIABLE | ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE;
+      if (packet -> flags & ENET_PACKET_FLAG_STREAM)
+        command.header.command |= ENET_PROTOCOL_COMMAND_FLAG_STREAM;
       command.sendReliable.dataLength = ENET_HOST_TO_NET_16 (packet -> dataLength);
    }
    else
@@ -207,12 +272,327 @@ enet_peer_send (ENetPeer * peer, enet_uint8 channelID, ENetPacket * packet)
       command.sendUnreliable.dataLength = ENET_HOST_TO_NET_16 (packet -> dataLength);
    }
 
-   if (enet_peer_queue_outgoing_command (peer, & command, packet, 0, packet -> dataLength) == NULL)
+   outgoingCommand = enet_peer_queue_outgoing_command (peer, & command, packet, 0, packet -> dataLength);
+   if (outgoingCommand == NULL)
      return -1;
 
+   if (channel -> fec != NULL)
+     enet_peer_fec_encode (peer, channelID, outgoingCommand);
+
    return 0;
 }
 
+/** Queues a packet to be sent, superseding any packet with the same key still queued on the channel.
+
+    Meant for state updates of which only the newest one matters: if a packet queued earlier
+    with the same key and kind has not been sent yet, it is released and the new packet takes
+    its place and sequence number instead of being queued behind it.  Bandwidth then goes to
+    fresh data, and the queue of a slow peer holds at most one packet per key.  Packets that
+    need fragmentation, and channels with forward error correction, are queued as by
+    enet_peer_send().
+    @param peer destination for the packet
+    @param channelID channel on which to send
+    @param packet packet to send
+    @param key non-zero key identifying the state carried by the packet, 0 to never coalesce
+    @retval 0 on success
+    @retval -2 if the outgoing queue of the peer or its host is full, see enet_peer_queue_room()
+    @retval < 0 on failure
+*/
+int
+enet_peer_send_coalesced (ENetPeer * peer, enet_uint8 channelID, ENetPacket * packet, enet_uint32 key)
+{
+   ENetChannel * channel = & peer -> channels [channelID];
+   ENetOutgoingCommand * outgoingCommand;
+   ENetListIterator currentCommand;
+   ENetList * queue;
+   enet_uint8 commandNumber;
+   size_t fragmentLength;
+   int result;
+
+   if (peer -> state != ENET_PEER_STATE_CONNECTED ||
+       channelID >= peer -> channelCount ||
+       packet -> dataLength > ENET_PROTOCOL_MAXIMUM_PACKET_SIZE)
+     return -1;
+
+   fragmentLength = enet_peer_fragment_length (peer);
+
+   if (key == 0 || channel -> fec != NULL || packet -> dataLength > fragmentLength)
+     return enet_peer_send (peer, channelID, packet);
+
+   if ((packet -> flags & (ENET_PACKET_FLAG_RELIABLE | ENET_PACKET_FLAG_UNSEQUENCED)) == ENET_PACKET_FLAG_UNSEQUENCED)
+     commandNumber = ENET_PROTOCOL_COMMAND_SEND_UNSEQUENCED;
+   else
+   if (packet -> flags & ENET_PACKET_FLAG_RELIABLE || channel -> outgoingUnreliableSequenceNumber >= 0xFFFF)
+     commandNumber = ENET_PROTOCOL_COMMAND_SEND_RELIABLE;
+   else
+     commandNumber = ENET_PROTOCOL_COMMAND_SEND_UNRELIABLE;
+
+   queue = commandNumber == ENET_PROTOCOL_COMMAND_SEND_RELIABLE ? & channel -> outgoingReliableCommands : & channel -> outgoingUnreliableCommands;
+
+   for (currentCommand = enet_list_begin (queue);
+        currentCommand != enet_list_end (queue);
+        currentCommand = enet_list_next (currentCommand))
+   {
+      outgoingCommand = (ENetOutgoingCommand *) currentCommand;
+
+      if (outgoingCommand -> coalesceKey != key ||
+          (outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK) != commandNumber)
+        continue;
+
+      enet_peer_release_outgoing_command (peer, outgoingCommand);
+
+      -- outgoingCommand -> packet -> referenceCount;
+
+      if (outgoingCommand -> packet -> referenceCount == 0)
+        enet_packet_destroy (outgoingCommand -> packet);
+
+      ++ packet -> referenceCount;
+
+      outgoingCommand -> packet = packet;
+      outgoingCommand -> fragmentLength = packet -> dataLength;
+      outgoingCommand -> queueTime = peer -> host -> serviceTime;
+
+      switch (commandNumber)
+      {
+      case ENET_PROTOCOL_COMMAND_SEND_RELIABLE:
+         outgoingCommand -> command.sendReliable.dataLength = ENET_HOST_TO_NET_16 (packet -> dataLength);
+         break;
+
+      case ENET_PROTOCOL_COMMAND_SEND_UNRELIABLE:
+         outgoingCommand -> command.sendUnreliable.dataLength = ENET_HOST_TO_NET_16 (packet -> dataLength);
+         break;
+
+      default:
+         outgoingCommand -> command.sendUnsequenced.dataLength = ENET_HOST_TO_NET_16 (packet -> dataLength);
+         break;
+      }
+
+      peer -> queuedLength += packet -> dataLength;
+      ++ peer -> queuedCommands;
+      peer -> host -> queuedLength += packet -> dataLength;
+      ++ peer -> host -> queuedCommands;
+
+      return 0;
+   }
+
+   result = enet_peer_send (peer, channelID, packet);
+   if (result < 0)
+     return result;
+
+   outgoingCommand = (ENetOutgoingCommand *) enet_list_back (queue);
+   outgoingCommand -> coalesceKey = key;
+
+   return 0;
+}
+
+/** Limits the data a host holds for a peer.
+
+    Packets sent to the peer are counted from the moment enet_peer_send() queues them until they are
+    acknowledged, dropped or sent unreliably.  Once the data held would go over a limit,
+    enet_peer_send() refuses packets with -2 instead of queuing them, and an ENET_EVENT_TYPE_WRITABLE
+    event follows once the data held has drained below half of the limits.  The limits are cleared
+    when the peer is reset.
+    @param peer peer to configure
+    @param length maximum bytes of packet data held, 0 for no limit
+    @param commands maximum protocol commands held, 0 for no limit
+    @sa enet_host_queue_limit()
+*/
+void
+enet_peer_queue_limit (ENetPeer * peer, size_t length, size_t commands)
+{
+   peer -> queueLengthLimit = length;
+   peer -> queueCommandLimit = commands;
+}
+
+/** Returns the largest packet sent to a peer in one piece: larger packets are fragmented.
+    @param peer destination of the packets
+*/
+size_t
+enet_peer_fragment_length (ENetPeer * peer)
+{
+   size_t fragmentLength = peer -> mtu - sizeof (ENetProtocolHeader) - sizeof (ENetProtocolSendFragment);
+
+   if (peer -> host -> checksum != NULL)
+     fragmentLength -= sizeof(enet_uint32);
+   if (ENET_PEER_EXTENDED_ID (peer))
+     fragmentLength -= sizeof (enet_uint16);
+
+   return fragmentLength;
+}
+
+/** Checks whether the outgoing queues of a peer and its host have room for a packet.
+
+    A packet always fits while nothing is held, however large it is.  If it does not fit, the peer
+    gets an ENET_EVENT_TYPE_WRITABLE event once the queues have drained below half of their limits.
+    @param peer destination of the packet
+    @param dataLength length of the packet
+    @retval 1 if enet_peer_send() would queue the packet
+    @retval 0 if it would refuse it with -2
+*/
+int
+enet_peer_queue_room (ENetPeer * peer, size_t dataLength)
+{
+   if (enet_peer_queue_full (peer, dataLength))
+   {
+      peer -> queueBlocked = 1;
+
+      return 0;
+   }
+
+   return 1;
+}
+
+static void
+enet_peer_stream_release (ENetStream * stream)
+{
+   if (-- stream -> referenceCount == 0)
+     enet_allocator_free (stream -> allocator, stream);
+}
+
+static void ENET_CALLBACK
+enet_peer_stream_packet_free (ENetPacket * packet)
+{
+   ENetStream * stream = (ENetStream *) packet -> userData;
+
+   stream -> queuedLength -= packet -> dataLength;
+
+   enet_peer_stream_release (stream);
+}
+
+/** Sends a stream of data to a peer without holding all of it in memory.
+
+    The data is pulled from the callback in chunks as the reliable window of the peer opens, at
+    most a window of data being queued or in transit at once.  Each chunk is a reliable packet
+    flagged ENET_PACKET_FLAG_STREAM that fits in one datagram, so the receiver never reassembles
+    more than a chunk either: it gets the chunks in order on the channel, then an empty chunk once
+    the callback has returned 0.  Only one stream may be sent at a time on a channel.
+    @param peer destination for the stream, which must support streams
+    @param channelID channel on which to send
+    @param callback function called from enet_host_service() and enet_host_flush() to supply the chunks, not NULL
+    @param userData passed to the callback
+    @retval 0 on success
+    @retval < 0 on failure
+*/
+int
+enet_peer_stream (ENetPeer * peer, enet_uint8 channelID, ENetStreamCallback callback, void * userData)
+{
+   ENetListIterator currentStream;
+   ENetStream * stream;
+
+   if (callback == NULL ||
+       peer -> state != ENET_PEER_STATE_CONNECTED ||
+       channelID >= peer -> channelCount ||
+       ! (peer -> capabilities & ENET_PROTOCOL_CAPABILITY_STREAM))
+     return -1;
+
+   for (currentStream = enet_list_begin (& peer -> outgoingStreams);
+        currentStream != enet_list_end (& peer -> outgoingStreams);
+        currentStream = enet_list_next (currentStream))
+   {
+      if (((ENetStream *) currentStream) -> channelID == channelID)
+        return -1;
+   }
+
+   stream = (ENetStream *) enet_allocator_malloc (peer -> host -> allocator, sizeof (ENetStream));
+   if (stream == NULL)
+     return -1;
+
+   stream -> channelID = channelID;
+   stream -> callback = callback;
+   stream -> userData = userData;
+   stream -> referenceCount = 1;
+   stream -> queuedLength = 0;
+   stream -> packet = NULL;
+   stream -> allocator = peer -> host -> allocator;
+
+   enet_list_insert (enet_list_end (& peer -> outgoingStreams), stream);
+
+   return 0;
+}
+
+/* Pulls chunks from the outgoing streams of a peer until each has a window of data queued or in
+   transit, or has no data available.  A stream is removed once its empty last chunk is queued,
+   and freed once all its chunks are acknowledged. */
+void
+enet_peer_pull_streams (ENetPeer * peer)
+{
+   ENetListIterator currentStream;
+   size_t chunkLength;
+
+   chunkLength = enet_peer_fragment_length (peer);
+
+   for (currentStream = enet_list_begin (& peer -> outgoingStreams);
+        currentStream != enet_list_end (& peer -> outgoingStreams); )
+   {
+      ENetStream * stream = (ENetStream *) currentStream;
+
+      currentStream = enet_list_next (currentStream);
+
+      while (stream -> packet != NULL || stream -> queuedLength + chunkLength <= peer -> windowSize)
+      {
+         ENetPacket * packet = stream -> packet;
+
+         if (packet == NULL)
+         {
+            int length;
+
+            packet = enet_packet_create_with_allocator (peer -> host -> allocator, NULL, chunkLength, ENET_PACKET_FLAG_RELIABLE | ENET_PACKET_FLAG_STREAM);
+            if (packet == NULL)
+              return;
+
+            length = stream -> callback (peer, stream -> channelID, packet -> data, chunkLength, stream -> userData);
+            if (length < 0)
+            {
+               enet_packet_destroy (packet);
+
+               break;
+            }
+
+            if ((size_t) length < chunkLength)
+              packet -> dataLength = length;
+            packet -> freeCallback = enet_peer_stream_packet_free;
+            packet -> userData = stream;
+
+            ++ stream -> referenceCount;
+            stream -> queuedLength += packet -> dataLength;
+         }
+
+         if (enet_peer_send (peer, stream -> channelID, packet) < 0)
+         {
+            stream -> packet = packet;
+
+            return;
+         }
+
+         stream -> packet = NULL;
+
+         if (packet -> dataLength == 0)
+         {
+            enet_list_remove (& stream -> streamList);
+
+            stream -> callback (peer, stream -> channelID, NULL, 0, stream -> userData);
+
+            enet_peer_stream_release (stream);
+
+            break;
+         }
+      }
+   }
+}
+
+/* Frees an incoming command removed from its queue, releasing the memory charged for it and its packet. */
+static void
+enet_peer_free_incoming_command (ENetPeer * peer, ENetIncomingCommand * incomingCommand)
+{
+    if (incomingCommand -> packet != NULL)
+      enet_host_release_memory (peer -> host, peer, sizeof (ENetPacket) + incomingCommand -> packet -> dataLength);
+
+    if (incomingCommand -> fragments != NULL)
+      enet_host_free (peer -> host, peer, incomingCommand -> fragments, (incomingCommand -> fragmentCount + 31) / 32 * sizeof (enet_uint32));
+
+    enet_host_free (peer -> host, peer, incomingCommand, sizeof (ENetIncomingCommand));
+}
+
 /** Attempts to dequeue any incoming queued packet.
     @param peer peer to dequeue packets from
     @param channelID holds the channel ID of the channel the packet was received on success
@@ -236,16 +616,13 @@ enet_peer_receive (ENetPeer * peer, enet_uint8 * channelID)
 
    -- packet -> referenceCount;
 
-   if (incomingCommand -> fragments != NULL)
-     enet_free (incomingCommand -> fragments);
-
-   enet_free (incomingCommand);
+   enet_peer_free_incoming_command (peer, incomingCommand);
 
    return packet;
 }
 
 static void
-enet_peer_reset_outgoing_commands (ENetList * queue)
+enet_peer_reset_outgoing_commands (ENetPeer * peer, ENetList * queue)
 {
     ENetOutgoingCommand * outgoingCommand;
 
@@ -253,6 +630,8 @@ enet_peer_reset_outgoing_commands (ENetList * queue)
     {
        outgoingCommand = (ENetOutgoingCommand *) enet_list_remove (enet_list_begin (queue));
 
+       enet_peer_release_outgoing_command (peer, outgoingCommand);
+
        if (outgoingCommand -> packet != NULL)
        {
           -- outgoingCommand -> packet -> referenceCount;
@@ -261,42 +640,58 @@ enet_peer_reset_outgoing_commands (ENetList * queue)
             enet_packet_destroy (outgoingCommand -> packet);
        }
 
-       enet_free (outgoingCommand);
+       enet_peer_free_outgoing_command (peer, outgoingCommand);
     }
 }
 
 static void
-enet_peer_remove_incoming_commands (ENetList * queue, ENetListIterator startCommand, ENetListIterator endCommand)
+enet_peer_remove_incoming_commands (ENetPeer * peer, ENetList * queue, ENetListIterator startCommand, ENetListIterator endCommand)
 {
     ENetListIterator currentCommand;    
     
     for (currentCommand = startCommand; currentCommand != endCommand; )
     {
        ENetIncomingCommand * incomingCommand = (ENetIncomingCommand *) currentCommand;
+       ENetPacket * packet = incomingCommand -> packet;
 
        currentCommand = enet_list_next (currentCommand);
 
        enet_list_remove (& incomingCommand -> incomingCommandList);
+
+       enet_peer_free_incoming_command (peer, incomingCommand);
  
-       if (incomingCommand -> packet != NULL)
+       if (packet != NULL)
        {
-          -- incomingCommand -> packet -> referenceCount;
+          -- packet -> referenceCount;
 
-          if (incomingCommand -> packet -> referenceCount == 0)
-            enet_packet_destroy (incomingCommand -> packet);
+          if (packet -> referenceCount == 0)
+            enet_packet_destroy (packet);
        }
-
-       if (incomingCommand -> fragments != NULL)
-         enet_free (incomingCommand -> fragments);
-
-       enet_free (incomingCommand);
     }
 }
 
 static void
-enet_peer_reset_incoming_commands (ENetList * queue)
+enet_peer_reset_incoming_commands (ENetPeer * peer, ENetList * queue)
 {
-    enet_peer_remove_incoming_commands(queue, enet_list_begin (queue), enet_list_end (queue));
+    enet_peer_remove_incoming_commands(peer, queue, enet_list_begin (queue), enet_list_end (queue));
+}
+
+/* Frees the unreliable data a peer holds to bring its memory back within budget: the unreliable
+   commands not sent yet, and the unreliable packets received but not dispatched yet. */
+void
+enet_peer_drop_unreliable (ENetPeer * peer)
+{
+    ENetChannel * channel;
+
+    for (channel = peer -> channels;
+         channel < & peer -> channels [peer -> channelCount];
+         ++ channel)
+    {
+        enet_peer_reset_incoming_commands (peer, & channel -> incomingUnreliableCommands);
+        enet_peer_reset_outgoing_commands (peer, & channel -> outgoingUnreliableCommands);
+    }
+
+    memset (peer -> outgoingUnreliableChannels, 0, sizeof (peer -> outgoingUnreliableChannels));
 }
  
 void
@@ -304,6 +699,9 @@ enet_peer_reset_queues (ENetPeer * peer)
 {
     ENetChannel * channel;
 
+    peer -> queueBlocked = 0;
+    peer -> lostFragments = 0;
+
     if (peer -> needsDispatch)
     {
        enet_list_remove (& peer -> dispatchList);
@@ -312,13 +710,13 @@ enet_peer_reset_queues (ENetPeer * peer)
     }
 
     while (! enet_list_empty (& peer -> acknowledgements))
-      enet_free (enet_list_remove (enet_list_begin (& peer -> acknowledgements)));
+      enet_host_free (peer -> host, peer, enet_list_remove (enet_list_begin (& peer -> acknowledgements)), sizeof (ENetAcknowledgement));
 
-    enet_peer_reset_outgoing_commands (& peer -> sentReliableCommands);
-    enet_peer_reset_outgoing_commands (& peer -> sentUnreliableCommands);
-    enet_peer_reset_outgoing_commands (& peer -> outgoingReliableCommands);
-    enet_peer_reset_outgoing_commands (& peer -> outgoingUnreliableCommands);
-    enet_peer_reset_incoming_commands (& peer -> dispatchedCommands);
+    enet_peer_reset_outgoing_commands (peer, & peer -> sentReliableCommands);
+    enet_peer_reset_outgoing_commands (peer, & peer -> sentUnreliableCommands);
+    enet_peer_reset_outgoing_commands (peer, & peer -> outgoingReliableCommands);
+    enet_peer_reset_outgoing_commands (peer, & peer -> outgoingUnreliableCommands);
+    enet_peer_reset_incoming_commands (peer, & peer -> dispatchedCommands);
 
     if (peer -> channels != NULL && peer -> channelCount > 0)
     {
@@ -326,15 +724,53 @@ enet_peer_reset_queues (ENetPeer * peer)
              channel < & peer -> channels [peer -> channelCount];
              ++ channel)
         {
-            enet_peer_reset_incoming_commands (& channel -> incomingReliableCommands);
-            enet_peer_reset_incoming_commands (& channel -> incomingUnreliableCommands);
+            enet_peer_reset_incoming_commands (peer, & channel -> incomingReliableCommands);
+            enet_peer_reset_incoming_commands (peer, & channel -> incomingUnreliableCommands);
+            enet_peer_reset_outgoing_commands (peer, & channel -> outgoingReliableCommands);
+            enet_peer_reset_outgoing_commands (peer, & channel -> outgoingUnreliableCommands);
+
+            enet_peer_fec_destroy (peer, channel);
         }
 
-        enet_free (peer -> channels);
+        enet_host_free (peer -> host, peer, peer -> channels, peer -> channelCount * sizeof (ENetChannel));
+    }
+
+    while (! enet_list_empty (& peer -> outgoingStreams))
+    {
+        ENetStream * stream = (ENetStream *) enet_list_remove (enet_list_begin (& peer -> outgoingStreams));
+
+        if (stream -> packet != NULL)
+          enet_packet_destroy (stream -> packet);
+
+        stream -> callback (peer, stream -> channelID, NULL, 0, stream -> userData);
+
+        enet_peer_stream_release (stream);
     }
 
     peer -> channels = NULL;
     peer -> channelCount = 0;
+
+    memset (peer -> outgoingReliableChannels, 0, sizeof (peer -> outgoingReliableChannels));
+    memset (peer -> outgoingUnreliableChannels, 0, sizeof (peer -> outgoingUnreliableChannels));
+    peer -> nextReliableChannel = 0;
+    peer -> nextUnreliableChannel = 0;
+}
+
+int
+enet_peer_has_outgoing_commands (ENetPeer * peer)
+{
+    size_t i;
+
+    if (! enet_list_empty (& peer -> outgoingReliableCommands) ||
+        ! enet_list_empty (& peer -> outgoingUnreliableCommands) ||
+        peer -> lostFragments > 0)
+      return 1;
+
+    for (i = 0; i < ENET_PEER_CHANNEL_MASK_SIZE; ++ i)
+      if (peer -> outgoingReliableChannels [i] | peer -> outgoingUnreliableChannels [i])
+        return 1;
+
+    return 0;
 }
 
 void
@@ -371,10 +807,10 @@ enet_peer_reset (ENetPeer * peer)
 {
     enet_peer_on_disconnect (peer);
         
-    peer -> outgoingPeerID = ENET_PROTOCOL_MAXIMUM_PEER_ID;
+    peer -> outgoingPeerID = ENET_PROTOCOL_MAXIMUM_EXTENDED_PEER_ID;
     peer -> connectID = 0;
 
-    peer -> state = ENET_PEER_STATE_DISCONNECTED;
+    enet_peer_set_state (peer, ENET_PEER_STATE_DISCONNECTED);
 
     peer -> incomingBandwidth = 0;
     peer -> outgoingBandwidth = 0;
@@ -417,10 +853,27 @@ enet_peer_reset (ENetPeer * peer)
     peer -> eventData = 0;
 
     memset (peer -> unsequencedWindow, 0, sizeof (peer -> unsequencedWindow));
+    memset (peer -> connectCookie, 0, sizeof (peer -> connectCookie));
+    peer -> capabilities = 0;
+    peer -> mtuProbeLimit = 0;
+    peer -> mtuProbeSize = 0;
+    peer -> mtuProbeTime = 0;
+    peer -> mtuProbeAttempts = 0;
+    peer -> mtuProbeAnswer = 0;
+    peer -> queueLengthLimit = 0;
+    peer -> queueCommandLimit = 0;
     
     enet_peer_reset_queues (peer);
 }
 
+/** Sets the state of a peer, along with its copy in the packed state array of its host. */
+void
+enet_peer_set_state (ENetPeer * peer, ENetPeerState state)
+{
+    peer -> state = state;
+    peer -> host -> peerStates [peer - peer -> host -> peers] = (enet_uint8) state;
+}
+
 /** Sends a ping request to a peer.
     @param peer destination for the ping request
     @remarks ping requests factor into the mean round trip time as designated by the 
@@ -548,7 +1001,7 @@ enet_peer_disconnect (ENetPeer * peer, enet_uint32 data)
     {
         enet_peer_on_disconnect (peer);
 
-        peer -> state = ENET_PEER_STATE_DISCONNECTING;
+        enet_peer_set_state (peer, ENET_PEER_STATE_DISCONNECTING);
     }
     else
     {
@@ -567,11 +1020,10 @@ void
 enet_peer_disconnect_later (ENetPeer * peer, enet_uint32 data)
 {   
     if ((peer -> state == ENET_PEER_STATE_CONNECTED || peer -> state == ENET_PEER_STATE_DISCONNECT_LATER) && 
-        ! (enet_list_empty (& peer -> outgoingReliableCommands) &&
-           enet_list_empty (& peer -> outgoingUnreliableCommands) && 
-           enet_list_empty (& peer -> sentReliableCommands)))
+        (enet_peer_has_outgoing_commands (peer) ||
+         ! enet_list_empty (& peer -> sentReliableCommands)))
     {
-        peer -> state = ENET_PEER_STATE_DISCONNECT_LATER;
+        enet_peer_set_state (peer, ENET_PEER_STATE_DISCONNECT_LATER);
         peer -> eventData = data;
     }
     else
@@ -596,13 +1048,14 @@ enet_peer_queue_acknowledgement (ENetPeer * peer, const ENetProtocol * command,
           return NULL;
     }
 
-    acknowledgement = (ENetAcknowledgement *) enet_malloc (sizeof (ENetAcknowledgement));
+    acknowledgement = (ENetAcknowledgement *) enet_host_malloc (peer -> host, peer, sizeof (ENetAcknowledgement));
     if (acknowledgement == NULL)
       return NULL;
 
     peer -> outgoingDataTotal += sizeof (ENetProtocolAcknowledge);
 
     acknowledgement -> sentTime = sentTime;
+    acknowledgement -> queueTime = peer -> host -> serviceTime;
     acknowledgement -> command = * command;
     
     enet_list_insert (enet_list_end (& peer -> acknowledgements), acknowledgement);
@@ -610,13 +1063,47 @@ enet_peer_queue_acknowledgement (ENetPeer * peer, const ENetProtocol * command,
     return acknowledgement;
 }
 
+/* Packet data an outgoing command holds: its whole packet if it sends it in fragments, its fragment otherwise. */
+#define ENET_OUTGOING_COMMAND_QUEUED_LENGTH(outgoingCommand) \
+    ((outgoingCommand) -> packet == NULL ? 0 : \
+     (outgoingCommand) -> fragments != NULL ? (outgoingCommand) -> packet -> dataLength : \
+     (outgoingCommand) -> fragmentLength)
+
+/* Discounts an outgoing command about to be freed from the data held for its peer and host. */
+void
+enet_peer_release_outgoing_command (ENetPeer * peer, const ENetOutgoingCommand * outgoingCommand)
+{
+    size_t length = ENET_OUTGOING_COMMAND_QUEUED_LENGTH (outgoingCommand);
+
+    peer -> queuedLength -= length;
+    -- peer -> queuedCommands;
+    peer -> host -> queuedLength -= length;
+    -- peer -> host -> queuedCommands;
+}
+
 void
 enet_peer_setup_outgoing_command (ENetPeer * peer, ENetOutgoingCommand * outgoingCommand)
 {
     ENetChannel * channel = & peer -> channels [outgoingCommand -> command.header.channelID];
+    size_t length = ENET_OUTGOING_COMMAND_QUEUED_LENGTH (outgoingCommand);
+
+    peer -> queuedLength += length;
+    ++ peer -> queuedCommands;
+    peer -> host -> queuedLength += length;
+    ++ peer -> host -> queuedCommands;
     
-    peer -> outgoingDataTotal += enet_protocol_command_size (outgoingCommand -> command.header.command) + outgoingCommand -> fragmentLength;
+    if (outgoingCommand -> fragments != NULL)
+      peer -> outgoingDataTotal += enet_protocol_command_size (outgoingCommand -> command.header.command) * outgoingCommand -> fragments -> fragmentCount +
+                                   outgoingCommand -> packet -> dataLength;
+    else
+      peer -> outgoingDataTotal += enet_protocol_command_size (outgoingCommand -> command.header.command) + outgoingCommand -> fragmentLength;
 
+    if ((outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK) == ENET_PROTOCOL_COMMAND_SEND_PARITY)
+    {
+       outgoingCommand -> reliableSequenceNumber = outgoingCommand -> command.header.reliableSequenceNumber;
+       outgoingCommand -> unreliableSequenceNumber = channel -> outgoingUnreliableSequenceNumber;
+    }
+    else
     if (outgoingCommand -> command.header.channelID == 0xFF)
     {
        ++ peer -> outgoingReliableSequenceNumber;
@@ -632,6 +1119,9 @@ enet_peer_setup_outgoing_command (ENetPeer * peer, ENetOutgoingCommand * outgoin
 
        outgoingCommand -> reliableSequenceNumber = channel -> outgoingReliableSequenceNumber;
        outgoingCommand -> unreliableSequenceNumber = 0;
+
+       if (outgoingCommand -> fragments != NULL)
+         channel -> outgoingReliableSequenceNumber += outgoingCommand -> fragments -> fragmentCount - 1;
     }
     else
     if (outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_FLAG_UNSEQUENCED)
@@ -651,6 +1141,8 @@ enet_peer_setup_outgoing_command (ENetPeer * peer, ENetOutgoingCommand * outgoin
     }
    
     outgoingCommand -> sendAttempts = 0;
+    outgoingCommand -> coalesceKey = 0;
+    outgoingCommand -> queueTime = peer -> host -> serviceTime;
     outgoingCommand -> sentTime = 0;
     outgoingCommand -> roundTripTimeout = 0;
     outgoingCommand -> roundTripTimeoutLimit = 0;
@@ -670,22 +1162,39 @@ enet_peer_setup_outgoing_command (ENetPeer * peer, ENetOutgoingCommand * outgoin
         break;
     }
 
+    if (outgoingCommand -> command.header.channelID >= peer -> channelCount)
+    {
+       if (outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE)
+         enet_list_insert (enet_list_end (& peer -> outgoingReliableCommands), outgoingCommand);
+       else
+         enet_list_insert (enet_list_end (& peer -> outgoingUnreliableCommands), outgoingCommand);
+    }
+    else
     if (outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE)
-      enet_list_insert (enet_list_end (& peer -> outgoingReliableCommands), outgoingCommand);
+    {
+       enet_list_insert (enet_list_end (& channel -> outgoingReliableCommands), outgoingCommand);
+
+       peer -> outgoingReliableChannels [outgoingCommand -> command.header.channelID / 32] |= 1u << (outgoingCommand -> command.header.channelID % 32);
+    }
     else
-      enet_list_insert (enet_list_end (& peer -> outgoingUnreliableCommands), outgoingCommand);
+    {
+       enet_list_insert (enet_list_end (& channel -> outgoingUnreliableCommands), outgoingCommand);
+
+       peer -> outgoingUnreliableChannels [outgoingCommand -> command.header.channelID / 32] |= 1u << (outgoingCommand -> command.header.channelID % 32);
+    }
 }
 
 ENetOutgoingCommand *
 enet_peer_queue_outgoing_command (ENetPeer * peer, const ENetProtocol * command, ENetPacket * packet, enet_uint32 offset, enet_uint16 length)
 {
-    ENetOutgoingCommand * outgoingCommand = (ENetOutgoingCommand *) enet_malloc (sizeof (ENetOutgoingCommand));
+    ENetOutgoingCommand * outgoingCommand = (ENetOutgoingCommand *) enet_host_malloc (peer -> host, peer, sizeof (ENetOutgoingCommand));
     if (outgoingCommand == NULL)
       return NULL;
 
     outgoingCommand -> command = * command;
     outgoingCommand -> fragmentOffset = offset;
     outgoingCommand -> fragmentLength = length;
+    outgoingCommand -> fragments = NULL;
     outgoingCommand -> packet = packet;
     if (packet != NULL)
       ++ packet -> referenceCount;
@@ -695,6 +1204,22 @@ enet_peer_queue_outgoing_command (ENetPeer * peer, const ENetProtocol * command,
     return outgoingCommand;
 }
 
+/* Frees an outgoing command, along with the state of the fragments allocated with it. */
+void
+enet_peer_free_outgoing_command (ENetPeer * peer, ENetOutgoingCommand * outgoingCommand)
+{
+    size_t size = sizeof (ENetOutgoingCommand);
+
+    if (outgoingCommand -> fragments != NULL)
+    {
+       size += sizeof (ENetOutgoingFragments);
+       if (outgoingCommand -> fragments -> states != NULL)
+         size += outgoingCommand -> fragments -> fragmentCount * sizeof (ENetOutgoingFragment);
+    }
+
+    enet_host_free (peer -> host, peer, outgoingCommand, size);
+}
+
 void
 enet_peer_dispatch_incoming_unreliable_commands (ENetPeer * peer, ENetChannel * channel)
 {
@@ -775,7 +1300,7 @@ enet_peer_dispatch_incoming_unreliable_commands (ENetPeer * peer, ENetChannel *
        droppedCommand = currentCommand;
     }
 
-    enet_peer_remove_incoming_commands (& channel -> incomingUnreliableCommands, enet_list_begin (& channel -> incomingUnreliableCommands), droppedCommand);
+    enet_peer_remove_incoming_commands (peer, & channel -> incomingUnreliableCommands, enet_list_begin (& channel -> incomingUnreliableCommands), droppedCommand);
 }
 
 void
@@ -926,7 +1451,7 @@ enet_peer_queue_incoming_command (ENetPeer * peer, const ENetProtocol * command,
        goto freePacket;
     }
 
-    incomingCommand = (ENetIncomingCommand *) enet_malloc (sizeof (ENetIncomingCommand));
+    incomingCommand = (ENetIncomingCommand *) enet_host_malloc (peer -> host, peer, sizeof (ENetIncomingCommand));
     if (incomingCommand == NULL)
       goto notifyError;
 
@@ -941,10 +1466,10 @@ enet_peer_queue_incoming_command (ENetPeer * peer, const ENetProtocol * command,
     if (fragmentCount > 0)
     { 
        if (fragmentCount <= ENET_PROTOCOL_MAXIMUM_FRAGMENT_COUNT)
-         incomingCommand -> fragments = (enet_uint32 *) enet_malloc ((fragmentCount + 31) / 32 * sizeof (enet_uint32));
+         incomingCommand -> fragments = (enet_uint32 *) enet_host_malloc (peer -> host, peer, (fragmentCount + 31) / 32 * sizeof (enet_uint32));
        if (incomingCommand -> fragments == NULL)
        {
-          enet_free (incomingCommand);
+          enet_host_free (peer -> host, peer, incomingCommand, sizeof (ENetIncomingCommand));
 
           goto notifyError;
        }
@@ -952,7 +1477,11 @@ enet_peer_queue_incoming_command (ENetPeer * peer, const ENetProtocol * command,
     }
 
     if (packet != NULL)
-      ++ packet -> referenceCount;
+    {
+       ++ packet -> referenceCount;
+
+       enet_host_charge_memory (peer -> host, peer, sizeof (ENetPacket) + packet -> dataLength);
+    }
 
     enet_list_insert (enet_list_next (currentCommand), incomingCommand);
 
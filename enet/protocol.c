@@ -23,9 +23,14 @@ static size_t commandSizes [ENET_PROTOCOL_COMMAND_COUNT] =
     sizeof (ENetProtocolSendUnsequenced),
     sizeof (ENetProtocolBandwidthLimit),
     sizeof (ENetProtocolThrottleConfigure),
-    sizeof (ENetProtocolSendFragment)
+    sizeof (ENetProtocolSendFragment),
+    sizeof (ENetProtocolSendParity),
+    sizeof (ENetProtocolConnectExtension),
+    sizeof (ENetProtocolMTUProbe)
 };
 
+static const enet_uint8 mtuProbePadding [ENET_PROTOCOL_MAXIMUM_MTU];
+
 size_t
 enet_protocol_command_size (enet_uint8 commandNumber)
 {
@@ -40,7 +45,7 @@ enet_protocol_change_state (ENetHost * host, ENetPeer * peer, ENetPeerState stat
     else
       enet_peer_on_disconnect (peer);
 
-    peer -> state = state;
+    enet_peer_set_state (peer, state);
 }
 
 static void
@@ -56,6 +61,16 @@ enet_protocol_dispatch_state (ENetHost * host, ENetPeer * peer, ENetPeerState st
     }
 }
 
+/* Whether the queues of a peer that refused a packet have drained below half of their limits. */
+static int
+enet_protocol_queue_drained (ENetHost * host, ENetPeer * peer)
+{
+    return (peer -> queueLengthLimit == 0 || peer -> queuedLength <= peer -> queueLengthLimit / 2) &&
+           (peer -> queueCommandLimit == 0 || peer -> queuedCommands <= peer -> queueCommandLimit / 2) &&
+           (host -> queueLengthLimit == 0 || host -> queuedLength <= host -> queueLengthLimit / 2) &&
+           (host -> queueCommandLimit == 0 || host -> queuedCommands <= host -> queueCommandLimit / 2);
+}
+
 static int
 enet_protocol_dispatch_incoming_commands (ENetHost * host, ENetEvent * event)
 {
@@ -89,6 +104,26 @@ enet_protocol_dispatch_incoming_commands (ENetHost * host, ENetEvent * event)
            return 1;
 
        case ENET_PEER_STATE_CONNECTED:
+           if (peer -> queueBlocked && enet_protocol_queue_drained (host, peer))
+           {
+              peer -> queueBlocked = 0;
+
+              event -> type = ENET_EVENT_TYPE_WRITABLE;
+              event -> peer = peer;
+              event -> channelID = 0;
+              event -> data = 0;
+              event -> packet = NULL;
+
+              if (! enet_list_empty (& peer -> dispatchedCommands))
+              {
+                 peer -> needsDispatch = 1;
+
+                 enet_list_insert (enet_list_end (& host -> dispatchQueue), & peer -> dispatchList);
+              }
+
+              return 1;
+           }
+
            if (enet_list_empty (& peer -> dispatchedCommands))
              continue;
 
@@ -169,6 +204,8 @@ enet_protocol_remove_sent_unreliable_commands (ENetPeer * peer)
         
         enet_list_remove (& outgoingCommand -> outgoingCommandList);
 
+        enet_peer_release_outgoing_command (peer, outgoingCommand);
+
         if (outgoingCommand -> packet != NULL)
         {
            -- outgoingCommand -> packet -> referenceCount;
@@ -181,8 +218,116 @@ enet_protocol_remove_sent_unreliable_commands (ENetPeer * peer)
            }
         }
 
-        enet_free (outgoingCommand);
+        enet_peer_free_outgoing_command (peer, outgoingCommand);
+    }
+}
+
+/* Returns 1 and the time at which a command sent and not acknowledged yet times out, or 0 if it is
+   a fragmented command none of whose fragments is in transit. */
+static int
+enet_protocol_outgoing_command_timeout (const ENetOutgoingCommand * outgoingCommand, enet_uint32 * timeout)
+{
+    const ENetOutgoingFragments * fragments = outgoingCommand -> fragments;
+    enet_uint32 fragmentNumber;
+    int found = 0;
+
+    if (fragments == NULL)
+    {
+       * timeout = outgoingCommand -> sentTime + outgoingCommand -> roundTripTimeout;
+
+       return 1;
+    }
+
+    for (fragmentNumber = fragments -> acknowledgedFragments; fragmentNumber < fragments -> sentFragments; ++ fragmentNumber)
+    {
+       const ENetOutgoingFragment * fragment = & fragments -> states [fragmentNumber];
+
+       if (fragment -> state != ENET_OUTGOING_FRAGMENT_STATE_IN_TRANSIT ||
+           (found && ! ENET_TIME_LESS (fragment -> sentTime + fragment -> roundTripTimeout, * timeout)))
+         continue;
+
+       * timeout = fragment -> sentTime + fragment -> roundTripTimeout;
+       found = 1;
+    }
+
+    return found;
+}
+
+/* Schedules the next check for timeouts when the first command sent and not acknowledged yet times out. */
+static void
+enet_protocol_reset_next_timeout (ENetPeer * peer)
+{
+    ENetListIterator currentCommand;
+
+    for (currentCommand = enet_list_begin (& peer -> sentReliableCommands);
+         currentCommand != enet_list_end (& peer -> sentReliableCommands);
+         currentCommand = enet_list_next (currentCommand))
+    {
+       if (enet_protocol_outgoing_command_timeout ((ENetOutgoingCommand *) currentCommand, & peer -> nextTimeout))
+         break;
+    }
+}
+
+/* Acknowledges a fragment of a fragmented reliable command, and removes the command once all of its
+   fragments are acknowledged. */
+static ENetProtocolCommand
+enet_protocol_remove_sent_reliable_fragment (ENetPeer * peer, ENetOutgoingCommand * outgoingCommand, enet_uint16 reliableSequenceNumber)
+{
+    ENetOutgoingFragments * fragments = outgoingCommand -> fragments;
+    enet_uint32 fragmentNumber = (enet_uint16) (reliableSequenceNumber - outgoingCommand -> reliableSequenceNumber);
+    ENetOutgoingFragment * fragment = & fragments -> states [fragmentNumber];
+    ENetChannel * channel = & peer -> channels [outgoingCommand -> command.header.channelID];
+    enet_uint16 reliableWindow = reliableSequenceNumber / ENET_PEER_RELIABLE_WINDOW_SIZE;
+
+    switch (fragment -> state)
+    {
+    case ENET_OUTGOING_FRAGMENT_STATE_IN_TRANSIT:
+       peer -> reliableDataInTransit -= ENET_NET_TO_HOST_16 (fragments -> table -> fragments [fragmentNumber].dataLength);
+       break;
+
+    case ENET_OUTGOING_FRAGMENT_STATE_QUEUED:
+       -- fragments -> lostFragments;
+       -- peer -> lostFragments;
+       break;
+
+    default:
+       return ENET_PROTOCOL_COMMAND_NONE;
+    }
+
+    if (channel -> reliableWindows [reliableWindow] > 0)
+    {
+       -- channel -> reliableWindows [reliableWindow];
+       if (! channel -> reliableWindows [reliableWindow])
+         channel -> usedReliableWindows &= ~ (1 << reliableWindow);
+    }
+
+    fragment -> state = ENET_OUTGOING_FRAGMENT_STATE_ACKNOWLEDGED;
+
+    while (fragments -> acknowledgedFragments < fragments -> sentFragments &&
+           fragments -> states [fragments -> acknowledgedFragments].state == ENET_OUTGOING_FRAGMENT_STATE_ACKNOWLEDGED)
+      ++ fragments -> acknowledgedFragments;
+
+    if (fragments -> acknowledgedFragments >= fragments -> fragmentCount)
+    {
+       enet_list_remove (& outgoingCommand -> outgoingCommandList);
+
+       enet_peer_release_outgoing_command (peer, outgoingCommand);
+
+       -- outgoingCommand -> packet -> referenceCount;
+
+       if (outgoingCommand -> packet -> referenceCount == 0)
+       {
+          outgoingCommand -> packet -> flags |= ENET_PACKET_FLAG_SENT;
+
+          enet_packet_destroy (outgoingCommand -> packet);
+       }
+
+       enet_peer_free_outgoing_command (peer, outgoingCommand);
     }
+
+    enet_protocol_reset_next_timeout (peer);
+
+    return ENET_PROTOCOL_COMMAND_SEND_FRAGMENT;
 }
 
 static ENetProtocolCommand
@@ -199,8 +344,16 @@ enet_protocol_remove_sent_reliable_command (ENetPeer * peer, enet_uint16 reliabl
     {
        outgoingCommand = (ENetOutgoingCommand *) currentCommand;
         
-       if (outgoingCommand -> reliableSequenceNumber == reliableSequenceNumber &&
-           outgoingCommand -> command.header.channelID == channelID)
+       if (outgoingCommand -> command.header.channelID != channelID)
+         continue;
+
+       if (outgoingCommand -> fragments != NULL)
+       {
+          if ((enet_uint16) (reliableSequenceNumber - outgoingCommand -> reliableSequenceNumber) < outgoingCommand -> fragments -> sentFragments)
+            return enet_protocol_remove_sent_reliable_fragment (peer, outgoingCommand, reliableSequenceNumber);
+       }
+       else
+       if (outgoingCommand -> reliableSequenceNumber == reliableSequenceNumber)
          break;
     }
 
@@ -244,6 +397,8 @@ enet_protocol_remove_sent_reliable_command (ENetPeer * peer, enet_uint16 reliabl
     
     enet_list_remove (& outgoingCommand -> outgoingCommandList);
 
+    enet_peer_release_outgoing_command (peer, outgoingCommand);
+
     if (outgoingCommand -> packet != NULL)
     {
        if (wasSent)
@@ -259,25 +414,271 @@ enet_protocol_remove_sent_reliable_command (ENetPeer * peer, enet_uint16 reliabl
        }
     }
 
-    enet_free (outgoingCommand);
+    enet_peer_free_outgoing_command (peer, outgoingCommand);
 
-    if (enet_list_empty (& peer -> sentReliableCommands))
-      return commandNumber;
-    
-    outgoingCommand = (ENetOutgoingCommand *) enet_list_front (& peer -> sentReliableCommands);
-    
-    peer -> nextTimeout = outgoingCommand -> sentTime + outgoingCommand -> roundTripTimeout;
+    enet_protocol_reset_next_timeout (peer);
 
     return commandNumber;
 } 
 
+#define ENET_HALFSIPHASH_ROTATE(x, b) (enet_uint32) (((x) << (b)) | ((x) >> (32 - (b))))
+
+#define ENET_HALFSIPHASH_ROUND(v0, v1, v2, v3) \
+    do { \
+       v0 += v1; v1 = ENET_HALFSIPHASH_ROTATE (v1, 5); v1 ^= v0; v0 = ENET_HALFSIPHASH_ROTATE (v0, 16); \
+       v2 += v3; v3 = ENET_HALFSIPHASH_ROTATE (v3, 8); v3 ^= v2; \
+       v0 += v3; v3 = ENET_HALFSIPHASH_ROTATE (v3, 7); v3 ^= v0; \
+       v2 += v1; v1 = ENET_HALFSIPHASH_ROTATE (v1, 13); v1 ^= v2; v2 = ENET_HALFSIPHASH_ROTATE (v2, 16); \
+    } while (0)
+
+/* Computes the connection cookie of a CONNECT command from the received address for the given
+   time interval, as a HalfSipHash-2-4 with 64-bit output of the address, port and connect ID keyed
+   by the secret of the host.  Only 32-bit arithmetic is needed, and the cookie is only ever checked
+   by the host that computed it, so the words are hashed in host byte order. */
+static void
+enet_protocol_connect_cookie (ENetHost * host, const ENetProtocol * command, enet_uint32 interval, enet_uint8 * cookie)
+{
+    enet_uint32 message [4], k0, k1, v0, v1, v2, v3, b;
+    size_t i;
+
+    message [0] = host -> receivedAddress.host;
+    message [1] = host -> receivedAddress.port;
+    message [2] = command -> connect.connectID;
+    message [3] = interval;
+
+    memcpy (& k0, & host -> connectCookieKey [0], sizeof (enet_uint32));
+    memcpy (& k1, & host -> connectCookieKey [4], sizeof (enet_uint32));
+
+    v0 = k0;
+    v1 = k1 ^ 0xEE;
+    v2 = k0 ^ 0x6C796765;
+    v3 = k1 ^ 0x74656462;
+
+    for (i = 0; i < sizeof (message) / sizeof (message [0]); ++ i)
+    {
+       v3 ^= message [i];
+       ENET_HALFSIPHASH_ROUND (v0, v1, v2, v3);
+       ENET_HALFSIPHASH_ROUND (v0, v1, v2, v3);
+       v0 ^= message [i];
+    }
+
+    b = (enet_uint32) sizeof (message) << 24;
+    v3 ^= b;
+    ENET_HALFSIPHASH_ROUND (v0, v1, v2, v3);
+    ENET_HALFSIPHASH_ROUND (v0, v1, v2, v3);
+    v0 ^= b;
+
+    v2 ^= 0xEE;
+    for (i = 0; i < 4; ++ i)
+      ENET_HALFSIPHASH_ROUND (v0, v1, v2, v3);
+    b = v1 ^ v3;
+    memcpy (& cookie [0], & b, sizeof (enet_uint32));
+
+    v1 ^= 0xDD;
+    for (i = 0; i < 4; ++ i)
+      ENET_HALFSIPHASH_ROUND (v0, v1, v2, v3);
+    b = v1 ^ v3;
+    memcpy (& cookie [4], & b, sizeof (enet_uint32));
+}
+
+/* Returns the connection extension following a CONNECT or VERIFY_CONNECT command in its datagram,
+   or NULL if the remote peer did not send any. */
+static const ENetProtocol *
+enet_protocol_connect_extension (ENetHost * host, const enet_uint8 * currentData)
+{
+    const ENetProtocol * extension = (const ENetProtocol *) currentData;
+
+    if (currentData + sizeof (ENetProtocolConnectExtension) > & host -> receivedData [host -> receivedDataLength] ||
+        (extension -> header.command & ENET_PROTOCOL_COMMAND_MASK) != ENET_PROTOCOL_COMMAND_CONNECT_EXTENSION)
+      return NULL;
+
+    return extension;
+}
+
+/* Returns 1 if the CONNECT command is followed in its datagram by a connection extension echoing
+   the cookie of the current or the previous interval.  Otherwise, if the client supports cookies,
+   replies with the cookie of the current interval without keeping any state, and returns 0. */
+static int
+enet_protocol_check_connect_cookie (ENetHost * host, const ENetProtocol * command, const ENetProtocol * extension)
+{
+    enet_uint32 interval = host -> serviceTime / ENET_HOST_CONNECT_COOKIE_INTERVAL;
+    enet_uint8 cookie [ENET_PROTOCOL_CONNECT_COOKIE_SIZE];
+    enet_uint16 header [2], peerID;
+    ENetProtocolConnectExtension reply;
+    enet_uint32 capabilities, checksum;
+    ENetBuffer buffers [3];
+    size_t bufferCount = 0;
+    int sentLength;
+
+    if (extension == NULL)
+      return 0;
+
+    capabilities = ENET_NET_TO_HOST_32 (extension -> connectExtension.capabilities);
+    if (! (capabilities & ENET_PROTOCOL_CAPABILITY_CONNECT_COOKIE))
+      return 0;
+
+    enet_protocol_connect_cookie (host, command, interval, cookie);
+    if (! memcmp (cookie, extension -> connectExtension.cookie, sizeof (cookie)))
+      return 1;
+
+    enet_protocol_connect_cookie (host, command, interval - 1, reply.cookie);
+    if (! memcmp (reply.cookie, extension -> connectExtension.cookie, sizeof (reply.cookie)))
+      return 1;
+
+    peerID = ENET_NET_TO_HOST_16 (command -> connect.outgoingPeerID);
+
+    buffers [bufferCount].data = header;
+    if (peerID >= ENET_PROTOCOL_EXTENDED_PEER_ID && (capabilities & ENET_PROTOCOL_CAPABILITY_EXTENDED_PEER_ID))
+    {
+       header [0] = ENET_HOST_TO_NET_16 (ENET_PROTOCOL_EXTENDED_PEER_ID);
+       header [1] = ENET_HOST_TO_NET_16 (peerID);
+       buffers [bufferCount].dataLength = sizeof (header);
+    }
+    else
+    {
+       header [0] = ENET_HOST_TO_NET_16 (peerID & ENET_PROTOCOL_MAXIMUM_PEER_ID);
+       buffers [bufferCount].dataLength = sizeof (enet_uint16);
+    }
+    ++ bufferCount;
+
+    if (host -> checksum != NULL)
+    {
+       checksum = command -> connect.connectID;
+
+       buffers [bufferCount].data = & checksum;
+       buffers [bufferCount].dataLength = sizeof (enet_uint32);
+       ++ bufferCount;
+    }
+
+    reply.header.command = ENET_PROTOCOL_COMMAND_CONNECT_EXTENSION;
+    reply.header.channelID = 0xFF;
+    reply.header.reliableSequenceNumber = 0;
+    reply.capabilities = ENET_HOST_TO_NET_32 (ENET_PROTOCOL_CAPABILITY_MASK);
+    memcpy (reply.cookie, cookie, sizeof (cookie));
+
+    buffers [bufferCount].data = & reply;
+    buffers [bufferCount].dataLength = sizeof (reply);
+    ++ bufferCount;
+
+    if (host -> checksum != NULL)
+      checksum = host -> checksum (buffers, bufferCount);
+
+    sentLength = enet_socket_send (host -> socket, & host -> receivedAddress, buffers, bufferCount);
+    if (sentLength > 0)
+    {
+       host -> totalSentData += sentLength;
+       ++ host -> totalSentPackets;
+    }
+
+    return 0;
+}
+
+/* Appends a connection extension to the CONNECT or VERIFY_CONNECT command just added to the datagram. */
+static void
+enet_protocol_send_connect_extension (ENetHost * host, ENetPeer * peer)
+{
+    ENetProtocol * command = & host -> commands [host -> commandCount];
+    ENetBuffer * buffer = & host -> buffers [host -> bufferCount];
+
+    command -> header.command = ENET_PROTOCOL_COMMAND_CONNECT_EXTENSION;
+    command -> header.channelID = 0xFF;
+    command -> header.reliableSequenceNumber = 0;
+    command -> connectExtension.capabilities = ENET_HOST_TO_NET_32 (ENET_PROTOCOL_CAPABILITY_MASK);
+    memcpy (command -> connectExtension.cookie, peer -> connectCookie, sizeof (peer -> connectCookie));
+
+    buffer -> data = command;
+    buffer -> dataLength = sizeof (ENetProtocolConnectExtension);
+
+    host -> packetSize += buffer -> dataLength;
+
+    ++ host -> commandCount;
+    ++ host -> bufferCount;
+}
+
+/* Stores a new cookie sent by the host a peer is connecting to, and resends the CONNECT with it
+   right away.  Connection extensions received in any other state are ignored. */
+static int
+enet_protocol_handle_connect_extension (ENetHost * host, ENetPeer * peer, const ENetProtocol * command)
+{
+    ENetListIterator currentCommand;
+
+    if (peer -> state != ENET_PEER_STATE_CONNECTING ||
+        ! (ENET_NET_TO_HOST_32 (command -> connectExtension.capabilities) & ENET_PROTOCOL_CAPABILITY_CONNECT_COOKIE) ||
+        ! memcmp (peer -> connectCookie, command -> connectExtension.cookie, sizeof (peer -> connectCookie)))
+      return 0;
+
+    memcpy (peer -> connectCookie, command -> connectExtension.cookie, sizeof (peer -> connectCookie));
+
+    for (currentCommand = enet_list_begin (& peer -> sentReliableCommands);
+         currentCommand != enet_list_end (& peer -> sentReliableCommands);
+         currentCommand = enet_list_next (currentCommand))
+    {
+       ENetOutgoingCommand * outgoingCommand = (ENetOutgoingCommand *) currentCommand;
+
+       if ((outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK) == ENET_PROTOCOL_COMMAND_CONNECT)
+       {
+          enet_list_insert (enet_list_begin (& peer -> outgoingReliableCommands),
+                            enet_list_remove (& outgoingCommand -> outgoingCommandList));
+          break;
+       }
+    }
+
+    return 0;
+}
+
+/* Lowers the MTU of a new connection to ENET_HOST_DEFAULT_MTU, to probe the path for the largest
+   datagram that gets through up to the MTU negotiated, if the host and the peer both probe. */
+static void
+enet_protocol_start_mtu_probe (ENetHost * host, ENetPeer * peer)
+{
+    if (! host -> mtuProbe ||
+        ! (peer -> capabilities & ENET_PROTOCOL_CAPABILITY_MTU_PROBE) ||
+        peer -> mtu <= ENET_HOST_DEFAULT_MTU)
+      return;
+
+    peer -> mtuProbeLimit = peer -> mtu + 1;
+    peer -> mtuProbeSize = 0;
+    peer -> mtuProbeTime = host -> serviceTime;
+    peer -> mtuProbeAttempts = 0;
+    peer -> mtu = ENET_HOST_DEFAULT_MTU;
+}
+
+static int
+enet_protocol_handle_mtu_probe (ENetHost * host, ENetPeer * peer, const ENetProtocol * command, enet_uint8 ** currentData)
+{
+    enet_uint16 mtu = ENET_NET_TO_HOST_16 (command -> mtuProbe.mtu),
+                paddingLength = ENET_NET_TO_HOST_16 (command -> mtuProbe.paddingLength);
+
+    if (* currentData + paddingLength > & host -> receivedData [host -> receivedDataLength])
+      return -1;
+
+    * currentData += paddingLength;
+
+    if (paddingLength > 0)
+    {
+       peer -> mtuProbeAnswer = mtu;
+
+       return 0;
+    }
+
+    if (peer -> mtuProbeSize != 0 && mtu == peer -> mtuProbeSize)
+    {
+       peer -> mtu = mtu;
+       peer -> mtuProbeSize = 0;
+       peer -> mtuProbeTime = host -> serviceTime;
+       peer -> mtuProbeAttempts = 0;
+    }
+
+    return 0;
+}
+
 static ENetPeer *
-enet_protocol_handle_connect (ENetHost * host, ENetProtocolHeader * header, ENetProtocol * command)
+enet_protocol_handle_connect (ENetHost * host, ENetProtocolHeader * header, ENetProtocol * command, enet_uint32 capabilities)
 {
     enet_uint8 incomingSessionID, outgoingSessionID;
     enet_uint32 mtu, windowSize;
     ENetChannel * channel;
-    size_t channelCount;
+    size_t channelCount, peerLimit;
     ENetPeer * currentPeer;
     ENetProtocol verifyCommand;
 
@@ -291,34 +692,48 @@ enet_protocol_handle_connect (ENetHost * host, ENetProtocolHeader * header, ENet
          currentPeer < & host -> peers [host -> peerCount];
          ++ currentPeer)
     {
-        if (currentPeer -> state != ENET_PEER_STATE_DISCONNECTED &&
+        if (ENET_PEER_STATE (host, currentPeer) != ENET_PEER_STATE_DISCONNECTED &&
             currentPeer -> address.host == host -> receivedAddress.host &&
             currentPeer -> address.port == host -> receivedAddress.port &&
             currentPeer -> connectID == command -> connect.connectID)
           return NULL;
     }
 
+    /* Peers that do not understand extended peer IDs can only be given the lower peers. */
+    peerLimit = host -> maximumPeerCount;
+    if (! (capabilities & ENET_PROTOCOL_CAPABILITY_EXTENDED_PEER_ID) &&
+        peerLimit > ENET_PROTOCOL_EXTENDED_PEER_ID)
+      peerLimit = ENET_PROTOCOL_EXTENDED_PEER_ID;
+
     for (currentPeer = host -> peers;
-         currentPeer < & host -> peers [host -> peerCount];
+         currentPeer < & host -> peers [ENET_MIN (host -> peerCount, peerLimit)];
          ++ currentPeer)
     {
-        if (currentPeer -> state == ENET_PEER_STATE_DISCONNECTED)
+        if (ENET_PEER_STATE (host, currentPeer) == ENET_PEER_STATE_DISCONNECTED)
           break;
     }
 
-    if (currentPeer >= & host -> peers [host -> peerCount])
-      return NULL;
+    if (currentPeer >= & host -> peers [ENET_MIN (host -> peerCount, peerLimit)])
+    {
+       if (host -> peerCount >= peerLimit)
+         return NULL;
+
+       currentPeer = enet_host_commit_peers (host);
+       if (currentPeer == NULL)
+         return NULL;
+    }
 
     if (channelCount > host -> channelLimit)
       channelCount = host -> channelLimit;
-    currentPeer -> channels = (ENetChannel *) enet_malloc (channelCount * sizeof (ENetChannel));
+    currentPeer -> channels = (ENetChannel *) enet_host_malloc (host, currentPeer, channelCount * sizeof (ENetChannel));
     if (currentPeer -> channels == NULL)
       return NULL;
     currentPeer -> channelCount = channelCount;
-    currentPeer -> state = ENET_PEER_STATE_ACKNOWLEDGING_CONNECT;
+    enet_peer_set_state (currentPeer, ENET_PEER_STATE_ACKNOWLEDGING_CONNECT);
     currentPeer -> connectID = command -> connect.connectID;
     currentPeer -> address = host -> receivedAddress;
     currentPeer -> outgoingPeerID = ENET_NET_TO_HOST_16 (command -> connect.outgoingPeerID);
+    currentPeer -> capabilities = capabilities & ENET_PROTOCOL_CAPABILITY_MASK;
     currentPeer -> incomingBandwidth = ENET_NET_TO_HOST_32 (command -> connect.incomingBandwidth);
     currentPeer -> outgoingBandwidth = ENET_NET_TO_HOST_32 (command -> connect.outgoingBandwidth);
     currentPeer -> packetThrottleInterval = ENET_NET_TO_HOST_32 (command -> connect.packetThrottleInterval);
@@ -349,7 +764,16 @@ enet_protocol_handle_connect (ENetHost * host, ENetProtocolHeader * header, ENet
 
         enet_list_clear (& channel -> incomingReliableCommands);
         enet_list_clear (& channel -> incomingUnreliableCommands);
-
+        enet_list_clear (& channel -> outgoingReliableCommands);
+        enet_list_clear (& channel -> outgoingUnreliableCommands);
+
+        channel -> outgoingFragmentedCommand = NULL;
+        channel -> fec = NULL;
+        channel -> outgoingPriority = 0;
+        channel -> outgoingWeight = 1;
+        channel -> outgoingReliableDeficit = 0;
+        channel -> outgoingUnreliableDeficit = 0;
+        channel -> outgoingLifetime = 0;
         channel -> usedReliableWindows = 0;
         memset (channel -> reliableWindows, 0, sizeof (channel -> reliableWindows));
     }
@@ -362,6 +786,9 @@ enet_protocol_handle_connect (ENetHost * host, ENetProtocolHeader * header, ENet
     if (mtu > ENET_PROTOCOL_MAXIMUM_MTU)
       mtu = ENET_PROTOCOL_MAXIMUM_MTU;
 
+    if (mtu > host -> mtu)
+      mtu = host -> mtu;
+
     currentPeer -> mtu = mtu;
 
     if (host -> outgoingBandwidth == 0 &&
@@ -416,6 +843,8 @@ enet_protocol_handle_connect (ENetHost * host, ENetProtocolHeader * header, ENet
 
     enet_peer_queue_outgoing_command (currentPeer, & verifyCommand, NULL, 0, 0);
 
+    enet_protocol_start_mtu_probe (host, currentPeer);
+
     return currentPeer;
 }
 
@@ -436,9 +865,10 @@ enet_protocol_handle_send_reliable (ENetHost * host, ENetPeer * peer, const ENet
         * currentData > & host -> receivedData [host -> receivedDataLength])
       return -1;
 
-    packet = enet_packet_create ((const enet_uint8 *) command + sizeof (ENetProtocolSendReliable),
+    packet = enet_packet_create_with_allocator (host -> allocator, (const enet_uint8 *) command + sizeof (ENetProtocolSendReliable),
                                  dataLength,
-                                 ENET_PACKET_FLAG_RELIABLE);
+                                 ENET_PACKET_FLAG_RELIABLE |
+                                   (command -> header.command & ENET_PROTOCOL_COMMAND_FLAG_STREAM ? ENET_PACKET_FLAG_STREAM : 0));
     if (packet == NULL ||
         enet_peer_queue_incoming_command (peer, command, packet, 0) == NULL)
       return -1;
@@ -446,6 +876,32 @@ enet_protocol_handle_send_reliable (ENetHost * host, ENetPeer * peer, const ENet
     return 0;
 }
 
+static int
+enet_protocol_admit_unsequenced_group (ENetPeer * peer, enet_uint32 unsequencedGroup)
+{
+    enet_uint32 index = unsequencedGroup % ENET_PEER_UNSEQUENCED_WINDOW_SIZE;
+
+    if (unsequencedGroup < peer -> incomingUnsequencedGroup)
+      unsequencedGroup += 0x10000;
+
+    if (unsequencedGroup >= (enet_uint32) peer -> incomingUnsequencedGroup + ENET_PEER_FREE_UNSEQUENCED_WINDOWS * ENET_PEER_UNSEQUENCED_WINDOW_SIZE)
+      return 0;
+
+    unsequencedGroup &= 0xFFFF;
+
+    if (unsequencedGroup - index != peer -> incomingUnsequencedGroup)
+    {
+        peer -> incomingUnsequencedGroup = unsequencedGroup - index;
+
+        memset (peer -> unsequencedWindow, 0, sizeof (peer -> unsequencedWindow));
+    }
+    else
+    if (peer -> unsequencedWindow [index / 32] & (1 << (index % 32)))
+      return 0;
+
+    return 1;
+}
+
 static int
 enet_protocol_handle_send_unsequenced (ENetHost * host, ENetPeer * peer, const ENetProtocol * command, enet_uint8 ** currentData)
 {
@@ -464,28 +920,25 @@ enet_protocol_handle_send_unsequenced (ENetHost * host, ENetPeer * peer, const E
         * currentData > & host -> receivedData [host -> receivedDataLength])
       return -1; 
 
+    if (peer -> channels [command -> header.channelID].fec != NULL)
+      enet_peer_fec_store (& peer -> channels [command -> header.channelID], command, (const enet_uint8 *) command + sizeof (ENetProtocolSendUnsequenced), dataLength);
+
     unsequencedGroup = ENET_NET_TO_HOST_16 (command -> sendUnsequenced.unsequencedGroup);
     index = unsequencedGroup % ENET_PEER_UNSEQUENCED_WINDOW_SIZE;
-   
-    if (unsequencedGroup < peer -> incomingUnsequencedGroup)
-      unsequencedGroup += 0x10000;
 
-    if (unsequencedGroup >= (enet_uint32) peer -> incomingUnsequencedGroup + ENET_PEER_FREE_UNSEQUENCED_WINDOWS * ENET_PEER_UNSEQUENCED_WINDOW_SIZE)
+    if (! enet_protocol_admit_unsequenced_group (peer, unsequencedGroup))
       return 0;
 
-    unsequencedGroup &= 0xFFFF;
-
-    if (unsequencedGroup - index != peer -> incomingUnsequencedGroup)
+    if (host -> receive != NULL &&
+        peer -> state == ENET_PEER_STATE_CONNECTED &&
+        host -> receive (host, peer, command -> header.channelID, (const enet_uint8 *) command + sizeof (ENetProtocolSendUnsequenced), dataLength))
     {
-        peer -> incomingUnsequencedGroup = unsequencedGroup - index;
+       peer -> unsequencedWindow [index / 32] |= 1 << (index % 32);
 
-        memset (peer -> unsequencedWindow, 0, sizeof (peer -> unsequencedWindow));
+       return 0;
     }
-    else
-    if (peer -> unsequencedWindow [index / 32] & (1 << (index % 32)))
-      return 0;
       
-    packet = enet_packet_create ((const enet_uint8 *) command + sizeof (ENetProtocolSendUnsequenced),
+    packet = enet_packet_create_with_allocator (host -> allocator, (const enet_uint8 *) command + sizeof (ENetProtocolSendUnsequenced),
                                  dataLength,
                                  ENET_PACKET_FLAG_UNSEQUENCED);
     if (packet == NULL ||
@@ -497,6 +950,36 @@ enet_protocol_handle_send_unsequenced (ENetHost * host, ENetPeer * peer, const E
     return 0;
 }
 
+/* Hands a sequenced unreliable packet to the receive callback of the host when it is next in order
+   on its channel and nothing received earlier on the channel is still waiting to be dispatched. */
+static int
+enet_protocol_receive_unreliable (ENetHost * host, ENetPeer * peer, const ENetProtocol * command, size_t dataLength)
+{
+    ENetChannel * channel = & peer -> channels [command -> header.channelID];
+    enet_uint16 unreliableSequenceNumber = ENET_NET_TO_HOST_16 (command -> sendUnreliable.unreliableSequenceNumber);
+    ENetListIterator currentCommand;
+
+    if (command -> header.reliableSequenceNumber != channel -> incomingReliableSequenceNumber ||
+        unreliableSequenceNumber <= channel -> incomingUnreliableSequenceNumber ||
+        ! enet_list_empty (& channel -> incomingUnreliableCommands))
+      return 0;
+
+    for (currentCommand = enet_list_begin (& peer -> dispatchedCommands);
+         currentCommand != enet_list_end (& peer -> dispatchedCommands);
+         currentCommand = enet_list_next (currentCommand))
+    {
+       if (((ENetIncomingCommand *) currentCommand) -> command.header.channelID == command -> header.channelID)
+         return 0;
+    }
+
+    if (! host -> receive (host, peer, command -> header.channelID, (const enet_uint8 *) command + sizeof (ENetProtocolSendUnreliable), dataLength))
+      return 0;
+
+    channel -> incomingUnreliableSequenceNumber = unreliableSequenceNumber;
+
+    return 1;
+}
+
 static int
 enet_protocol_handle_send_unreliable (ENetHost * host, ENetPeer * peer, const ENetProtocol * command, enet_uint8 ** currentData)
 {
@@ -514,7 +997,15 @@ enet_protocol_handle_send_unreliable (ENetHost * host, ENetPeer * peer, const EN
         * currentData > & host -> receivedData [host -> receivedDataLength])
       return -1;
 
-    packet = enet_packet_create ((const enet_uint8 *) command + sizeof (ENetProtocolSendUnreliable),
+    if (peer -> channels [command -> header.channelID].fec != NULL)
+      enet_peer_fec_store (& peer -> channels [command -> header.channelID], command, (const enet_uint8 *) command + sizeof (ENetProtocolSendUnreliable), dataLength);
+
+    if (host -> receive != NULL &&
+        peer -> state == ENET_PEER_STATE_CONNECTED &&
+        enet_protocol_receive_unreliable (host, peer, command, dataLength))
+      return 0;
+
+    packet = enet_packet_create_with_allocator (host -> allocator, (const enet_uint8 *) command + sizeof (ENetProtocolSendUnreliable),
                                  dataLength,
                                  0);
     if (packet == NULL ||
@@ -605,7 +1096,7 @@ enet_protocol_handle_send_fragment (ENetHost * host, ENetPeer * peer, const ENet
     if (startCommand == NULL)
     {
        ENetProtocol hostCommand = * command;
-       ENetPacket * packet = enet_packet_create (NULL, totalLength, ENET_PACKET_FLAG_RELIABLE);
+       ENetPacket * packet = enet_packet_create_with_allocator (host -> allocator, NULL, totalLength, ENET_PACKET_FLAG_RELIABLE);
        if (packet == NULL)
          return -1;
 
@@ -729,7 +1220,7 @@ enet_protocol_handle_send_unreliable_fragment (ENetHost * host, ENetPeer * peer,
 
     if (startCommand == NULL)
     {
-       ENetPacket * packet = enet_packet_create (NULL, totalLength, ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT);
+       ENetPacket * packet = enet_packet_create_with_allocator (host -> allocator, NULL, totalLength, ENET_PACKET_FLAG_UNRELIABLE_FRAGMENT);
        if (packet == NULL)
          return -1;
 
@@ -759,10 +1250,60 @@ enet_protocol_handle_send_unreliable_fragment (ENetHost * host, ENetPeer * peer,
 }
 
 static int
-enet_protocol_handle_ping (ENetHost * host, ENetPeer * peer, const ENetProtocol * command)
+enet_protocol_handle_send_parity (ENetHost * host, ENetPeer * peer, const ENetProtocol * command, enet_uint8 ** currentData)
 {
-    if (peer -> state != ENET_PEER_STATE_CONNECTED && peer -> state != ENET_PEER_STATE_DISCONNECT_LATER)
-      return -1;
+    ENetProtocol recoveredCommand;
+    ENetPacket * packet;
+    size_t dataLength;
+
+    if (command -> header.channelID >= peer -> channelCount ||
+        (peer -> state != ENET_PEER_STATE_CONNECTED && peer -> state != ENET_PEER_STATE_DISCONNECT_LATER))
+      return -1;
+
+    dataLength = ENET_NET_TO_HOST_16 (command -> sendParity.dataLength);
+    * currentData += dataLength;
+    if (dataLength > ENET_PROTOCOL_MAXIMUM_PACKET_SIZE ||
+        * currentData < host -> receivedData ||
+        * currentData > & host -> receivedData [host -> receivedDataLength])
+      return -1;
+
+    packet = enet_peer_fec_recover (peer, & peer -> channels [command -> header.channelID], command,
+                                    (const enet_uint8 *) command + sizeof (ENetProtocolSendParity),
+                                    & recoveredCommand);
+    if (packet == NULL)
+      return 0;
+
+    if ((recoveredCommand.header.command & ENET_PROTOCOL_COMMAND_MASK) == ENET_PROTOCOL_COMMAND_SEND_UNSEQUENCED)
+    {
+        enet_uint32 unsequencedGroup = ENET_NET_TO_HOST_16 (recoveredCommand.sendUnsequenced.unsequencedGroup),
+                    index = unsequencedGroup % ENET_PEER_UNSEQUENCED_WINDOW_SIZE;
+
+        if (! enet_protocol_admit_unsequenced_group (peer, unsequencedGroup))
+        {
+            enet_packet_destroy (packet);
+
+            return 0;
+        }
+
+        if (enet_peer_queue_incoming_command (peer, & recoveredCommand, packet, 0) == NULL)
+          return -1;
+
+        peer -> unsequencedWindow [index / 32] |= 1 << (index % 32);
+
+        return 0;
+    }
+
+    if (enet_peer_queue_incoming_command (peer, & recoveredCommand, packet, 0) == NULL)
+      return -1;
+
+    return 0;
+}
+
+static int
+enet_protocol_handle_ping (ENetHost * host, ENetPeer * peer, const ENetProtocol * command)
+{
+    if (peer -> state != ENET_PEER_STATE_CONNECTED && peer -> state != ENET_PEER_STATE_DISCONNECT_LATER)
+      return -1;
 
     return 0;
 }
@@ -915,8 +1456,7 @@ enet_protocol_handle_acknowledge (ENetHost * host, ENetEvent * event, ENetPeer *
        break;
 
     case ENET_PEER_STATE_DISCONNECT_LATER:
-       if (enet_list_empty (& peer -> outgoingReliableCommands) &&
-           enet_list_empty (& peer -> outgoingUnreliableCommands) &&   
+       if (! enet_peer_has_outgoing_commands (peer) &&
            enet_list_empty (& peer -> sentReliableCommands))
          enet_peer_disconnect (peer, peer -> eventData);
        break;
@@ -986,23 +1526,60 @@ enet_protocol_handle_verify_connect (ENetHost * host, ENetEvent * event, ENetPee
     peer -> incomingBandwidth = ENET_NET_TO_HOST_32 (command -> verifyConnect.incomingBandwidth);
     peer -> outgoingBandwidth = ENET_NET_TO_HOST_32 (command -> verifyConnect.outgoingBandwidth);
 
+    enet_protocol_start_mtu_probe (host, peer);
+
     enet_protocol_notify_connect (host, peer, event);
     return 0;
 }
 
+/* Takes a token from the bucket of the source of the received datagram.  Returns 1 if one was
+   available, or 0 if the source exceeded its rate and the datagram should be dropped. */
+static int
+enet_protocol_charge_source (ENetHost * host)
+{
+    enet_uint32 hash = (host -> receivedAddress.host ^ host -> sourceLimitSeed) * 2654435761U,
+                capacity = host -> sourceLimitBurst * ENET_HOST_SOURCE_LIMIT_SCALE,
+                elapsed;
+    ENetSourceLimit * limit = & host -> sourceLimits [(hash >> 16) % ENET_HOST_SOURCE_LIMIT_SIZE];
+
+    elapsed = ENET_TIME_DIFFERENCE (host -> serviceTime, limit -> time);
+    limit -> time = host -> serviceTime;
+
+    /* rounded up, so a rate above the capacity does not refill the bucket on every datagram */
+    if (elapsed >= (capacity + host -> sourceLimitRate - 1) / host -> sourceLimitRate)
+      limit -> tokens = capacity;
+    else
+    {
+       limit -> tokens += elapsed * host -> sourceLimitRate;
+       if (limit -> tokens > capacity)
+         limit -> tokens = capacity;
+    }
+
+    if (limit -> tokens < ENET_HOST_SOURCE_LIMIT_SCALE)
+      return 0;
+
+    limit -> tokens -= ENET_HOST_SOURCE_LIMIT_SCALE;
+
+    return 1;
+}
+
 static int
 enet_protocol_handle_incoming_commands (ENetHost * host, ENetEvent * event)
 {
     ENetProtocolHeader * header;
     ENetProtocol * command;
+    const ENetProtocol * extension;
     ENetPeer * peer;
     enet_uint8 * currentData;
     size_t headerSize;
-    enet_uint16 peerID, flags;
+    enet_uint16 peerID, flags, sentTime = 0;
     enet_uint8 sessionID;
 
     if (host -> receivedDataLength < (size_t) & ((ENetProtocolHeader *) 0) -> sentTime)
-      return 0;
+    {
+       ++ host -> droppedDatagrams [ENET_DROP_REASON_MALFORMED];
+       return 0;
+    }
 
     header = (ENetProtocolHeader *) host -> receivedData;
 
@@ -1011,15 +1588,55 @@ enet_protocol_handle_incoming_commands (ENetHost * host, ENetEvent * event)
     flags = peerID & ENET_PROTOCOL_HEADER_FLAG_MASK;
     peerID &= ~ (ENET_PROTOCOL_HEADER_FLAG_MASK | ENET_PROTOCOL_HEADER_SESSION_MASK);
 
-    headerSize = (flags & ENET_PROTOCOL_HEADER_FLAG_SENT_TIME ? sizeof (ENetProtocolHeader) : (size_t) & ((ENetProtocolHeader *) 0) -> sentTime);
+    headerSize = (size_t) & ((ENetProtocolHeader *) 0) -> sentTime;
+    if (peerID == ENET_PROTOCOL_EXTENDED_PEER_ID)
+    {
+       if (host -> receivedDataLength < headerSize + sizeof (enet_uint16))
+       {
+          ++ host -> droppedDatagrams [ENET_DROP_REASON_MALFORMED];
+          return 0;
+       }
+
+       memcpy (& peerID, & host -> receivedData [headerSize], sizeof (enet_uint16));
+       peerID = ENET_NET_TO_HOST_16 (peerID);
+       headerSize += sizeof (enet_uint16);
+    }
+    else
+    if (peerID == ENET_PROTOCOL_MAXIMUM_PEER_ID)
+      peerID = ENET_PROTOCOL_MAXIMUM_EXTENDED_PEER_ID;
+
+    if (flags & ENET_PROTOCOL_HEADER_FLAG_SENT_TIME)
+    {
+       if (host -> receivedDataLength < headerSize + sizeof (enet_uint16))
+       {
+          ++ host -> droppedDatagrams [ENET_DROP_REASON_MALFORMED];
+          return 0;
+       }
+
+       memcpy (& sentTime, & host -> receivedData [headerSize], sizeof (enet_uint16));
+       sentTime = ENET_NET_TO_HOST_16 (sentTime);
+       headerSize += sizeof (enet_uint16);
+    }
+
     if (host -> checksum != NULL)
       headerSize += sizeof (enet_uint32);
 
-    if (peerID == ENET_PROTOCOL_MAXIMUM_PEER_ID)
-      peer = NULL;
+    if (peerID == ENET_PROTOCOL_MAXIMUM_EXTENDED_PEER_ID)
+    {
+       if (host -> sourceLimits != NULL && ! enet_protocol_charge_source (host))
+       {
+          ++ host -> droppedDatagrams [ENET_DROP_REASON_SOURCE_LIMIT];
+          return 0;
+       }
+
+       peer = NULL;
+    }
     else
     if (peerID >= host -> peerCount)
-      return 0;
+    {
+       ++ host -> droppedDatagrams [ENET_DROP_REASON_UNKNOWN_PEER];
+       return 0;
+    }
     else
     {
        peer = & host -> peers [peerID];
@@ -1029,16 +1646,22 @@ enet_protocol_handle_incoming_commands (ENetHost * host, ENetEvent * event)
            ((host -> receivedAddress.host != peer -> address.host ||
              host -> receivedAddress.port != peer -> address.port) &&
              peer -> address.host != ENET_HOST_BROADCAST) ||
-           (peer -> outgoingPeerID < ENET_PROTOCOL_MAXIMUM_PEER_ID &&
+           (peer -> outgoingPeerID < ENET_PROTOCOL_MAXIMUM_EXTENDED_PEER_ID &&
             sessionID != peer -> incomingSessionID))
-         return 0;
+       {
+          ++ host -> droppedDatagrams [ENET_DROP_REASON_UNKNOWN_PEER];
+          return 0;
+       }
     }
  
     if (flags & ENET_PROTOCOL_HEADER_FLAG_COMPRESSED)
     {
         size_t originalSize;
         if (host -> compressor.context == NULL || host -> compressor.decompress == NULL)
+        {
+          ++ host -> droppedDatagrams [ENET_DROP_REASON_DECOMPRESS];
           return 0;
+        }
 
         originalSize = host -> compressor.decompress (host -> compressor.context,
                                     host -> receivedData + headerSize, 
@@ -1046,7 +1669,10 @@ enet_protocol_handle_incoming_commands (ENetHost * host, ENetEvent * event)
                                     host -> packetData [1] + headerSize, 
                                     sizeof (host -> packetData [1]) - headerSize);
         if (originalSize <= 0 || originalSize > sizeof (host -> packetData [1]) - headerSize)
+        {
+          ++ host -> droppedDatagrams [ENET_DROP_REASON_DECOMPRESS];
           return 0;
+        }
 
         memcpy (host -> packetData [1], header, headerSize);
         host -> receivedData = host -> packetData [1];
@@ -1065,7 +1691,10 @@ enet_protocol_handle_incoming_commands (ENetHost * host, ENetEvent * event)
         buffer.dataLength = host -> receivedDataLength;
 
         if (host -> checksum (& buffer, 1) != desiredChecksum)
+        {
+          ++ host -> droppedDatagrams [ENET_DROP_REASON_CHECKSUM];
           return 0;
+        }
     }
        
     if (peer != NULL)
@@ -1112,12 +1741,22 @@ enet_protocol_handle_incoming_commands (ENetHost * host, ENetEvent * event)
        case ENET_PROTOCOL_COMMAND_CONNECT:
           if (peer != NULL)
             goto commandError;
-          peer = enet_protocol_handle_connect (host, header, command);
+          extension = enet_protocol_connect_extension (host, currentData);
+          if (host -> connectCookies &&
+              ! enet_protocol_check_connect_cookie (host, command, extension))
+            goto commandError;
+          peer = enet_protocol_handle_connect (host, header, command,
+                   extension != NULL ? ENET_NET_TO_HOST_32 (extension -> connectExtension.capabilities) : 0);
           if (peer == NULL)
             goto commandError;
           break;
 
        case ENET_PROTOCOL_COMMAND_VERIFY_CONNECT:
+          if (peer -> state == ENET_PEER_STATE_CONNECTING)
+          {
+             extension = enet_protocol_connect_extension (host, currentData);
+             peer -> capabilities = extension != NULL ? ENET_NET_TO_HOST_32 (extension -> connectExtension.capabilities) & ENET_PROTOCOL_CAPABILITY_MASK : 0;
+          }
           if (enet_protocol_handle_verify_connect (host, event, peer, command))
             goto commandError;
           break;
@@ -1167,6 +1806,21 @@ enet_protocol_handle_incoming_commands (ENetHost * host, ENetEvent * event)
             goto commandError;
           break;
 
+       case ENET_PROTOCOL_COMMAND_SEND_PARITY:
+          if (enet_protocol_handle_send_parity (host, peer, command, & currentData))
+            goto commandError;
+          break;
+
+       case ENET_PROTOCOL_COMMAND_CONNECT_EXTENSION:
+          if (enet_protocol_handle_connect_extension (host, peer, command))
+            goto commandError;
+          break;
+
+       case ENET_PROTOCOL_COMMAND_MTU_PROBE:
+          if (enet_protocol_handle_mtu_probe (host, peer, command, & currentData))
+            goto commandError;
+          break;
+
        default:
           goto commandError;
        }
@@ -1174,13 +1828,9 @@ enet_protocol_handle_incoming_commands (ENetHost * host, ENetEvent * event)
        if (peer != NULL &&
            (command -> header.command & ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE) != 0)
        {
-           enet_uint16 sentTime;
-
            if (! (flags & ENET_PROTOCOL_HEADER_FLAG_SENT_TIME))
              break;
 
-           sentTime = ENET_NET_TO_HOST_16 (header -> sentTime);
-
            switch (peer -> state)
            {
            case ENET_PEER_STATE_DISCONNECTING:
@@ -1270,6 +1920,30 @@ enet_protocol_receive_incoming_commands (ENetHost * host, ENetEvent * event)
     return -1;
 }
 
+static int
+enet_protocol_acknowledgements_due (ENetHost * host, ENetPeer * peer)
+{
+    ENetAcknowledgement * acknowledgement;
+    enet_uint32 deadline;
+
+    if (host -> acknowledgementDelay == 0 ||
+        peer -> state != ENET_PEER_STATE_CONNECTED ||
+        enet_peer_has_outgoing_commands (peer))
+      return 1;
+
+    acknowledgement = (ENetAcknowledgement *) enet_list_front (& peer -> acknowledgements);
+    deadline = acknowledgement -> queueTime + host -> acknowledgementDelay;
+
+    if (ENET_TIME_GREATER_EQUAL (host -> serviceTime, deadline))
+      return 1;
+
+    if (host -> nextAcknowledgementTime == 0 ||
+        ENET_TIME_LESS (deadline, host -> nextAcknowledgementTime))
+      host -> nextAcknowledgementTime = deadline;
+
+    return 0;
+}
+
 static void
 enet_protocol_send_acknowledgements (ENetHost * host, ENetPeer * peer)
 {
@@ -1278,6 +1952,7 @@ enet_protocol_send_acknowledgements (ENetHost * host, ENetPeer * peer)
     ENetAcknowledgement * acknowledgement;
     ENetListIterator currentAcknowledgement;
     enet_uint16 reliableSequenceNumber;
+    enet_uint32 heldTime;
  
     currentAcknowledgement = enet_list_begin (& peer -> acknowledgements);
          
@@ -1307,13 +1982,17 @@ enet_protocol_send_acknowledgements (ENetHost * host, ENetPeer * peer)
        command -> header.channelID = acknowledgement -> command.header.channelID;
        command -> header.reliableSequenceNumber = reliableSequenceNumber;
        command -> acknowledge.receivedReliableSequenceNumber = reliableSequenceNumber;
-       command -> acknowledge.receivedSentTime = ENET_HOST_TO_NET_16 (acknowledgement -> sentTime);
+
+       heldTime = ENET_TIME_DIFFERENCE (host -> serviceTime, acknowledgement -> queueTime);
+       if (heldTime > host -> acknowledgementDelay)
+         heldTime = host -> acknowledgementDelay;
+       command -> acknowledge.receivedSentTime = ENET_HOST_TO_NET_16 ((acknowledgement -> sentTime + heldTime) & 0xFFFF);
   
        if ((acknowledgement -> command.header.command & ENET_PROTOCOL_COMMAND_MASK) == ENET_PROTOCOL_COMMAND_DISCONNECT)
          enet_protocol_dispatch_state (host, peer, ENET_PEER_STATE_ZOMBIE);
 
        enet_list_remove (& acknowledgement -> acknowledgementList);
-       enet_free (acknowledgement);
+       enet_host_free (host, peer, acknowledgement, sizeof (ENetAcknowledgement));
 
        ++ command;
        ++ buffer;
@@ -1323,280 +2002,796 @@ enet_protocol_send_acknowledgements (ENetHost * host, ENetPeer * peer)
     host -> bufferCount = buffer - host -> buffers;
 }
 
+/* Appends the answer to a probe received from a peer. */
 static void
-enet_protocol_send_unreliable_outgoing_commands (ENetHost * host, ENetPeer * peer)
+enet_protocol_send_mtu_probe_answer (ENetHost * host, ENetPeer * peer)
 {
     ENetProtocol * command = & host -> commands [host -> commandCount];
     ENetBuffer * buffer = & host -> buffers [host -> bufferCount];
-    ENetOutgoingCommand * outgoingCommand;
-    ENetListIterator currentCommand;
 
-    currentCommand = enet_list_begin (& peer -> outgoingUnreliableCommands);
-    
-    while (currentCommand != enet_list_end (& peer -> outgoingUnreliableCommands))
-    {
-       size_t commandSize;
+    if (command >= & host -> commands [sizeof (host -> commands) / sizeof (ENetProtocol)] ||
+        buffer >= & host -> buffers [sizeof (host -> buffers) / sizeof (ENetBuffer)] ||
+        peer -> mtu - host -> packetSize < sizeof (ENetProtocolMTUProbe))
+      return;
 
-       outgoingCommand = (ENetOutgoingCommand *) currentCommand;
-       commandSize = commandSizes [outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK];
+    command -> header.command = ENET_PROTOCOL_COMMAND_MTU_PROBE;
+    command -> header.channelID = 0xFF;
+    command -> header.reliableSequenceNumber = 0;
+    command -> mtuProbe.mtu = ENET_HOST_TO_NET_16 (peer -> mtuProbeAnswer);
+    command -> mtuProbe.paddingLength = 0;
 
-       if (command >= & host -> commands [sizeof (host -> commands) / sizeof (ENetProtocol)] ||
-           buffer + 1 >= & host -> buffers [sizeof (host -> buffers) / sizeof (ENetBuffer)] ||
-           peer -> mtu - host -> packetSize < commandSize ||
-           (outgoingCommand -> packet != NULL &&
-             peer -> mtu - host -> packetSize < commandSize + outgoingCommand -> fragmentLength))
-       {
-          host -> continueSending = 1;
+    buffer -> data = command;
+    buffer -> dataLength = sizeof (ENetProtocolMTUProbe);
 
-          break;
-       }
+    host -> packetSize += buffer -> dataLength;
 
-       currentCommand = enet_list_next (currentCommand);
+    peer -> mtuProbeAnswer = 0;
 
-       if (outgoingCommand -> packet != NULL && outgoingCommand -> fragmentOffset == 0)
-       {
-          peer -> packetThrottleCounter += ENET_PEER_PACKET_THROTTLE_COUNTER;
-          peer -> packetThrottleCounter %= ENET_PEER_PACKET_THROTTLE_SCALE;
-          
-          if (peer -> packetThrottleCounter > peer -> packetThrottle)
-          {
-             enet_uint16 reliableSequenceNumber = outgoingCommand -> reliableSequenceNumber,
-                         unreliableSequenceNumber = outgoingCommand -> unreliableSequenceNumber;
-             for (;;)
-             {
-                -- outgoingCommand -> packet -> referenceCount;
+    ++ host -> commandCount;
+    ++ host -> bufferCount;
+}
 
-                if (outgoingCommand -> packet -> referenceCount == 0)
-                  enet_packet_destroy (outgoingCommand -> packet);
-         
-                enet_list_remove (& outgoingCommand -> outgoingCommandList);
-                enet_free (outgoingCommand);
+/* Fills an empty datagram with a probe of the path MTU to a peer if one is due, halfway between
+   the MTU known to get through and the smallest size known not to.  Probes travel alone, so that
+   losing one loses nothing else.  A probe left unanswered ENET_PEER_MTU_PROBE_ATTEMPTS times in a
+   row lowers the latter, and probing stops once both are within ENET_PEER_MTU_PROBE_PRECISION.
+   Returns 1 if a probe was added. */
+static int
+enet_protocol_send_mtu_probe (ENetHost * host, ENetPeer * peer)
+{
+    ENetProtocol * command = & host -> commands [host -> commandCount];
+    ENetBuffer * buffer = & host -> buffers [host -> bufferCount];
+    size_t paddingLength;
 
-                if (currentCommand == enet_list_end (& peer -> outgoingUnreliableCommands))
-                  break;
+    if (peer -> state != ENET_PEER_STATE_CONNECTED ||
+        ENET_TIME_LESS (host -> serviceTime, peer -> mtuProbeTime))
+      return 0;
 
-                outgoingCommand = (ENetOutgoingCommand *) currentCommand;
-                if (outgoingCommand -> reliableSequenceNumber != reliableSequenceNumber ||
-                    outgoingCommand -> unreliableSequenceNumber != unreliableSequenceNumber)
-                  break;
+    if (peer -> mtuProbeSize != 0 &&
+        ++ peer -> mtuProbeAttempts >= ENET_PEER_MTU_PROBE_ATTEMPTS)
+    {
+       peer -> mtuProbeLimit = peer -> mtuProbeSize;
+       peer -> mtuProbeAttempts = 0;
+    }
 
-                currentCommand = enet_list_next (currentCommand);
-             }
-           
-             continue;
-          }
-       }
+    if (peer -> mtuProbeLimit <= peer -> mtu + ENET_PEER_MTU_PROBE_PRECISION)
+    {
+       peer -> mtuProbeLimit = 0;
+       peer -> mtuProbeSize = 0;
 
-       buffer -> data = command;
-       buffer -> dataLength = commandSize;
-      
-       host -> packetSize += buffer -> dataLength;
+       return 0;
+    }
 
-       * command = outgoingCommand -> command;
-       
-       enet_list_remove (& outgoingCommand -> outgoingCommandList);
+    if (peer -> mtuProbeAttempts == 0)
+      peer -> mtuProbeSize = (peer -> mtu + peer -> mtuProbeLimit) / 2;
+    peer -> mtuProbeTime = host -> serviceTime + ENET_MAX (2 * peer -> roundTripTime, ENET_PEER_MTU_PROBE_TIMEOUT);
 
-       if (outgoingCommand -> packet != NULL)
-       {
-          ++ buffer;
-          
-          buffer -> data = outgoingCommand -> packet -> data + outgoingCommand -> fragmentOffset;
-          buffer -> dataLength = outgoingCommand -> fragmentLength;
+    paddingLength = peer -> mtuProbeSize - host -> packetSize - sizeof (ENetProtocolMTUProbe) + sizeof (enet_uint16);
+    if (host -> checksum != NULL)
+      paddingLength -= sizeof (enet_uint32);
 
-          host -> packetSize += buffer -> dataLength;
+    command -> header.command = ENET_PROTOCOL_COMMAND_MTU_PROBE;
+    command -> header.channelID = 0xFF;
+    command -> header.reliableSequenceNumber = 0;
+    command -> mtuProbe.mtu = ENET_HOST_TO_NET_16 (peer -> mtuProbeSize);
+    command -> mtuProbe.paddingLength = ENET_HOST_TO_NET_16 (paddingLength);
 
-          enet_list_insert (enet_list_end (& peer -> sentUnreliableCommands), outgoingCommand);
-       }
-       else
-         enet_free (outgoingCommand);
+    buffer -> data = command;
+    buffer -> dataLength = sizeof (ENetProtocolMTUProbe);
+    ++ buffer;
 
-       ++ command;
-       ++ buffer;
-    } 
+    buffer -> data = (void *) mtuProbePadding;
+    buffer -> dataLength = paddingLength;
 
-    host -> commandCount = command - host -> commands;
-    host -> bufferCount = buffer - host -> buffers;
+    host -> packetSize += sizeof (ENetProtocolMTUProbe) + paddingLength;
 
-    if (peer -> state == ENET_PEER_STATE_DISCONNECT_LATER && 
-        enet_list_empty (& peer -> outgoingReliableCommands) &&
-        enet_list_empty (& peer -> outgoingUnreliableCommands) && 
-        enet_list_empty (& peer -> sentReliableCommands))
-      enet_peer_disconnect (peer, peer -> eventData);
+    ++ host -> commandCount;
+    host -> bufferCount += 2;
+
+    return 1;
 }
 
-static int
-enet_protocol_check_timeouts (ENetHost * host, ENetPeer * peer, ENetEvent * event)
+/* Drops an unsent unreliable command along with the following commands carrying the rest of its packet. */
+static void
+enet_protocol_drop_unreliable_outgoing_commands (ENetPeer * peer, ENetList * queue, ENetOutgoingCommand * outgoingCommand)
 {
-    ENetOutgoingCommand * outgoingCommand;
-    ENetListIterator currentCommand, insertPosition;
+    enet_uint16 reliableSequenceNumber = outgoingCommand -> reliableSequenceNumber,
+                unreliableSequenceNumber = outgoingCommand -> unreliableSequenceNumber;
+    ENetListIterator currentCommand = enet_list_next (& outgoingCommand -> outgoingCommandList);
 
-    currentCommand = enet_list_begin (& peer -> sentReliableCommands);
-    insertPosition = enet_list_begin (& peer -> outgoingReliableCommands);
-
-    while (currentCommand != enet_list_end (& peer -> sentReliableCommands))
+    for (;;)
     {
+       enet_peer_release_outgoing_command (peer, outgoingCommand);
+
+       -- outgoingCommand -> packet -> referenceCount;
+
+       if (outgoingCommand -> packet -> referenceCount == 0)
+         enet_packet_destroy (outgoingCommand -> packet);
+
+       enet_list_remove (& outgoingCommand -> outgoingCommandList);
+       enet_peer_free_outgoing_command (peer, outgoingCommand);
+
+       if (currentCommand == enet_list_end (queue))
+         break;
+
        outgoingCommand = (ENetOutgoingCommand *) currentCommand;
+       if (outgoingCommand -> reliableSequenceNumber != reliableSequenceNumber ||
+           outgoingCommand -> unreliableSequenceNumber != unreliableSequenceNumber)
+         break;
 
        currentCommand = enet_list_next (currentCommand);
+    }
+}
 
-       if (ENET_TIME_DIFFERENCE (host -> serviceTime, outgoingCommand -> sentTime) < outgoingCommand -> roundTripTimeout)
-         continue;
+/* Describes a range of the data of a packet in the buffers of the host starting at buffer, one per segment
+   of the packet that it covers.  If the segments outnumber the buffers left, their data is gathered in the
+   bounce buffer of the datagram instead, so a command always fits in an empty datagram whatever its segments.
+   Returns the number of buffers used, or 0 if they do not fit in the datagram. */
+static size_t
+enet_protocol_get_data_buffers (ENetHost * host, ENetBuffer * buffer, const ENetPacket * packet, enet_uint32 dataOffset, enet_uint16 dataLength)
+{
+    size_t bufferCount = & host -> buffers [sizeof (host -> buffers) / sizeof (ENetBuffer)] - buffer,
+           dataBufferCount = enet_packet_get_buffers (packet, dataOffset, dataLength, buffer, bufferCount);
 
-       if (peer -> earliestTimeout == 0 ||
-           ENET_TIME_LESS (outgoingCommand -> sentTime, peer -> earliestTimeout))
-         peer -> earliestTimeout = outgoingCommand -> sentTime;
+    if (dataBufferCount <= bufferCount)
+      return dataBufferCount;
 
-       if (peer -> earliestTimeout != 0 &&
-             (ENET_TIME_DIFFERENCE (host -> serviceTime, peer -> earliestTimeout) >= peer -> timeoutMaximum ||
-               (outgoingCommand -> roundTripTimeout >= outgoingCommand -> roundTripTimeoutLimit &&
-                 ENET_TIME_DIFFERENCE (host -> serviceTime, peer -> earliestTimeout) >= peer -> timeoutMinimum)))
-       {
-          enet_protocol_notify_disconnect (host, peer, event);
+    if (bufferCount == 0 ||
+        host -> bounceLength + dataLength > sizeof (host -> bounceData))
+      return 0;
 
-          return 1;
-       }
+    buffer -> data = & host -> bounceData [host -> bounceLength];
+    buffer -> dataLength = dataLength;
 
-       if (outgoingCommand -> packet != NULL)
-         peer -> reliableDataInTransit -= outgoingCommand -> fragmentLength;
-          
-       ++ peer -> packetsLost;
+    enet_packet_copy_data (packet, dataOffset, dataLength, buffer -> data);
 
-       outgoingCommand -> roundTripTimeout *= 2;
+    host -> bounceLength += dataLength;
 
-       enet_list_insert (insertPosition, enet_list_remove (& outgoingCommand -> outgoingCommandList));
+    return 1;
+}
 
-       if (currentCommand == enet_list_begin (& peer -> sentReliableCommands) &&
-           ! enet_list_empty (& peer -> sentReliableCommands))
-       {
-          outgoingCommand = (ENetOutgoingCommand *) currentCommand;
+/* Fills in the header of a fragment of a fragmented command: the header shared in the fragment table of
+   its packet, with the command, channel and sequence numbers of the peer. */
+static void
+enet_protocol_fragment_header (const ENetOutgoingCommand * outgoingCommand, enet_uint32 fragmentNumber, ENetProtocol * command)
+{
+    command -> sendFragment = outgoingCommand -> fragments -> table -> fragments [fragmentNumber];
+    command -> header = outgoingCommand -> command.header;
+    command -> sendFragment.startSequenceNumber = outgoingCommand -> command.sendFragment.startSequenceNumber;
 
-          peer -> nextTimeout = outgoingCommand -> sentTime + outgoingCommand -> roundTripTimeout;
-       }
-    }
-    
-    return 0;
+    if (outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_FLAG_ACKNOWLEDGE)
+      command -> header.reliableSequenceNumber = ENET_HOST_TO_NET_16 (outgoingCommand -> reliableSequenceNumber + fragmentNumber);
 }
 
+/* Moves on to the next fragment of a fragmented command once one is sent for the first time.
+   Returns 0 once all of them have been sent. */
 static int
-enet_protocol_send_reliable_outgoing_commands (ENetHost * host, ENetPeer * peer)
+enet_protocol_next_fragment (ENetOutgoingCommand * outgoingCommand)
+{
+    ENetOutgoingFragments * fragments = outgoingCommand -> fragments;
+
+    if (++ fragments -> sentFragments >= fragments -> fragmentCount)
+      return 0;
+
+    outgoingCommand -> fragmentOffset = ENET_NET_TO_HOST_32 (fragments -> table -> fragments [fragments -> sentFragments].fragmentOffset);
+    outgoingCommand -> fragmentLength = ENET_NET_TO_HOST_16 (fragments -> table -> fragments [fragments -> sentFragments].dataLength);
+
+    return 1;
+}
+
+/* Returns 1 if the command was added to the datagram, 0 if the datagram is full, or -1 if it was dropped
+   along with the rest of its packet because it expired or the throttle discarded it. */
+static int
+enet_protocol_send_unreliable_outgoing_command (ENetHost * host, ENetPeer * peer, ENetList * queue, ENetOutgoingCommand * outgoingCommand)
 {
     ENetProtocol * command = & host -> commands [host -> commandCount];
     ENetBuffer * buffer = & host -> buffers [host -> bufferCount];
-    ENetOutgoingCommand * outgoingCommand;
-    ENetListIterator currentCommand;
-    ENetChannel *channel;
-    enet_uint16 reliableWindow;
-    size_t commandSize;
-    int windowExceeded = 0, windowWrap = 0, canPing = 1;
+    size_t commandSize = commandSizes [outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK],
+           dataBufferCount = 0;
+
+    if (command >= & host -> commands [sizeof (host -> commands) / sizeof (ENetProtocol)] ||
+        buffer + 1 >= & host -> buffers [sizeof (host -> buffers) / sizeof (ENetBuffer)] ||
+        peer -> mtu - host -> packetSize < commandSize ||
+        (outgoingCommand -> packet != NULL &&
+          (peer -> mtu - host -> packetSize < commandSize + outgoingCommand -> fragmentLength ||
+           (dataBufferCount = enet_protocol_get_data_buffers (host, buffer + 1, outgoingCommand -> packet, outgoingCommand -> fragmentOffset, outgoingCommand -> fragmentLength)) == 0)))
+    {
+       /* retrying with an empty datagram would never get any further */
+       if (host -> commandCount > 0)
+         host -> continueSending = 1;
 
-    currentCommand = enet_list_begin (& peer -> outgoingReliableCommands);
-    
-    while (currentCommand != enet_list_end (& peer -> outgoingReliableCommands))
+       return 0;
+    }
+
+    if (outgoingCommand -> packet != NULL && outgoingCommand -> fragmentOffset == 0)
     {
-       outgoingCommand = (ENetOutgoingCommand *) currentCommand;
+       ENetChannel * channel = outgoingCommand -> command.header.channelID < peer -> channelCount ? & peer -> channels [outgoingCommand -> command.header.channelID] : NULL;
 
-       channel = outgoingCommand -> command.header.channelID < peer -> channelCount ? & peer -> channels [outgoingCommand -> command.header.channelID] : NULL;
-       reliableWindow = outgoingCommand -> reliableSequenceNumber / ENET_PEER_RELIABLE_WINDOW_SIZE;
-       if (channel != NULL)
-       {
-           if (! windowWrap &&      
-               outgoingCommand -> sendAttempts < 1 && 
-               ! (outgoingCommand -> reliableSequenceNumber % ENET_PEER_RELIABLE_WINDOW_SIZE) &&
-               (channel -> reliableWindows [(reliableWindow + ENET_PEER_RELIABLE_WINDOWS - 1) % ENET_PEER_RELIABLE_WINDOWS] >= ENET_PEER_RELIABLE_WINDOW_SIZE ||
-                 channel -> usedReliableWindows & ((((1 << ENET_PEER_FREE_RELIABLE_WINDOWS) - 1) << reliableWindow) | 
-                   (((1 << ENET_PEER_FREE_RELIABLE_WINDOWS) - 1) >> (ENET_PEER_RELIABLE_WINDOW_SIZE - reliableWindow)))))
-             windowWrap = 1;
-          if (windowWrap)
-          {
-             currentCommand = enet_list_next (currentCommand);
- 
-             continue;
-          }
-       }
- 
-       if (outgoingCommand -> packet != NULL)
+       if (channel != NULL && channel -> outgoingLifetime != 0 &&
+           ENET_TIME_DIFFERENCE (host -> serviceTime, outgoingCommand -> queueTime) >= channel -> outgoingLifetime)
        {
-          if (! windowExceeded)
-          {
-             enet_uint32 windowSize = (peer -> packetThrottle * peer -> windowSize) / ENET_PEER_PACKET_THROTTLE_SCALE;
-             
-             if (peer -> reliableDataInTransit + outgoingCommand -> fragmentLength > ENET_MAX (windowSize, peer -> mtu))
-               windowExceeded = 1;
-          }
-          if (windowExceeded)
-          {
-             currentCommand = enet_list_next (currentCommand);
+          enet_protocol_drop_unreliable_outgoing_commands (peer, queue, outgoingCommand);
 
-             continue;
-          }
+          return -1;
        }
 
-       canPing = 0;
-
-       commandSize = commandSizes [outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK];
-       if (command >= & host -> commands [sizeof (host -> commands) / sizeof (ENetProtocol)] ||
-           buffer + 1 >= & host -> buffers [sizeof (host -> buffers) / sizeof (ENetBuffer)] ||
-           peer -> mtu - host -> packetSize < commandSize ||
-           (outgoingCommand -> packet != NULL && 
-             (enet_uint16) (peer -> mtu - host -> packetSize) < (enet_uint16) (commandSize + outgoingCommand -> fragmentLength)))
+       peer -> packetThrottleCounter += ENET_PEER_PACKET_THROTTLE_COUNTER;
+       peer -> packetThrottleCounter %= ENET_PEER_PACKET_THROTTLE_SCALE;
+       
+       if (peer -> packetThrottleCounter > peer -> packetThrottle)
        {
-          host -> continueSending = 1;
-          
+          enet_protocol_drop_unreliable_outgoing_commands (peer, queue, outgoingCommand);
+        
+          return -1;
+       }
+    }
+
+    buffer -> data = command;
+    buffer -> dataLength = commandSize;
+   
+    host -> packetSize += buffer -> dataLength;
+
+    * command = outgoingCommand -> command;
+
+    if (outgoingCommand -> fragments != NULL)
+    {
+       enet_protocol_fragment_header (outgoingCommand, outgoingCommand -> fragments -> sentFragments, command);
+
+       buffer += dataBufferCount;
+
+       host -> packetSize += outgoingCommand -> fragmentLength;
+
+       /* the command stays at the front of its queue until its last fragment is sent */
+       if (! enet_protocol_next_fragment (outgoingCommand))
+         enet_list_insert (enet_list_end (& peer -> sentUnreliableCommands), enet_list_remove (& outgoingCommand -> outgoingCommandList));
+    }
+    else
+    {
+       enet_list_remove (& outgoingCommand -> outgoingCommandList);
+
+       if (outgoingCommand -> packet != NULL)
+       {
+          buffer += dataBufferCount;
+
+          host -> packetSize += outgoingCommand -> fragmentLength;
+
+          enet_list_insert (enet_list_end (& peer -> sentUnreliableCommands), outgoingCommand);
+       }
+       else
+       {
+          enet_peer_release_outgoing_command (peer, outgoingCommand);
+
+          enet_peer_free_outgoing_command (peer, outgoingCommand);
+       }
+    }
+
+    host -> commandCount = command + 1 - host -> commands;
+    host -> bufferCount = buffer + 1 - host -> buffers;
+
+    return 1;
+}
+
+static int
+enet_protocol_reliable_window_wraps (ENetChannel * channel, enet_uint16 reliableSequenceNumber, enet_uint16 sendAttempts)
+{
+    enet_uint16 reliableWindow = reliableSequenceNumber / ENET_PEER_RELIABLE_WINDOW_SIZE;
+
+    return channel != NULL &&
+           sendAttempts < 1 && 
+           ! (reliableSequenceNumber % ENET_PEER_RELIABLE_WINDOW_SIZE) &&
+           (channel -> reliableWindows [(reliableWindow + ENET_PEER_RELIABLE_WINDOWS - 1) % ENET_PEER_RELIABLE_WINDOWS] >= ENET_PEER_RELIABLE_WINDOW_SIZE ||
+             channel -> usedReliableWindows & ((((1 << ENET_PEER_FREE_RELIABLE_WINDOWS) - 1) << reliableWindow) | 
+               (((1 << ENET_PEER_FREE_RELIABLE_WINDOWS) - 1) >> (ENET_PEER_RELIABLE_WINDOW_SIZE - reliableWindow))));
+}
+
+static int
+enet_protocol_reliable_window_exceeded (ENetPeer * peer, const ENetOutgoingCommand * outgoingCommand, enet_uint16 fragmentLength)
+{
+    enet_uint32 windowSize = (peer -> packetThrottle * peer -> windowSize) / ENET_PEER_PACKET_THROTTLE_SCALE;
+
+    return outgoingCommand -> packet != NULL &&
+           peer -> reliableDataInTransit + fragmentLength > ENET_MAX (windowSize, peer -> mtu);
+}
+
+/* Returns 1 if the command was added to the datagram or 0 if the datagram is full. */
+static int
+enet_protocol_send_reliable_outgoing_command (ENetHost * host, ENetPeer * peer, ENetOutgoingCommand * outgoingCommand)
+{
+    ENetProtocol * command = & host -> commands [host -> commandCount];
+    ENetBuffer * buffer = & host -> buffers [host -> bufferCount];
+    ENetChannel * channel = outgoingCommand -> command.header.channelID < peer -> channelCount ? & peer -> channels [outgoingCommand -> command.header.channelID] : NULL;
+    enet_uint16 reliableWindow = outgoingCommand -> reliableSequenceNumber / ENET_PEER_RELIABLE_WINDOW_SIZE;
+    size_t commandSize = commandSizes [outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK],
+           extensionSize = 0,
+           dataBufferCount = 0;
+
+    /* A VERIFY_CONNECT only carries the extensions of the host if the client advertised its own. */
+    if ((outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK) == ENET_PROTOCOL_COMMAND_CONNECT ||
+        ((outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK) == ENET_PROTOCOL_COMMAND_VERIFY_CONNECT &&
+          peer -> capabilities != 0))
+      extensionSize = sizeof (ENetProtocolConnectExtension);
+
+    if (command + (extensionSize ? 1 : 0) >= & host -> commands [sizeof (host -> commands) / sizeof (ENetProtocol)] ||
+        buffer + 1 >= & host -> buffers [sizeof (host -> buffers) / sizeof (ENetBuffer)] ||
+        peer -> mtu - host -> packetSize < commandSize + extensionSize ||
+        (outgoingCommand -> packet != NULL && 
+          ((enet_uint16) (peer -> mtu - host -> packetSize) < (enet_uint16) (commandSize + outgoingCommand -> fragmentLength) ||
+           (dataBufferCount = enet_protocol_get_data_buffers (host, buffer + 1, outgoingCommand -> packet, outgoingCommand -> fragmentOffset, outgoingCommand -> fragmentLength)) == 0)))
+    {
+       /* retrying with an empty datagram would never get any further */
+       if (host -> commandCount > 0)
+         host -> continueSending = 1;
+       
+       return 0;
+    }
+
+    if (channel != NULL && outgoingCommand -> sendAttempts < 1)
+    {
+       channel -> usedReliableWindows |= 1 << reliableWindow;
+       ++ channel -> reliableWindows [reliableWindow];
+    }
+
+    ++ outgoingCommand -> sendAttempts;
+
+    if (outgoingCommand -> roundTripTimeout == 0)
+    {
+       outgoingCommand -> roundTripTimeout = peer -> roundTripTime + 4 * peer -> roundTripTimeVariance;
+       outgoingCommand -> roundTripTimeoutLimit = peer -> timeoutLimit * outgoingCommand -> roundTripTimeout;
+    }
+
+    if (enet_list_empty (& peer -> sentReliableCommands))
+      peer -> nextTimeout = host -> serviceTime + outgoingCommand -> roundTripTimeout;
+
+    enet_list_insert (enet_list_end (& peer -> sentReliableCommands),
+                      enet_list_remove (& outgoingCommand -> outgoingCommandList));
+
+    outgoingCommand -> sentTime = host -> serviceTime;
+
+    buffer -> data = command;
+    buffer -> dataLength = commandSize;
+
+    host -> packetSize += buffer -> dataLength;
+    host -> headerFlags |= ENET_PROTOCOL_HEADER_FLAG_SENT_TIME;
+
+    * command = outgoingCommand -> command;
+
+    if (outgoingCommand -> packet != NULL)
+    {
+       buffer += dataBufferCount;
+
+       host -> packetSize += outgoingCommand -> fragmentLength;
+
+       peer -> reliableDataInTransit += outgoingCommand -> fragmentLength;
+    }
+
+    ++ peer -> packetsSent;
+
+    host -> commandCount = command + 1 - host -> commands;
+    host -> bufferCount = buffer + 1 - host -> buffers;
+
+    if (extensionSize)
+      enet_protocol_send_connect_extension (host, peer);
+
+    return 1;
+}
+
+/* Sends a fragment of a fragmented reliable command, either for the first time or again once it was
+   lost.  The command moves to the sent commands of the peer along with its first fragment, and each of
+   its fragments is then retransmitted and acknowledged on its own.
+   Returns 1 if the fragment was added to the datagram or 0 if the datagram is full. */
+static int
+enet_protocol_send_reliable_outgoing_fragment (ENetHost * host, ENetPeer * peer, ENetOutgoingCommand * outgoingCommand, enet_uint32 fragmentNumber)
+{
+    ENetProtocol * command = & host -> commands [host -> commandCount];
+    ENetBuffer * buffer = & host -> buffers [host -> bufferCount];
+    ENetOutgoingFragments * fragments = outgoingCommand -> fragments;
+    ENetOutgoingFragment * fragment = & fragments -> states [fragmentNumber];
+    ENetChannel * channel = & peer -> channels [outgoingCommand -> command.header.channelID];
+    enet_uint16 reliableSequenceNumber = outgoingCommand -> reliableSequenceNumber + fragmentNumber,
+                reliableWindow = reliableSequenceNumber / ENET_PEER_RELIABLE_WINDOW_SIZE,
+                fragmentLength = ENET_NET_TO_HOST_16 (fragments -> table -> fragments [fragmentNumber].dataLength);
+    size_t commandSize = sizeof (ENetProtocolSendFragment),
+           dataBufferCount = 0;
+
+    if (command >= & host -> commands [sizeof (host -> commands) / sizeof (ENetProtocol)] ||
+        buffer + 1 >= & host -> buffers [sizeof (host -> buffers) / sizeof (ENetBuffer)] ||
+        (enet_uint16) (peer -> mtu - host -> packetSize) < (enet_uint16) (commandSize + fragmentLength) ||
+        (dataBufferCount = enet_protocol_get_data_buffers (host, buffer + 1, outgoingCommand -> packet,
+                              ENET_NET_TO_HOST_32 (fragments -> table -> fragments [fragmentNumber].fragmentOffset), fragmentLength)) == 0)
+    {
+       /* retrying with an empty datagram would never get any further */
+       if (host -> commandCount > 0)
+         host -> continueSending = 1;
+
+       return 0;
+    }
+
+    if (fragment -> sendAttempts < 1)
+    {
+       channel -> usedReliableWindows |= 1 << reliableWindow;
+       ++ channel -> reliableWindows [reliableWindow];
+    }
+
+    ++ fragment -> sendAttempts;
+
+    if (fragment -> roundTripTimeout == 0)
+    {
+       fragment -> roundTripTimeout = peer -> roundTripTime + 4 * peer -> roundTripTimeVariance;
+       fragment -> roundTripTimeoutLimit = peer -> timeoutLimit * fragment -> roundTripTimeout;
+    }
+
+    if (fragmentNumber == fragments -> sentFragments)
+    {
+       if (fragmentNumber == 0)
+         enet_list_insert (enet_list_end (& peer -> sentReliableCommands),
+                           enet_list_remove (& outgoingCommand -> outgoingCommandList));
+
+       channel -> outgoingFragmentedCommand = enet_protocol_next_fragment (outgoingCommand) ? outgoingCommand : NULL;
+    }
+    else
+    {
+       -- fragments -> lostFragments;
+       -- peer -> lostFragments;
+    }
+
+    fragment -> sentTime = host -> serviceTime;
+    fragment -> state = ENET_OUTGOING_FRAGMENT_STATE_IN_TRANSIT;
+
+    buffer -> data = command;
+    buffer -> dataLength = commandSize;
+
+    host -> packetSize += buffer -> dataLength;
+    host -> headerFlags |= ENET_PROTOCOL_HEADER_FLAG_SENT_TIME;
+
+    enet_protocol_fragment_header (outgoingCommand, fragmentNumber, command);
+
+    buffer += dataBufferCount;
+
+    host -> packetSize += fragmentLength;
+
+    peer -> reliableDataInTransit += fragmentLength;
+
+    ++ peer -> packetsSent;
+
+    host -> commandCount = command + 1 - host -> commands;
+    host -> bufferCount = buffer + 1 - host -> buffers;
+
+    if (enet_list_next (& outgoingCommand -> outgoingCommandList) == enet_list_end (& peer -> sentReliableCommands) &&
+        & outgoingCommand -> outgoingCommandList == enet_list_begin (& peer -> sentReliableCommands))
+      peer -> nextTimeout = fragment -> sentTime + fragment -> roundTripTimeout;
+    else
+    if (ENET_TIME_LESS (fragment -> sentTime + fragment -> roundTripTimeout, peer -> nextTimeout))
+      peer -> nextTimeout = fragment -> sentTime + fragment -> roundTripTimeout;
+
+    return 1;
+}
+
+/* Fills the datagram from the outgoing queues of the channels, serving the highest priority first
+   and channels of equal priority by deficit round robin.  Returns 1 if any command was considered
+   for the datagram, whether or not it fit, and 0 otherwise. */
+static int
+enet_protocol_send_channel_commands (ENetHost * host, ENetPeer * peer, int reliable)
+{
+    enet_uint32 * outgoingChannels = reliable ? peer -> outgoingReliableChannels : peer -> outgoingUnreliableChannels;
+    size_t * nextChannel = reliable ? & peer -> nextReliableChannel : & peer -> nextUnreliableChannel;
+    enet_uint32 readyChannels [ENET_PEER_CHANNEL_MASK_SIZE];
+    int considered = 0;
+
+    if (peer -> channelCount == 0)
+      return 0;
+
+    memcpy (readyChannels, outgoingChannels, sizeof (readyChannels));
+
+    for (;;)
+    {
+       size_t channelID, remaining;
+       int priority = -1;
+
+       for (channelID = 0; channelID < peer -> channelCount; ++ channelID)
+       {
+          if (! readyChannels [channelID / 32])
+          {
+             channelID |= 31;
+
+             continue;
+          }
+
+          if (readyChannels [channelID / 32] & (1u << (channelID % 32)) &&
+              peer -> channels [channelID].outgoingPriority > priority)
+            priority = peer -> channels [channelID].outgoingPriority;
+       }
+
+       if (priority < 0)
+         break;
+
+       for (channelID = * nextChannel % peer -> channelCount, remaining = peer -> channelCount;
+            remaining > 0;
+            channelID = (channelID + 1) % peer -> channelCount, -- remaining)
+       {
+          ENetChannel * channel = & peer -> channels [channelID];
+          ENetList * queue = reliable ? & channel -> outgoingReliableCommands : & channel -> outgoingUnreliableCommands;
+          enet_uint32 * deficit = reliable ? & channel -> outgoingReliableDeficit : & channel -> outgoingUnreliableDeficit;
+          int blocked = 0;
+
+          if (! (readyChannels [channelID / 32] & (1u << (channelID % 32))) ||
+              channel -> outgoingPriority != priority)
+            continue;
+
+          if (! enet_list_empty (queue) || (reliable && channel -> outgoingFragmentedCommand != NULL))
+          {
+             ENetOutgoingCommand * outgoingCommand = reliable && channel -> outgoingFragmentedCommand != NULL ?
+                                                       channel -> outgoingFragmentedCommand : (ENetOutgoingCommand *) enet_list_front (queue);
+
+             if (* deficit < commandSizes [outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK] + outgoingCommand -> fragmentLength)
+               * deficit += channel -> outgoingWeight * peer -> mtu;
+          }
+
+          while (! enet_list_empty (queue) || (reliable && channel -> outgoingFragmentedCommand != NULL))
+          {
+             /* the fragments left of a reliable command whose first fragment was sent go first */
+             ENetOutgoingCommand * outgoingCommand = reliable && channel -> outgoingFragmentedCommand != NULL ?
+                                                       channel -> outgoingFragmentedCommand : (ENetOutgoingCommand *) enet_list_front (queue);
+             size_t size = commandSizes [outgoingCommand -> command.header.command & ENET_PROTOCOL_COMMAND_MASK] + outgoingCommand -> fragmentLength;
+             int result;
+
+             if (* deficit < size)
+               break;
+
+             if (reliable)
+             {
+                enet_uint16 reliableSequenceNumber = outgoingCommand -> reliableSequenceNumber,
+                            sendAttempts = outgoingCommand -> sendAttempts;
+
+                if (outgoingCommand -> fragments != NULL)
+                {
+                   reliableSequenceNumber += outgoingCommand -> fragments -> sentFragments;
+                   sendAttempts = 0;
+                }
+
+                if (enet_protocol_reliable_window_wraps (channel, reliableSequenceNumber, sendAttempts) ||
+                    enet_protocol_reliable_window_exceeded (peer, outgoingCommand, outgoingCommand -> fragmentLength))
+                {
+                   blocked = 1;
+
+                   break;
+                }
+
+                if (outgoingCommand -> fragments != NULL)
+                  result = enet_protocol_send_reliable_outgoing_fragment (host, peer, outgoingCommand, outgoingCommand -> fragments -> sentFragments);
+                else
+                  result = enet_protocol_send_reliable_outgoing_command (host, peer, outgoingCommand);
+             }
+             else
+               result = enet_protocol_send_unreliable_outgoing_command (host, peer, queue, outgoingCommand);
+
+             considered = 1;
+
+             if (result == 0)
+             {
+                * nextChannel = channelID;
+
+                return 1;
+             }
+
+             if (result > 0)
+               * deficit -= size;
+          }
+
+          if (enet_list_empty (queue) && (! reliable || channel -> outgoingFragmentedCommand == NULL))
+          {
+             outgoingChannels [channelID / 32] &= ~ (1u << (channelID % 32));
+             * deficit = 0;
+             blocked = 1;
+          }
+
+          if (blocked)
+            readyChannels [channelID / 32] &= ~ (1u << (channelID % 32));
+
+          * nextChannel = channelID + 1;
+       }
+    }
+
+    return considered;
+}
+
+static void
+enet_protocol_send_unreliable_outgoing_commands (ENetHost * host, ENetPeer * peer)
+{
+    int full = 0;
+
+    while (! enet_list_empty (& peer -> outgoingUnreliableCommands))
+    {
+       if (enet_protocol_send_unreliable_outgoing_command (host, peer, & peer -> outgoingUnreliableCommands,
+             (ENetOutgoingCommand *) enet_list_front (& peer -> outgoingUnreliableCommands)) == 0)
+       {
+          full = 1;
+
           break;
        }
+    }
+
+    if (! full)
+      enet_protocol_send_channel_commands (host, peer, 0);
+
+    if (peer -> state == ENET_PEER_STATE_DISCONNECT_LATER && 
+        ! enet_peer_has_outgoing_commands (peer) &&
+        enet_list_empty (& peer -> sentReliableCommands))
+      enet_peer_disconnect (peer, peer -> eventData);
+}
+
+/* Returns 1 if a command or fragment sent at sentTime that just timed out means the peer is lost. */
+static int
+enet_protocol_peer_timed_out (ENetHost * host, ENetPeer * peer, enet_uint32 sentTime, enet_uint32 roundTripTimeout, enet_uint32 roundTripTimeoutLimit)
+{
+    if (peer -> earliestTimeout == 0 ||
+        ENET_TIME_LESS (sentTime, peer -> earliestTimeout))
+      peer -> earliestTimeout = sentTime;
+
+    return peer -> earliestTimeout != 0 &&
+             (ENET_TIME_DIFFERENCE (host -> serviceTime, peer -> earliestTimeout) >= peer -> timeoutMaximum ||
+               (roundTripTimeout >= roundTripTimeoutLimit &&
+                 ENET_TIME_DIFFERENCE (host -> serviceTime, peer -> earliestTimeout) >= peer -> timeoutMinimum));
+}
+
+static int
+enet_protocol_check_timeouts (ENetHost * host, ENetPeer * peer, ENetEvent * event)
+{
+    ENetOutgoingCommand * outgoingCommand;
+    ENetListIterator currentCommand, insertPosition;
+
+    currentCommand = enet_list_begin (& peer -> sentReliableCommands);
+    insertPosition = enet_list_begin (& peer -> outgoingReliableCommands);
+
+    while (currentCommand != enet_list_end (& peer -> sentReliableCommands))
+    {
+       outgoingCommand = (ENetOutgoingCommand *) currentCommand;
 
        currentCommand = enet_list_next (currentCommand);
 
-       if (channel != NULL && outgoingCommand -> sendAttempts < 1)
+       if (outgoingCommand -> fragments != NULL)
        {
-          channel -> usedReliableWindows |= 1 << reliableWindow;
-          ++ channel -> reliableWindows [reliableWindow];
+          /* the fragments of a fragmented command time out on their own and are sent again in place */
+          ENetOutgoingFragments * fragments = outgoingCommand -> fragments;
+          enet_uint32 fragmentNumber;
+
+          for (fragmentNumber = fragments -> acknowledgedFragments; fragmentNumber < fragments -> sentFragments; ++ fragmentNumber)
+          {
+             ENetOutgoingFragment * fragment = & fragments -> states [fragmentNumber];
+
+             if (fragment -> state != ENET_OUTGOING_FRAGMENT_STATE_IN_TRANSIT ||
+                 ENET_TIME_DIFFERENCE (host -> serviceTime, fragment -> sentTime) < fragment -> roundTripTimeout)
+               continue;
+
+             if (enet_protocol_peer_timed_out (host, peer, fragment -> sentTime, fragment -> roundTripTimeout, fragment -> roundTripTimeoutLimit))
+             {
+                enet_protocol_notify_disconnect (host, peer, event);
+
+                return 1;
+             }
+
+             peer -> reliableDataInTransit -= ENET_NET_TO_HOST_16 (fragments -> table -> fragments [fragmentNumber].dataLength);
+
+             ++ peer -> packetsLost;
+
+             fragment -> roundTripTimeout *= 2;
+             fragment -> state = ENET_OUTGOING_FRAGMENT_STATE_QUEUED;
+
+             ++ fragments -> lostFragments;
+             ++ peer -> lostFragments;
+          }
+
+          continue;
        }
 
-       ++ outgoingCommand -> sendAttempts;
- 
-       if (outgoingCommand -> roundTripTimeout == 0)
+       if (ENET_TIME_DIFFERENCE (host -> serviceTime, outgoingCommand -> sentTime) < outgoingCommand -> roundTripTimeout)
+         continue;
+
+       if (enet_protocol_peer_timed_out (host, peer, outgoingCommand -> sentTime, outgoingCommand -> roundTripTimeout, outgoingCommand -> roundTripTimeoutLimit))
        {
-          outgoingCommand -> roundTripTimeout = peer -> roundTripTime + 4 * peer -> roundTripTimeVariance;
-          outgoingCommand -> roundTripTimeoutLimit = peer -> timeoutLimit * outgoingCommand -> roundTripTimeout;
+          enet_protocol_notify_disconnect (host, peer, event);
+
+          return 1;
        }
 
-       if (enet_list_empty (& peer -> sentReliableCommands))
-         peer -> nextTimeout = host -> serviceTime + outgoingCommand -> roundTripTimeout;
+       if (outgoingCommand -> packet != NULL)
+         peer -> reliableDataInTransit -= outgoingCommand -> fragmentLength;
+          
+       ++ peer -> packetsLost;
 
-       enet_list_insert (enet_list_end (& peer -> sentReliableCommands),
-                         enet_list_remove (& outgoingCommand -> outgoingCommandList));
+       outgoingCommand -> roundTripTimeout *= 2;
 
-       outgoingCommand -> sentTime = host -> serviceTime;
+       enet_list_insert (insertPosition, enet_list_remove (& outgoingCommand -> outgoingCommandList));
+    }
 
-       buffer -> data = command;
-       buffer -> dataLength = commandSize;
+    enet_protocol_reset_next_timeout (peer);
+    
+    return 0;
+}
 
-       host -> packetSize += buffer -> dataLength;
-       host -> headerFlags |= ENET_PROTOCOL_HEADER_FLAG_SENT_TIME;
+/* Sends again the fragments of fragmented commands that timed out.  Returns 1 if the datagram is full. */
+static int
+enet_protocol_send_lost_fragments (ENetHost * host, ENetPeer * peer, int * canPing)
+{
+    ENetListIterator currentCommand;
+
+    for (currentCommand = enet_list_begin (& peer -> sentReliableCommands);
+         currentCommand != enet_list_end (& peer -> sentReliableCommands) && peer -> lostFragments > 0;
+         currentCommand = enet_list_next (currentCommand))
+    {
+       ENetOutgoingCommand * outgoingCommand = (ENetOutgoingCommand *) currentCommand;
+       ENetOutgoingFragments * fragments = outgoingCommand -> fragments;
+       enet_uint32 fragmentNumber;
 
-       * command = outgoingCommand -> command;
+       if (fragments == NULL || fragments -> lostFragments == 0)
+         continue;
 
-       if (outgoingCommand -> packet != NULL)
+       for (fragmentNumber = fragments -> acknowledgedFragments;
+            fragmentNumber < fragments -> sentFragments && fragments -> lostFragments > 0;
+            ++ fragmentNumber)
        {
-          ++ buffer;
-          
-          buffer -> data = outgoingCommand -> packet -> data + outgoingCommand -> fragmentOffset;
-          buffer -> dataLength = outgoingCommand -> fragmentLength;
+          if (fragments -> states [fragmentNumber].state != ENET_OUTGOING_FRAGMENT_STATE_QUEUED)
+            continue;
 
-          host -> packetSize += outgoingCommand -> fragmentLength;
+          if (enet_protocol_reliable_window_exceeded (peer, outgoingCommand, ENET_NET_TO_HOST_16 (fragments -> table -> fragments [fragmentNumber].dataLength)))
+            return 0;
 
-          peer -> reliableDataInTransit += outgoingCommand -> fragmentLength;
+          * canPing = 0;
+
+          if (! enet_protocol_send_reliable_outgoing_fragment (host, peer, outgoingCommand, fragmentNumber))
+            return 1;
        }
+    }
 
-       ++ peer -> packetsSent;
-        
-       ++ command;
-       ++ buffer;
+    return 0;
+}
+
+static int
+enet_protocol_send_reliable_outgoing_commands (ENetHost * host, ENetPeer * peer)
+{
+    ENetOutgoingCommand * outgoingCommand;
+    ENetListIterator currentCommand;
+    int windowExceeded = 0, windowWrap = 0, canPing = 1;
+
+    currentCommand = enet_list_begin (& peer -> outgoingReliableCommands);
+    
+    while (currentCommand != enet_list_end (& peer -> outgoingReliableCommands))
+    {
+       outgoingCommand = (ENetOutgoingCommand *) currentCommand;
+
+       if (! windowWrap &&
+           enet_protocol_reliable_window_wraps (outgoingCommand -> command.header.channelID < peer -> channelCount ? & peer -> channels [outgoingCommand -> command.header.channelID] : NULL,
+                                                outgoingCommand -> reliableSequenceNumber, outgoingCommand -> sendAttempts))
+         windowWrap = 1;
+       if (windowWrap && outgoingCommand -> command.header.channelID < peer -> channelCount)
+       {
+          currentCommand = enet_list_next (currentCommand);
+
+          continue;
+       }
+ 
+       if (! windowExceeded && enet_protocol_reliable_window_exceeded (peer, outgoingCommand, outgoingCommand -> fragmentLength))
+         windowExceeded = 1;
+       if (windowExceeded && outgoingCommand -> packet != NULL)
+       {
+          currentCommand = enet_list_next (currentCommand);
+
+          continue;
+       }
+
+       canPing = 0;
+
+       currentCommand = enet_list_next (currentCommand);
+
+       if (! enet_protocol_send_reliable_outgoing_command (host, peer, outgoingCommand))
+         return 0;
     }
 
-    host -> commandCount = command - host -> commands;
-    host -> bufferCount = buffer - host -> buffers;
+    if (! windowExceeded && peer -> lostFragments > 0 &&
+        enet_protocol_send_lost_fragments (host, peer, & canPing))
+      return 0;
+
+    if (! windowExceeded && enet_protocol_send_channel_commands (host, peer, 1))
+      canPing = 0;
 
     return canPing;
 }
@@ -1604,13 +2799,14 @@ enet_protocol_send_reliable_outgoing_commands (ENetHost * host, ENetPeer * peer)
 static int
 enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int checkForTimeouts)
 {
-    enet_uint8 headerData [sizeof (ENetProtocolHeader) + sizeof (enet_uint32)];
+    enet_uint8 headerData [sizeof (ENetProtocolHeader) + sizeof (enet_uint16) + sizeof (enet_uint32)];
     ENetProtocolHeader * header = (ENetProtocolHeader *) headerData;
     ENetPeer * currentPeer;
-    int sentLength;
-    size_t shouldCompress = 0;
+    int sentLength, probing;
+    size_t headerSize, shouldCompress = 0;
  
     host -> continueSending = 1;
+    host -> nextAcknowledgementTime = 0;
 
     while (host -> continueSending)
     for (host -> continueSending = 0,
@@ -1618,16 +2814,45 @@ enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int ch
          currentPeer < & host -> peers [host -> peerCount];
          ++ currentPeer)
     {
-        if (currentPeer -> state == ENET_PEER_STATE_DISCONNECTED ||
-            currentPeer -> state == ENET_PEER_STATE_ZOMBIE)
+        if (ENET_PEER_STATE (host, currentPeer) == ENET_PEER_STATE_DISCONNECTED ||
+            ENET_PEER_STATE (host, currentPeer) == ENET_PEER_STATE_ZOMBIE)
           continue;
 
+        headerSize = sizeof (ENetProtocolHeader);
+        if (ENET_PEER_EXTENDED_ID (currentPeer))
+          headerSize += sizeof (enet_uint16);
+
         host -> headerFlags = 0;
         host -> commandCount = 0;
         host -> bufferCount = 1;
-        host -> packetSize = sizeof (ENetProtocolHeader);
+        host -> packetSize = headerSize;
+        host -> bounceLength = 0;
+
+        if (! enet_list_empty (& currentPeer -> outgoingStreams) &&
+            currentPeer -> state == ENET_PEER_STATE_CONNECTED)
+          enet_peer_pull_streams (currentPeer);
+
+        if (currentPeer -> queueBlocked &&
+            ! currentPeer -> needsDispatch &&
+            enet_protocol_queue_drained (host, currentPeer))
+        {
+            currentPeer -> needsDispatch = 1;
+
+            enet_list_insert (enet_list_end (& host -> dispatchQueue), & currentPeer -> dispatchList);
+        }
 
-        if (! enet_list_empty (& currentPeer -> acknowledgements))
+        probing = 0;
+        if (currentPeer -> mtuProbeLimit != 0 &&
+            enet_protocol_send_mtu_probe (host, currentPeer))
+        {
+            /* the other commands of the peer go in the next datagram */
+            probing = 1;
+            host -> continueSending = 1;
+            goto sendDatagram;
+        }
+
+        if (! enet_list_empty (& currentPeer -> acknowledgements) &&
+            enet_protocol_acknowledgements_due (host, currentPeer))
           enet_protocol_send_acknowledgements (host, currentPeer);
 
         if (checkForTimeouts != 0 &&
@@ -1641,8 +2866,7 @@ enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int ch
               continue;
         }
 
-        if ((enet_list_empty (& currentPeer -> outgoingReliableCommands) ||
-              enet_protocol_send_reliable_outgoing_commands (host, currentPeer)) &&
+        if (enet_protocol_send_reliable_outgoing_commands (host, currentPeer) &&
             enet_list_empty (& currentPeer -> sentReliableCommands) &&
             ENET_TIME_DIFFERENCE (host -> serviceTime, currentPeer -> lastReceiveTime) >= currentPeer -> pingInterval &&
             currentPeer -> mtu - host -> packetSize >= sizeof (ENetProtocolPing))
@@ -1651,9 +2875,12 @@ enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int ch
             enet_protocol_send_reliable_outgoing_commands (host, currentPeer);
         }
                       
-        if (! enet_list_empty (& currentPeer -> outgoingUnreliableCommands))
-          enet_protocol_send_unreliable_outgoing_commands (host, currentPeer);
+        enet_protocol_send_unreliable_outgoing_commands (host, currentPeer);
 
+        if (currentPeer -> mtuProbeAnswer != 0)
+          enet_protocol_send_mtu_probe_answer (host, currentPeer);
+
+    sendDatagram:
         if (host -> commandCount == 0)
           continue;
 
@@ -1693,19 +2920,19 @@ enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int ch
         }
 
         host -> buffers -> data = headerData;
+        host -> buffers -> dataLength = headerSize - sizeof (enet_uint16);
         if (host -> headerFlags & ENET_PROTOCOL_HEADER_FLAG_SENT_TIME)
         {
-            header -> sentTime = ENET_HOST_TO_NET_16 (host -> serviceTime & 0xFFFF);
+            enet_uint16 sentTime = ENET_HOST_TO_NET_16 (host -> serviceTime & 0xFFFF);
 
-            host -> buffers -> dataLength = sizeof (ENetProtocolHeader);
+            memcpy (& headerData [host -> buffers -> dataLength], & sentTime, sizeof (enet_uint16));
+            host -> buffers -> dataLength += sizeof (enet_uint16);
         }
-        else
-          host -> buffers -> dataLength = (size_t) & ((ENetProtocolHeader *) 0) -> sentTime;
 
         shouldCompress = 0;
-        if (host -> compressor.context != NULL && host -> compressor.compress != NULL)
+        if (! probing && host -> compressor.context != NULL && host -> compressor.compress != NULL)
         {
-            size_t originalSize = host -> packetSize - sizeof(ENetProtocolHeader),
+            size_t originalSize = host -> packetSize - headerSize,
                    compressedSize = host -> compressor.compress (host -> compressor.context,
                                         & host -> buffers [1], host -> bufferCount - 1,
                                         originalSize,
@@ -1726,13 +2953,21 @@ enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int ch
             }
         }
 
-        if (currentPeer -> outgoingPeerID < ENET_PROTOCOL_MAXIMUM_PEER_ID)
+        if (currentPeer -> outgoingPeerID < ENET_PROTOCOL_MAXIMUM_EXTENDED_PEER_ID)
           host -> headerFlags |= currentPeer -> outgoingSessionID << ENET_PROTOCOL_HEADER_SESSION_SHIFT;
-        header -> peerID = ENET_HOST_TO_NET_16 (currentPeer -> outgoingPeerID | host -> headerFlags);
+        if (ENET_PEER_EXTENDED_ID (currentPeer))
+        {
+            enet_uint16 extendedPeerID = ENET_HOST_TO_NET_16 (currentPeer -> outgoingPeerID);
+
+            header -> peerID = ENET_HOST_TO_NET_16 (ENET_PROTOCOL_EXTENDED_PEER_ID | host -> headerFlags);
+            memcpy (& headerData [sizeof (enet_uint16)], & extendedPeerID, sizeof (enet_uint16));
+        }
+        else
+          header -> peerID = ENET_HOST_TO_NET_16 (ENET_MIN (currentPeer -> outgoingPeerID, ENET_PROTOCOL_MAXIMUM_PEER_ID) | host -> headerFlags);
         if (host -> checksum != NULL)
         {
             enet_uint32 * checksum = (enet_uint32 *) & headerData [host -> buffers -> dataLength];
-            * checksum = currentPeer -> outgoingPeerID < ENET_PROTOCOL_MAXIMUM_PEER_ID ? currentPeer -> connectID : 0;
+            * checksum = currentPeer -> outgoingPeerID < ENET_PROTOCOL_MAXIMUM_EXTENDED_PEER_ID ? currentPeer -> connectID : 0;
             host -> buffers -> dataLength += sizeof (enet_uint32);
             * checksum = host -> checksum (host -> buffers, host -> bufferCount);
         }
@@ -1760,6 +2995,118 @@ enet_protocol_send_outgoing_commands (ENetHost * host, ENetEvent * event, int ch
     return 0;
 }
 
+/* Frees the memory of a peer at once and queues a DISCONNECT for the foreign host; the
+   DISCONNECT is flushed and the user notified by enet_protocol_shed_memory(). */
+static void
+enet_protocol_shed_peer (ENetHost * host, ENetPeer * peer)
+{
+    ENetProtocol command;
+
+    enet_peer_reset_queues (peer);
+
+    command.header.command = ENET_PROTOCOL_COMMAND_DISCONNECT | ENET_PROTOCOL_COMMAND_FLAG_UNSEQUENCED;
+    command.header.channelID = 0xFF;
+    command.disconnect.data = 0;
+
+    enet_peer_queue_outgoing_command (peer, & command, NULL, 0, 0);
+
+    peer -> shed = 1;
+
+    ++ host -> shedPeers;
+}
+
+static void
+enet_protocol_shed_host_memory (ENetHost * host)
+{
+    ENetPeer * currentPeer;
+    size_t fixedMemory;
+
+    /* If the host outgrew its budget on its own, e.g. with tables allocated after setting it,
+       shedding peers cannot help, so it only drops their unreliable data below. */
+    fixedMemory = enet_host_fixed_memory (host);
+
+    for (currentPeer = host -> peers;
+         currentPeer < & host -> peers [host -> peerCount];
+         ++ currentPeer)
+    {
+       if (ENET_PEER_STATE (host, currentPeer) != ENET_PEER_STATE_DISCONNECTED &&
+           ENET_PEER_STATE (host, currentPeer) != ENET_PEER_STATE_ZOMBIE)
+         enet_peer_drop_unreliable (currentPeer);
+    }
+
+    while (fixedMemory < host -> memoryBudget && host -> memoryUsage > host -> memoryBudget)
+    {
+       ENetPeer * worstPeer = NULL;
+
+       for (currentPeer = host -> peers;
+            currentPeer < & host -> peers [host -> peerCount];
+            ++ currentPeer)
+       {
+          if (ENET_PEER_STATE (host, currentPeer) == ENET_PEER_STATE_DISCONNECTED ||
+              ENET_PEER_STATE (host, currentPeer) == ENET_PEER_STATE_ZOMBIE ||
+              currentPeer -> shed)
+            continue;
+
+          if (worstPeer == NULL || currentPeer -> memoryUsage > worstPeer -> memoryUsage)
+            worstPeer = currentPeer;
+       }
+
+       if (worstPeer == NULL)
+         break;
+
+       enet_protocol_shed_peer (host, worstPeer);
+    }
+}
+
+/* Brings the host and its peers back within their memory budgets, see enet_host_memory_budget(). */
+static void
+enet_protocol_shed_memory (ENetHost * host)
+{
+    ENetPeer * currentPeer;
+    enet_uint32 shedPeers = host -> shedPeers;
+
+    host -> memoryOverBudget = 0;
+
+    if (host -> peerMemoryBudget != 0)
+    {
+       for (currentPeer = host -> peers;
+            currentPeer < & host -> peers [host -> peerCount];
+            ++ currentPeer)
+       {
+          if (ENET_PEER_STATE (host, currentPeer) == ENET_PEER_STATE_DISCONNECTED ||
+              ENET_PEER_STATE (host, currentPeer) == ENET_PEER_STATE_ZOMBIE ||
+              currentPeer -> memoryUsage <= host -> peerMemoryBudget)
+            continue;
+
+          enet_peer_drop_unreliable (currentPeer);
+
+          if (currentPeer -> memoryUsage > host -> peerMemoryBudget)
+            enet_protocol_shed_peer (host, currentPeer);
+       }
+    }
+
+    if (host -> memoryBudget != 0 && host -> memoryUsage > host -> memoryBudget)
+      enet_protocol_shed_host_memory (host);
+
+    if (host -> shedPeers == shedPeers)
+      return;
+
+    /* one flush sends the DISCONNECT of every shed peer before they become zombies */
+    enet_host_flush (host);
+
+    for (currentPeer = host -> peers;
+         currentPeer < & host -> peers [host -> peerCount];
+         ++ currentPeer)
+    {
+       if (! currentPeer -> shed)
+         continue;
+
+       currentPeer -> shed = 0;
+
+       enet_protocol_notify_disconnect (host, currentPeer, NULL);
+    }
+}
+
 /** Sends any queued packets on the host specified to its designated peers.
 
     @param host   host to flush
@@ -1811,7 +3158,7 @@ enet_host_check_events (ENetHost * host, ENetEvent * event)
 int
 enet_host_service (ENetHost * host, ENetEvent * event, enet_uint32 timeout)
 {
-    enet_uint32 waitCondition;
+    enet_uint32 waitCondition, waitTimeout;
 
     if (event != NULL)
     {
@@ -1845,6 +3192,9 @@ enet_host_service (ENetHost * host, ENetEvent * event, enet_uint32 timeout)
        if (ENET_TIME_DIFFERENCE (host -> serviceTime, host -> bandwidthThrottleEpoch) >= ENET_HOST_BANDWIDTH_THROTTLE_INTERVAL)
          enet_host_bandwidth_throttle (host);
 
+       if (host -> memoryOverBudget)
+         enet_protocol_shed_memory (host);
+
        switch (enet_protocol_send_outgoing_commands (host, event, 1))
        {
        case 1:
@@ -1877,6 +3227,9 @@ enet_host_service (ENetHost * host, ENetEvent * event, enet_uint32 timeout)
           break;
        }
 
+       if (host -> memoryOverBudget)
+         enet_protocol_shed_memory (host);
+
        switch (enet_protocol_send_outgoing_commands (host, event, 1))
        {
        case 1:
@@ -1921,13 +3274,18 @@ enet_host_service (ENetHost * host, ENetEvent * event, enet_uint32 timeout)
 
           waitCondition = ENET_SOCKET_WAIT_RECEIVE | ENET_SOCKET_WAIT_INTERRUPT;
 
-          if (enet_socket_wait (host -> socket, & waitCondition, ENET_TIME_DIFFERENCE (timeout, host -> serviceTime)) != 0)
+          waitTimeout = timeout;
+          if (host -> nextAcknowledgementTime != 0 && ENET_TIME_LESS (host -> nextAcknowledgementTime, timeout))
+            waitTimeout = ENET_TIME_LESS (host -> serviceTime, host -> nextAcknowledgementTime) ? host -> nextAcknowledgementTime : host -> serviceTime;
+
+          if (enet_socket_wait (host -> socket, & waitCondition, ENET_TIME_DIFFERENCE (waitTimeout, host -> serviceTime)) != 0)
             return -1;
        }
        while (waitCondition & ENET_SOCKET_WAIT_INTERRUPT);
 
        host -> serviceTime = enet_time_get ();
-    } while (waitCondition & ENET_SOCKET_WAIT_RECEIVE);
+    } while (waitCondition & ENET_SOCKET_WAIT_RECEIVE ||
+             (host -> nextAcknowledgementTime != 0 && ENET_TIME_GREATER_EQUAL (host -> serviceTime, host -> nextAcknowledgementTime)));
 
     return 0; 
 }
@@ -8,6 +8,7 @@
 #include <sys/socket.h>
 #include <sys/ioctl.h>
 #include <sys/time.h>
+#include <sys/mman.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <unistd.h>
@@ -55,6 +56,14 @@ typedef int socklen_t;
 #define MSG_NOSIGNAL 0
 #endif
 
+#if ! defined (MAP_ANONYMOUS) && defined (MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+
 static enet_uint32 timeBase = 0;
 
 int
@@ -88,6 +97,30 @@ enet_time_set (enet_uint32 newTimeBase)
     timeBase = timeVal.tv_sec * 1000 + timeVal.tv_usec / 1000 - newTimeBase;
 }
 
+void *
+enet_memory_reserve (size_t size)
+{
+    void * address = mmap (NULL, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+    return address != MAP_FAILED ? address : NULL;
+}
+
+int
+enet_memory_commit (void * address, size_t size)
+{
+    size_t pageSize = (size_t) sysconf (_SC_PAGESIZE),
+           start = (size_t) address & ~ (pageSize - 1),
+           end = ((size_t) address + size + pageSize - 1) & ~ (pageSize - 1);
+
+    return mprotect ((void *) start, end - start, PROT_READ | PROT_WRITE);
+}
+
+void
+enet_memory_release (void * address, size_t size)
+{
+    munmap (address, size);
+}
+
 int
 enet_address_set_host (ENetAddress * address, const char * name)
 {
@@ -259,6 +292,15 @@ enet_socket_set_option (ENetSocket socket, ENetSocketOption option, int value)
             result = setsockopt (socket, SOL_SOCKET, SO_SNDTIMEO, (char *) & value, sizeof (int));
             break;
 
+        case ENET_SOCKOPT_DONTFRAGMENT:
+#if defined (IP_MTU_DISCOVER) && defined (IP_PMTUDISC_PROBE)
+            value = value ? IP_PMTUDISC_PROBE : IP_PMTUDISC_WANT;
+            result = setsockopt (socket, IPPROTO_IP, IP_MTU_DISCOVER, (char *) & value, sizeof (int));
+#elif defined (IP_DONTFRAG)
+            result = setsockopt (socket, IPPROTO_IP, IP_DONTFRAG, (char *) & value, sizeof (int));
+#endif
+            break;
+
         default:
             break;
     }
@@ -351,7 +393,7 @@ enet_socket_send (ENetSocket socket,
     
     if (sentLength == -1)
     {
-       if (errno == EWOULDBLOCK)
+       if (errno == EWOULDBLOCK || errno == EMSGSIZE)
          return 0;
 
        return -1;
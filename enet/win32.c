@@ -52,6 +52,24 @@ enet_time_set (enet_uint32 newTimeBase)
     timeBase = (enet_uint32) timeGetTime () - newTimeBase;
 }
 
+void *
+enet_memory_reserve (size_t size)
+{
+    return VirtualAlloc (NULL, size, MEM_RESERVE, PAGE_NOACCESS);
+}
+
+int
+enet_memory_commit (void * address, size_t size)
+{
+    return VirtualAlloc (address, size, MEM_COMMIT, PAGE_READWRITE) != NULL ? 0 : -1;
+}
+
+void
+enet_memory_release (void * address, size_t size)
+{
+    VirtualFree (address, 0, MEM_RELEASE);
+}
+
 int
 enet_address_set_host (ENetAddress * address, const char * name)
 {
@@ -189,6 +207,12 @@ enet_socket_set_option (ENetSocket socket, ENetSocketOption option, int value)
             result = setsockopt (socket, SOL_SOCKET, SO_SNDTIMEO, (char *) & value, sizeof (int));
             break;
 
+        case ENET_SOCKOPT_DONTFRAGMENT:
+#ifdef IP_DONTFRAGMENT
+            result = setsockopt (socket, IPPROTO_IP, IP_DONTFRAGMENT, (char *) & value, sizeof (int));
+#endif
+            break;
+
         default:
             break;
     }
@@ -278,7 +302,7 @@ enet_socket_send (ENetSocket socket,
                    NULL,
                    NULL) == SOCKET_ERROR)
     {
-       if (WSAGetLastError () == WSAEWOULDBLOCK)
+       if (WSAGetLastError () == WSAEWOULDBLOCK || WSAGetLastError () == WSAEMSGSIZE)
          return 0;
 
        return -1;
@@ -1,8 +1,17 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "enet/enet.h"
+#include "s_enet_internal.h"
 #include "s_enet.h"
 
+#if !(defined(__WIN32__) || defined(_WIN32) || defined(WIN32) || defined(__WINDOWS__) || defined(__TOS_WIN__))
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
 /* Init/Shutdown */
 /** \brief
  *
@@ -13,6 +22,7 @@ int         SENET_API   SE_Startup ()
     if (enet_initialize() != 0) {
         return 0;
     }
+    resolver_startup();
     return 1;
 }
 
@@ -22,9 +32,504 @@ int         SENET_API   SE_Startup ()
  */
 void        SENET_API   SE_Shutdown ()
 {
+    resolver_shutdown();
     enet_deinitialize();
 }
 
+/* Packets */
+typedef struct {
+    SEPacketOnFree on_free;
+    void* user_data;
+} packet_callback_t;
+
+static void ENET_CALLBACK packet_free_callback (ENetPacket* packet)
+{
+    packet_callback_t* callback = packet->userData;
+
+    callback->on_free((packet_t*)packet, callback->user_data);
+    free(callback);
+}
+
+/** \brief Create a packet that can be sent to any number of peers without being copied again
+ *
+ * The caller owns a reference to the packet and must release it with SE_PacketRelease() once
+ * it has finished sending it. The packet is freed when it is released and all its sends are done
+ *
+ * \param data[in] Packet data, or 0 to leave the data uninitialized (see SE_PacketGetData()); requires alloc = 1
+ * \param data_len[in] Data size
+ * \param reliable[in] 1 to send the packet reliably, 0 otherwise
+ * \param alloc[in] If set to 1, the data is copied into the packet, otherwise the user must keep the data buffer until the packet is freed (see SE_PacketSetFreeCallback())
+ *
+ * \return Packet pointer, or 0 if failure
+ *
+ */
+packet_t*   SENET_API   SE_PacketCreate (const uint8* data, const size_t data_len, const int reliable, const int alloc)
+{
+    unsigned int flags = 0;
+    if (data == NULL && alloc == 0) {
+        return NULL;
+    }
+    if (reliable != 0) {
+        flags += ENET_PACKET_FLAG_RELIABLE;
+    }
+    if (alloc == 0) {
+        flags += ENET_PACKET_FLAG_NO_ALLOCATE;
+    }
+
+    ENetPacket* packet = enet_packet_create(data, data_len, flags);
+    if (packet == NULL) {
+        return NULL;
+    }
+
+    packet->referenceCount++;
+    return (packet_t*)packet;
+}
+
+/** \brief Create a packet made of several buffers, sent without being concatenated
+ *
+ * The buffers are not copied: the user must keep them until the packet is freed (see SE_PacketSetFreeCallback()).
+ * SE_PacketGetData() returns 0 for such a packet. It is released with SE_PacketRelease(), like any packet
+ *
+ * \param datas[in] Array of buffers, in order
+ * \param data_lens[in] Array of buffer sizes
+ * \param count[in] Number of buffers
+ * \param reliable[in] 1 to send the packet reliably, 0 otherwise
+ *
+ * \return Packet pointer, or 0 if failure
+ *
+ */
+packet_t*   SENET_API   SE_PacketCreateSegments (const uint8** datas, const size_t* data_lens, const size_t count, const int reliable)
+{
+    unsigned int flags = 0;
+    if (reliable != 0) {
+        flags += ENET_PACKET_FLAG_RELIABLE;
+    }
+
+    ENetBuffer* segments = malloc(count * sizeof(ENetBuffer));
+    if (segments == NULL && count > 0) {
+        return NULL;
+    }
+
+    size_t i;
+    for (i = 0; i < count; i++) {
+        segments[i].data = (void*)datas[i];
+        segments[i].dataLength = data_lens[i];
+    }
+
+    ENetPacket* packet = enet_packet_create_segments(segments, count, flags);
+    free(segments);
+    if (packet == NULL) {
+        return NULL;
+    }
+
+    packet->referenceCount++;
+    return (packet_t*)packet;
+}
+
+/** \brief Set a function called when a packet is freed, meaning its data can be reused
+ *
+ * Packets whose memory is managed by the library, such as the packets of SESrv_SendFile() or those
+ * allocated by a host allocator, already have a free function of their own and are refused
+ *
+ * \param packet[in] Packet pointer
+ * \param on_free_proc[in] Function called when the packet is freed, or 0 to remove it
+ * \param user_data[in] User data passed to the callback
+ *
+ * \return 1 on succes, 0 on failure
+ *
+ */
+int         SENET_API   SE_PacketSetFreeCallback (packet_t* packet, SEPacketOnFree on_free_proc, void* user_data)
+{
+    ENetPacket* e_packet = (ENetPacket*)packet;
+
+    if (e_packet == NULL || e_packet->allocator != NULL ||
+        (e_packet->freeCallback != NULL && e_packet->freeCallback != packet_free_callback)) {
+        return 0;
+    }
+
+    if (e_packet->freeCallback != NULL) {
+        free(e_packet->userData);
+        e_packet->freeCallback = NULL;
+        e_packet->userData = NULL;
+    }
+    if (on_free_proc == NULL) { return 1; }
+
+    packet_callback_t* callback = malloc(sizeof(packet_callback_t));
+    if (callback == NULL) {
+        return 0;
+    }
+    callback->on_free = on_free_proc;
+    callback->user_data = user_data;
+
+    e_packet->userData = callback;
+    e_packet->freeCallback = packet_free_callback;
+    return 1;
+}
+
+/** \brief Get the data of a packet
+ *
+ * \param packet[in] Packet pointer
+ *
+ * \return Packet data, or 0 for a packet created with SE_PacketCreateSegments()
+ *
+ */
+uint8*      SENET_API   SE_PacketGetData (packet_t* packet)
+{
+    return ((ENetPacket*)packet)->data;
+}
+
+/** \brief Queue a packet to be sent to a peer of a server or an advanced client
+ *
+ * The packet is not copied. It is sent on the next call of SESrv_Process() or SECln2_Process()
+ *
+ * \param packet[in] Packet pointer
+ * \param peer[in] Peer pointer
+ * \param channel[in] Channel N°
+ *
+ * \return 1 on succes, 0 on failure, -1 if packet == NULL or peer == NULL, -2 if the queue of the peer is full
+ *
+ */
+int         SENET_API   SE_PacketSendTo (packet_t* packet, peer_t* peer, const size_t channel)
+{
+    if (packet == NULL || peer == NULL) { return -1; }
+
+    int ret = enet_peer_send((ENetPeer*)peer, channel, (ENetPacket*)packet);
+    if (ret == 0) { return 1; }
+    if (ret == -2) { return -2; }
+    return 0;
+}
+
+/** \brief Release the reference to a packet obtained with SE_PacketCreate() or SE_PacketCreateSegments()
+ *
+ * The packet is freed at once if it isn't queued for sending anymore, otherwise when its last send is done
+ *
+ * \param packet[in] Packet pointer
+ *
+ */
+void        SENET_API   SE_PacketRelease (packet_t* packet)
+{
+    ENetPacket* e_packet = (ENetPacket*)packet;
+
+    if (--e_packet->referenceCount == 0) {
+        enet_packet_destroy(e_packet);
+    }
+}
+
+/* Streams */
+typedef struct {
+    SEStreamPull pull;
+    void* user_data;
+} stream_callback_t;
+
+static int ENET_CALLBACK stream_pull_callback (ENetPeer* peer, enet_uint8 channel, enet_uint8* data, size_t data_len, void* user_data)
+{
+    stream_callback_t* callback = user_data;
+
+    int ret = callback->pull((peer_t*)peer, channel, data, data_len, callback->user_data);
+    if (data == NULL) {
+        free(callback);
+    }
+    return ret;
+}
+
+/* Start sending a stream to a peer. Returns 1 on success, 0 on failure */
+int stream_send (ENetPeer* peer, size_t channel, SEStreamPull pull_proc, void* user_data)
+{
+    if (pull_proc == NULL || channel >= peer->channelCount) { return 0; }
+
+    stream_callback_t* callback = malloc(sizeof(stream_callback_t));
+    if (callback == NULL) {
+        return 0;
+    }
+    callback->pull = pull_proc;
+    callback->user_data = user_data;
+
+    if (enet_peer_stream(peer, channel, stream_pull_callback, callback) != 0) {
+        free(callback);
+        return 0;
+    }
+    return 1;
+}
+
+/* File mapping */
+#if defined(__WIN32__) || defined(_WIN32) || defined(WIN32) || defined(__WINDOWS__) || defined(__TOS_WIN__)
+int file_map (const char* path, void** data, size_t* len)
+{
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) { return 0; }
+
+    LARGE_INTEGER size;
+    if (GetFileSizeEx(file, &size) == 0 || (ULONGLONG)size.QuadPart > (size_t)-1) {
+        CloseHandle(file);
+        return 0;
+    }
+    *data = NULL;
+    *len = (size_t)size.QuadPart;
+    if (*len == 0) {
+        CloseHandle(file);
+        return 1;
+    }
+
+    /* the view keeps the mapping and the file open */
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL) { return 0; }
+
+    *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    return *data != NULL;
+}
+
+void file_unmap (void* data, size_t len)
+{
+    if (data != NULL) { UnmapViewOfFile(data); }
+}
+#else  /* presume POSIX */
+int file_map (const char* path, void** data, size_t* len)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) { return 0; }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (unsigned long long)st.st_size > (size_t)-1) {
+        close(fd);
+        return 0;
+    }
+    *data = NULL;
+    *len = (size_t)st.st_size;
+    if (*len == 0) {
+        close(fd);
+        return 1;
+    }
+
+    /* the mapping keeps the file open */
+    void* map = mmap(NULL, *len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) { return 0; }
+
+    #ifdef MADV_SEQUENTIAL
+    madvise(map, *len, MADV_SEQUENTIAL);
+    #endif
+    *data = map;
+    return 1;
+}
+
+void file_unmap (void* data, size_t len)
+{
+    if (data != NULL) { munmap(data, len); }
+}
+#endif
+
+/* Message aggregation */
+static size_t varint_size (size_t value)
+{
+    size_t size = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        size++;
+    }
+    return size;
+}
+
+static enet_uint8* varint_write (enet_uint8* dest, size_t value)
+{
+    while (value >= 0x80) {
+        *dest++ = (enet_uint8)(value | 0x80);
+        value >>= 7;
+    }
+    *dest++ = (enet_uint8)value;
+    return dest;
+}
+
+/* Send the packed messages of a batch. Returns 1 on success or if it was empty, 0 on failure (the messages
+   are dropped), -2 if the queue of the peer is full (the batch is kept for a later flush) */
+int batch_flush (batch_t* batch)
+{
+    if (batch->packet == NULL) { return 1; }
+
+    ENetPacket* packet = batch->packet;
+    size_t capacity = packet->dataLength;
+
+    /* the data keeps its size, so the batch can still be appended to if it can't be queued yet */
+    packet->dataLength = batch->len;
+    int ret = enet_peer_send(batch->peer, batch->channel, packet);
+    if (ret == -2) {
+        packet->dataLength = capacity;
+        return -2;
+    }
+
+    batch->packet = NULL;
+    batch->len = 0;
+    if (ret != 0) {
+        enet_packet_destroy(packet);
+        return 0;
+    }
+    return 1;
+}
+
+/* Add a message to a batch, flushing it first if the message doesn't fit in one datagram with
+   the previous ones or doesn't have the same flags. Returns 1 on success, 0 on failure, -2 if
+   the queue of the peer is full, counting the messages of the batch not flushed yet */
+int batch_append (batch_t* batch, batch_t** pending, ENetPeer* peer, enet_uint8 channel, enet_uint32 flags, const enet_uint8* data, size_t data_len)
+{
+    size_t frame_len = varint_size(data_len) + data_len;
+    if (peer->state != ENET_PEER_STATE_CONNECTED || channel >= peer->channelCount) { return 0; }
+
+    /* the batch must not be fragmented: the limit counts the checksum and extended peer ID of the header */
+    size_t limit = enet_peer_fragment_length(peer);
+
+    flags &= ~ENET_PACKET_FLAG_NO_ALLOCATE;
+
+    /* the MTU of the peer may have grown since the batch was created, its packet keeps its size */
+    if (batch->packet != NULL && (batch->peer != peer || batch->packet->flags != flags || batch->len + frame_len > batch->packet->dataLength)) {
+        if (batch_flush(batch) == -2) { return -2; }
+    }
+
+    if (enet_peer_queue_room(peer, (batch->packet != NULL ? batch->len : 0) + frame_len) == 0) { return -2; }
+
+    if (frame_len > limit) {
+        ENetPacket* packet = enet_packet_create_with_allocator(peer->host->allocator, NULL, frame_len, flags);
+        if (packet == NULL) { return 0; }
+
+        memcpy(varint_write(packet->data, data_len), data, data_len);
+        int ret = enet_peer_send(peer, channel, packet);
+        if (ret != 0) {
+            enet_packet_destroy(packet);
+            return ret == -2 ? -2 : 0;
+        }
+        return 1;
+    }
+
+    if (batch->packet == NULL) {
+        batch->packet = enet_packet_create_with_allocator(peer->host->allocator, NULL, limit, flags);
+        if (batch->packet == NULL) { return 0; }
+
+        batch->peer = peer;
+        batch->channel = channel;
+        batch->len = 0;
+    }
+
+    memcpy(varint_write(batch->packet->data + batch->len, data_len), data, data_len);
+    batch->len += frame_len;
+
+    if (batch->pending == 0) {
+        batch->pending = 1;
+        batch->next = *pending;
+        *pending = batch;
+    }
+    return 1;
+}
+
+/* Flush all the batches holding messages. Batches refused by a full queue stay pending */
+void batch_flush_all (batch_t** pending)
+{
+    batch_t* batch = *pending;
+    *pending = NULL;
+    while (batch != NULL) {
+        batch_t* next = batch->next;
+        if (batch_flush(batch) == -2) {
+            batch->next = *pending;
+            *pending = batch;
+        } else {
+            batch->pending = 0;
+        }
+        batch = next;
+    }
+}
+
+/* Drop the messages of a batch */
+void batch_reset (batch_t* batch)
+{
+    if (batch->packet != NULL) {
+        enet_packet_destroy(batch->packet);
+        batch->packet = NULL;
+    }
+    batch->len = 0;
+}
+
+/* Allocate the batch slots of a connected peer. Returns 0 on failure */
+peer_batches_t* peer_batches_create (ENetPeer* peer)
+{
+    size_t size = sizeof(peer_batches_t) + peer->channelCount * sizeof(batch_t*);
+
+    peer_batches_t* batches = enet_host_malloc(peer->host, peer, size);
+    if (batches == NULL) { return NULL; }
+
+    batches->peer = peer;
+    batches->count = peer->channelCount;
+    batches->channels = (batch_t**)(batches + 1);
+    memset(batches->channels, 0, batches->count * sizeof(batch_t*));
+    return batches;
+}
+
+/* Get the batch of a channel, allocating it on the first message. Returns 0 on failure */
+batch_t* peer_batches_get (peer_batches_t* batches, size_t channel)
+{
+    if (channel >= batches->count) { return NULL; }
+
+    if (batches->channels[channel] == NULL) {
+        batch_t* batch = enet_host_malloc(batches->peer->host, batches->peer, sizeof(batch_t));
+        if (batch == NULL) { return NULL; }
+
+        batch->peer = batches->peer;
+        batch->channel = channel;
+        batch->packet = NULL;
+        batch->len = 0;
+        batch->pending = 0;
+        batch->next = NULL;
+        batches->channels[channel] = batch;
+    }
+    return batches->channels[channel];
+}
+
+/* Drop the messages of a peer (disconnected) and free its batches, taking them out of the pending list */
+void peer_batches_destroy (peer_batches_t* batches, batch_t** pending)
+{
+    ENetHost* host = batches->peer->host;
+
+    while (*pending != NULL) {
+        if ((*pending)->peer == batches->peer) {
+            *pending = (*pending)->next;
+        } else {
+            pending = &(*pending)->next;
+        }
+    }
+
+    size_t i;
+    for (i = 0; i < batches->count; i++) {
+        if (batches->channels[i] != NULL) {
+            batch_reset(batches->channels[i]);
+            enet_host_free(host, batches->peer, batches->channels[i], sizeof(batch_t));
+        }
+    }
+    enet_host_free(host, batches->peer, batches, sizeof(peer_batches_t) + batches->count * sizeof(batch_t*));
+}
+
+/* Read the next message of an aggregated packet. Returns 1 if a message was read, 0 at the end of the packet or if it is malformed */
+int batch_next (const enet_uint8** data, size_t* data_len, const enet_uint8** msg, size_t* msg_len)
+{
+    size_t len = 0;
+    int shift = 0;
+
+    while (1) {
+        if (*data_len == 0 || shift > 28) { return 0; }
+
+        enet_uint8 byte = *(*data)++;
+        (*data_len)--;
+
+        len |= (size_t)(byte & 0x7F) << shift;
+        shift += 7;
+        if ((byte & 0x80) == 0) { break; }
+    }
+    if (len > *data_len) { return 0; }
+
+    *msg = *data;
+    *msg_len = len;
+    *data += len;
+    *data_len -= len;
+    return 1;
+}
+
 inline void debug (const char* data)
 {
     printf(data);
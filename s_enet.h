@@ -16,29 +16,69 @@ typedef struct peer_t peer_t;
 typedef struct server_t server_t;
 typedef struct client_t client_t;
 typedef struct client2_t client2_t;
+typedef struct group_t group_t;
+typedef struct packet_t packet_t;
+
+/* Reasons datagrams are dropped on receive (see SESrv_GetDropCount()) */
+#define SE_DROP_MALFORMED       0
+#define SE_DROP_SOURCE_LIMIT    1
+#define SE_DROP_UNKNOWN_PEER    2
+#define SE_DROP_DECOMPRESS      3
+#define SE_DROP_CHECKSUM        4
 
 /* Callback */
 // Server
 typedef void (*SESrvOnConnect)       (server_t* srv, peer_t* peer, uint32 data);
 typedef void (*SESrvOnDisconnect)    (server_t* srv, peer_t* peer, uint32 data);
 typedef void (*SESrvOnRecv)          (server_t* srv, peer_t* peer, size_t channel, uint8* data, size_t data_len);
+typedef void (*SESrvOnStream)        (server_t* srv, peer_t* peer, size_t channel, uint8* data, size_t data_len);
 typedef void (*SESrvIterateProc)     (server_t* srv, peer_t* peer, void* user_data);
+typedef void (*SESrvOnFileSent)      (server_t* srv, peer_t* peer, int delivered, void* user_data);
+typedef void (*SESrvOnWritable)      (server_t* srv, peer_t* peer);
 
 // Client
+typedef void (*SEClnOnConnect)       (client_t* cln, int connected);
 typedef void (*SEClnOnDisconnect)    (client_t* cln, uint32 data);
 typedef void (*SEClnOnRecv)          (client_t* cln, size_t channel, uint8* data, size_t data_len);
+typedef void (*SEClnOnStream)        (client_t* cln, size_t channel, uint8* data, size_t data_len);
 
 // Advanced client
 typedef int  (*SECln2OnConnect)      (client2_t* cln, peer_t* peer, uint32 data);
 typedef void (*SECln2OnDisconnect)   (client2_t* cln, peer_t* peer, uint32 data);
 typedef void (*SECln2OnRecv)         (client2_t* cln, peer_t* peer, size_t channel, uint8* data, size_t data_len);
+typedef void (*SECln2OnStream)       (client2_t* cln, peer_t* peer, size_t channel, uint8* data, size_t data_len);
 typedef void (*SECln2IterateProc)    (client2_t* srv, peer_t* peer, void* user_data);
 
+// Packets
+typedef void (*SEPacketOnFree)       (packet_t* packet, void* user_data);
+
+// Streams
+typedef int  (*SEStreamPull)         (peer_t* peer, size_t channel, uint8* data, size_t data_len, void* user_data);
+
+// Resolver
+typedef int  (*SEResolveProc)        (const char* host, uint32* ip, void* user_data);
+
+// Allocator
+typedef void* (*SEAllocProc)         (void* user_data, size_t size);
+typedef void (*SEFreeProc)           (void* user_data, void* memory);
+
 
 /* Init/Shutdown */
 int         SENET_API   SE_Startup ();
 void        SENET_API   SE_Shutdown ();
 
+/* Resolver functions */
+void        SENET_API   SE_SetResolver (SEResolveProc resolve_proc, void* user_data);
+void        SENET_API   SE_SetResolverCacheTTL (const uint32 ttl);
+
+/* Packet functions */
+packet_t*   SENET_API   SE_PacketCreate (const uint8* data, const size_t data_len, const int reliable, const int alloc);
+packet_t*   SENET_API   SE_PacketCreateSegments (const uint8** datas, const size_t* data_lens, const size_t count, const int reliable);
+int         SENET_API   SE_PacketSetFreeCallback (packet_t* packet, SEPacketOnFree on_free_proc, void* user_data);
+uint8*      SENET_API   SE_PacketGetData (packet_t* packet);
+int         SENET_API   SE_PacketSendTo (packet_t* packet, peer_t* peer, const size_t channel);
+void        SENET_API   SE_PacketRelease (packet_t* packet);
+
 /* Server functions */
 server_t*   SENET_API   SESrv_Create (const uint16 port, const size_t max_peers, const size_t channels, const uint32 max_in_bandwidth, const uint32 max_out_bandwidth);
 void        SENET_API   SESrv_Destroy (server_t* srv);
@@ -50,10 +90,22 @@ void        SENET_API   SESrv_SetPort (server_t* srv, const uint16 port);
 uint16      SENET_API   SESrv_GetPort (server_t* srv);
 
 void        SENET_API   SESrv_SetCallbacks (server_t* srv, SESrvOnConnect on_conn_proc, SESrvOnRecv on_recv_proc, SESrvOnDisconnect on_disconnect_proc);
+void        SENET_API   SESrv_SetStreamCallback (server_t* srv, SESrvOnStream on_stream_proc);
+void        SENET_API   SESrv_SetWritableCallback (server_t* srv, SESrvOnWritable on_writable_proc);
 
 void        SENET_API   SESrv_SetLimits (server_t* srv, const uint32 max_in_bandwidth, const uint32 max_out_bandwidth);
 void        SENET_API   SESrv_SetReliability (server_t* srv, const int reliable);
 void        SENET_API   SESrv_SetSendImmediatly (server_t* srv, const int send_immediatly);
+void        SENET_API   SESrv_SetDirectRecv (server_t* srv, const int direct_recv);
+void        SENET_API   SESrv_SetConnectCookies (server_t* srv, const int connect_cookies);
+void        SENET_API   SESrv_SetMTU (server_t* srv, const uint32 mtu, const int probe);
+int         SENET_API   SESrv_SetSourceLimit (server_t* srv, const uint32 rate, const uint32 burst);
+void        SENET_API   SESrv_SetQueueLimits (server_t* srv, const size_t peer_bytes, const size_t peer_packets, const size_t total_bytes, const size_t total_packets);
+int         SENET_API   SESrv_SetMemoryBudget (server_t* srv, const size_t budget, const size_t peer_budget);
+size_t      SENET_API   SESrv_GetMemoryUsage (server_t* srv, uint32* shed_peers);
+int         SENET_API   SESrv_SetAllocator (server_t* srv, SEAllocProc alloc_proc, SEFreeProc free_proc, void* user_data);
+uint32      SENET_API   SESrv_GetDropCount (server_t* srv, const int reason);
+int         SENET_API   SESrv_SetAggregation (server_t* srv, const size_t channel, const int aggregate);
 
 void        SENET_API   SESrv_SetUserData (server_t* srv, void* user_data);
 void*       SENET_API   SESrv_GetUserData (server_t* srv);
@@ -72,10 +124,26 @@ char*       SENET_API   SESrv_PeerGetIP (server_t* srv, peer_t* peer);
 uint16      SENET_API   SESrv_PeerGetPort (server_t* srv, peer_t* peer);
 
 uint32      SENET_API   SESrv_PeerGetRoundTripTime (server_t* srv, peer_t* peer);
+int         SENET_API   SESrv_PeerSetChannelLifetime (server_t* srv, peer_t* peer, const size_t channel, const uint32 lifetime);
+void        SENET_API   SESrv_PeerSetQueueLimits (server_t* srv, peer_t* peer, const size_t bytes, const size_t packets);
+size_t      SENET_API   SESrv_PeerGetQueued (server_t* srv, peer_t* peer, size_t* packets);
+size_t      SENET_API   SESrv_PeerGetMemoryUsage (server_t* srv, peer_t* peer);
 
 int         SENET_API   SESrv_Send (server_t* srv, peer_t* peer, const size_t channel, const uint8* data, const size_t data_len, const int alloc);
+int         SENET_API   SESrv_SendState (server_t* srv, peer_t* peer, const size_t channel, const uint32 key, const uint8* data, const size_t data_len, const int alloc);
+int         SENET_API   SESrv_SendFile (server_t* srv, peer_t* peer, const size_t channel, const char* path, SESrvOnFileSent on_sent_proc, void* user_data);
+int         SENET_API   SESrv_SendStream (server_t* srv, peer_t* peer, const size_t channel, SEStreamPull pull_proc, void* user_data);
 void        SENET_API   SESrv_Broadcast (server_t* srv, const size_t channel, const uint8* data, const size_t data_len, const int alloc);
 
+group_t*    SENET_API   SESrv_GroupCreate (server_t* srv);
+void        SENET_API   SESrv_GroupDestroy (server_t* srv, group_t* group);
+int         SENET_API   SESrv_GroupAdd (server_t* srv, group_t* group, peer_t* peer);
+int         SENET_API   SESrv_GroupRemove (server_t* srv, group_t* group, peer_t* peer);
+size_t      SENET_API   SESrv_GroupPeersCount (server_t* srv, group_t* group);
+int         SENET_API   SESrv_GroupSend (server_t* srv, group_t* group, const size_t channel, const uint8* data, const size_t data_len, const int alloc);
+
+packet_t*   SENET_API   SESrv_RecvRetain (server_t* srv);
+
 void        SENET_API   SESrv_Process (server_t* srv, const uint32 wait_time);
 
 /* Client functions */
@@ -83,6 +151,7 @@ client_t*   SENET_API   SECln_Create (const char* host, const uint16 port, const
 void        SENET_API   SECln_Destroy (client_t* cln);
 
 int         SENET_API   SECln_Connect (client_t* cln, const uint32 timeout, const uint32 connect_data);
+int         SENET_API   SECln_ConnectAsync (client_t* cln, const uint32 timeout, const uint32 connect_data);
 void        SENET_API   SECln_Disconnect (client_t* cln, const int force, const uint32 disconnect_data);
 int         SENET_API   SECln_IsConnected (client_t* cln);
 
@@ -93,15 +162,24 @@ char*       SENET_API   SECln_GetHostIP (client_t* cln);
 uint16      SENET_API   SECln_GetPort (client_t* cln);
 
 void        SENET_API   SECln_SetCallbacks (client_t* cln, SEClnOnRecv on_recv_proc, SEClnOnDisconnect on_disconnect_proc);
+void        SENET_API   SECln_SetConnectCallback (client_t* cln, SEClnOnConnect on_connect_proc);
+void        SENET_API   SECln_SetStreamCallback (client_t* cln, SEClnOnStream on_stream_proc);
 
 void        SENET_API   SECln_SetLimits (client_t* cln, const uint32 max_in_bandwidth, const uint32 max_out_bandwidth);
+void        SENET_API   SECln_SetMTU (client_t* cln, const uint32 mtu, const int probe);
+void        SENET_API   SECln_SetQueueLimits (client_t* cln, const size_t bytes, const size_t packets);
 void        SENET_API   SECln_SetReliability (client_t* cln, const int reliable);
 void        SENET_API   SECln_SetSendImmediatly (client_t* cln, const int send_immediatly);
+int         SENET_API   SECln_SetAggregation (client_t* cln, const size_t channel, const int aggregate);
 
 void        SENET_API   SECln_SetUserData (client_t* cln, void* user_data);
 void*       SENET_API   SECln_GetUserData (client_t* cln);
 
 int         SENET_API   SECln_Send (client_t* cln, const size_t channel, const uint8* data, const size_t data_len, const int alloc);
+int         SENET_API   SECln_SendState (client_t* cln, const size_t channel, const uint32 key, const uint8* data, const size_t data_len, const int alloc);
+int         SENET_API   SECln_SendStream (client_t* cln, const size_t channel, SEStreamPull pull_proc, void* user_data);
+int         SENET_API   SECln_SendPacket (client_t* cln, const size_t channel, packet_t* packet);
+packet_t*   SENET_API   SECln_RecvRetain (client_t* cln);
 
 void        SENET_API   SECln_Process (client_t* cln, const uint32 wait_time);
 
@@ -110,15 +188,20 @@ client2_t*  SENET_API   SECln2_Create (const size_t max_peers, const size_t chan
 void        SENET_API   SECln2_Destroy (client2_t* cln);
 
 peer_t*     SENET_API   SECln2_Connect (client2_t* cln, const char* host, const uint16 port, const uint32 connect_data);
+int         SENET_API   SECln2_ConnectAsync (client2_t* cln, const char* host, const uint16 port, const uint32 connect_data);
+int         SENET_API   SECln2_ConnectAny (client2_t* cln, const char* hosts[], const uint16 ports[], const size_t count, const uint32 stagger, const uint32 connect_data);
 void        SENET_API   SECln2_PeerDisconnect (client2_t* cln, peer_t* peer, const int force, const uint32 disconnect_data);
 void        SENET_API   SECln2_PeersDisconnectAll (client2_t* cln, const int force, const uint32 disconnect_data);
 int         SENET_API   SECln2_PeerIsConnected (client2_t* cln, peer_t* peer);
 
 void        SENET_API   SECln2_SetLimits (client2_t* cln, const uint32 max_in_bandwidth, const uint32 max_out_bandwidth);
+void        SENET_API   SECln2_SetMTU (client2_t* cln, const uint32 mtu, const int probe);
+void        SENET_API   SECln2_SetQueueLimits (client2_t* cln, const size_t bytes, const size_t packets);
 void        SENET_API   SECln2_SetReliability (client2_t* cln, const int reliable);
 void        SENET_API   SECln2_SetSendImmediatly (client2_t* cln, const int send_immediatly);
 
 void        SENET_API   SECln2_SetCallbacks (client2_t* cln, SECln2OnConnect on_connect_proc, SECln2OnDisconnect on_disconnect_proc, SECln2OnRecv on_recv_proc);
+void        SENET_API   SECln2_SetStreamCallback (client2_t* cln, SECln2OnStream on_stream_proc);
 
 void        SENET_API   SECln2_SetUserData (client2_t* cln, void* user_data);
 void*       SENET_API   SECln2_GetUserData (client2_t* cln);
@@ -134,6 +217,9 @@ void        SENET_API   SECln2_PeerSetUserData (client2_t* cln, peer_t* peer, vo
 void*       SENET_API   SECln2_PeerGetUserData (client2_t* cln, peer_t* peer);
 
 int         SENET_API   SECln2_Send (client2_t* cln, peer_t* peer, const size_t channel, const uint8* data, const size_t data_len, const int alloc);
+int         SENET_API   SECln2_SendState (client2_t* cln, peer_t* peer, const size_t channel, const uint32 key, const uint8* data, const size_t data_len, const int alloc);
+int         SENET_API   SECln2_SendStream (client2_t* cln, peer_t* peer, const size_t channel, SEStreamPull pull_proc, void* user_data);
+packet_t*   SENET_API   SECln2_RecvRetain (client2_t* cln);
 void        SENET_API   SECln2_Broadcast (client2_t* cln, const size_t channel, const uint8* data, const size_t data_len, const int alloc);
 
 void        SENET_API   SECln2_Process (client2_t* cln, const uint32 wait_time);
@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "enet/enet.h"
 #include "s_enet_internal.h"
@@ -18,12 +19,36 @@ struct client_t {
     int reliable;
     int send_immediatly;
 
+    SEClnOnConnect on_connect;
     SEClnOnRecv on_recv;
+    SEClnOnStream on_stream;
     SEClnOnDisconnect on_disconnect;
 
+    int connecting;
+    uint32 connect_timeout;
+    uint32 connect_time;
+    uint32 connect_data;
+
+    resolve_t* resolve;
+    int resolved;
+
     void* user_data;
+
+    ENetPacket* recv_packet;
+    const uint8* recv_data;
+    size_t recv_len;
+
+    uint32 aggregated[8];
+    peer_batches_t* batches;
+    batch_t* batches_pending;
 };
 
+static int  batches_send (client_t* cln, size_t channel, enet_uint32 flags, const uint8* data, size_t data_len);
+static void batches_reset (client_t* cln);
+static void host_resolve_start (client_t* cln);
+static int  host_resolve (client_t* cln);
+static void connect_failed (client_t* cln);
+
 
 /** \brief
  *
@@ -47,17 +72,18 @@ client_t*   SENET_API   SECln_Create (const char* host, const uint16 port, const
             return NULL;
         }
         strcpy(cln->host, host);
-        enet_address_set_host(&cln->e_addr, host);
-        enet_address_get_host_ip(&cln->e_addr, cln->host_ip, 16);
     } else {
         cln->host = NULL;
-        cln->host_ip[0] = '\0';
     }
 
+    cln->resolve = NULL;
+    host_resolve_start(cln);
+
     cln->e_addr.port = port;
 
     cln->e_host = enet_host_create(NULL, 1, channels, max_in_bandwidth, max_out_bandwidth);
     if (cln->e_host == NULL) {
+        if (cln->resolve != NULL) { resolver_release(cln->resolve); }
         free(cln->host);
         free(cln);
         return NULL;
@@ -68,11 +94,26 @@ client_t*   SENET_API   SECln_Create (const char* host, const uint16 port, const
     cln->reliable = 1;
     cln->send_immediatly = 0;
 
+    cln->on_connect = NULL;
     cln->on_recv = NULL;
+    cln->on_stream = NULL;
     cln->on_disconnect = NULL;
 
+    cln->connecting = 0;
+    cln->connect_timeout = 0;
+    cln->connect_time = 0;
+    cln->connect_data = 0;
+
     cln->user_data = NULL;
 
+    cln->recv_packet = NULL;
+    cln->recv_data = NULL;
+    cln->recv_len = 0;
+
+    memset(cln->aggregated, 0, sizeof(cln->aggregated));
+    cln->batches = NULL;
+    cln->batches_pending = NULL;
+
     return cln;
 }
 
@@ -89,6 +130,8 @@ void        SENET_API   SECln_Destroy (client_t* cln)
         enet_peer_reset(cln->e_peer);
     }
 
+    batches_reset(cln);
+    if (cln->resolve != NULL) { resolver_release(cln->resolve); }
     enet_host_destroy(cln->e_host);
     free(cln->host);
     free(cln);
@@ -104,12 +147,19 @@ void        SENET_API   SECln_Destroy (client_t* cln)
  */
 int         SENET_API   SECln_Connect (client_t* cln, const uint32 timeout, const uint32 connect_data)
 {
-    if (cln->e_peer != NULL) { return -1; }
+    if (cln->e_peer != NULL || cln->connecting != 0) { return -1; }
+
+    uint32 start = enet_time_get();
+    while (host_resolve(cln) == 0 && enet_time_get() - start < timeout) {
+        resolver_wait(cln->resolve, timeout - (enet_time_get() - start));
+    }
+    if (cln->resolved != 1) { return 0; }
 
     cln->e_peer = enet_host_connect(cln->e_host, &cln->e_addr, cln->e_host->channelLimit, connect_data);
     if (cln->e_peer == NULL) { return -1; }
 
-    if (enet_host_service(cln->e_host, &cln->e_event, timeout) > 0 && cln->e_event.type == ENET_EVENT_TYPE_CONNECT && cln->e_event.peer == cln->e_peer) {
+    uint32 elapsed = enet_time_get() - start;
+    if (enet_host_service(cln->e_host, &cln->e_event, elapsed < timeout ? timeout - elapsed : 0) > 0 && cln->e_event.type == ENET_EVENT_TYPE_CONNECT && cln->e_event.peer == cln->e_peer) {
         return 1;
     } else {
         enet_peer_reset(cln->e_peer);
@@ -118,6 +168,36 @@ int         SENET_API   SECln_Connect (client_t* cln, const uint32 timeout, cons
     }
 }
 
+/** \brief Start connecting to the server without waiting for the connection to complete
+ *
+ * The function returns at once, even if the host name is still being resolved. The result is reported
+ * from SECln_Process() through the connect callback (see SECln_SetConnectCallback()), and
+ * SECln_IsConnected() returns 0 until then
+ *
+ * \param cln[in] Client pointer
+ * \param timeout[in] Time (ms) after which the connection attempt fails, 0 to wait until ENet gives up
+ * \param connect_data[in] Data sent to the server with the connection request
+ * \return 1 if the connection attempt started, 0 on failure, -1 if already connected or connecting
+ *
+ */
+int         SENET_API   SECln_ConnectAsync (client_t* cln, const uint32 timeout, const uint32 connect_data)
+{
+    if (cln->e_peer != NULL || cln->connecting != 0) { return -1; }
+    if (host_resolve(cln) == -1) { return 0; }
+
+    if (cln->resolved == 1) {
+        cln->e_peer = enet_host_connect(cln->e_host, &cln->e_addr, cln->e_host->channelLimit, connect_data);
+        if (cln->e_peer == NULL) { return 0; }
+        enet_host_flush(cln->e_host);
+    }
+
+    cln->connecting = 1;
+    cln->connect_timeout = timeout;
+    cln->connect_time = enet_time_get();
+    cln->connect_data = connect_data;
+    return 1;
+}
+
 /** \brief
  *
  * \param
@@ -127,12 +207,18 @@ int         SENET_API   SECln_Connect (client_t* cln, const uint32 timeout, cons
  */
 void        SENET_API   SECln_Disconnect (client_t* cln, const int force, const uint32 disconnect_data)
 {
-    if (cln->e_peer == NULL) { return; }
+    if (cln->e_peer == NULL) {
+        cln->connecting = 0;
+        return;
+    }
 
-    if (force != 0) {
+    if (force != 0 || cln->connecting != 0) {
+        batches_reset(cln);
         enet_peer_reset(cln->e_peer);
         cln->e_peer = NULL;
+        cln->connecting = 0;
     } else {
+        batch_flush_all(&cln->batches_pending);
         if (cln->send_immediatly != 0) {
             enet_peer_disconnect(cln->e_peer, disconnect_data);
             enet_host_flush(cln->e_host);
@@ -151,7 +237,7 @@ void        SENET_API   SECln_Disconnect (client_t* cln, const int force, const
  */
 int         SENET_API   SECln_IsConnected (client_t* cln)
 {
-    if (cln->e_peer != NULL) { return 1; }
+    if (cln->e_peer != NULL && cln->connecting == 0) { return 1; }
     return 0;
 }
 
@@ -169,13 +255,11 @@ void        SENET_API   SECln_SetHost (client_t* cln, const char* host)
     if (host_len > 0) {
         cln->host = realloc(cln->host, (host_len + 1) * sizeof(char));
         strcpy(cln->host, host);
-        enet_address_set_host(&cln->e_addr, host);
-        enet_address_get_host_ip(&cln->e_addr, cln->host_ip, 16);
     } else {
         if (cln->host != NULL) { free(cln->host); }
         cln->host = NULL;
-        cln->host_ip[0] = '\0';
     }
+    host_resolve_start(cln);
 }
 
 /** \brief
@@ -211,6 +295,7 @@ char*       SENET_API   SECln_GetHost (client_t* cln)
  */
 char*       SENET_API   SECln_GetHostIP (client_t* cln)
 {
+    host_resolve(cln);
     return cln->host_ip;
 }
 
@@ -240,6 +325,31 @@ void        SENET_API   SECln_SetCallbacks (client_t* cln, SEClnOnRecv on_recv_p
     cln->on_disconnect = on_disconnect_proc;
 }
 
+/** \brief Set the function called when a connection started with SECln_ConnectAsync() succeeds or fails
+ *
+ * \param cln[in] Client pointer
+ * \param on_connect_proc[in] Connect callback, called with connected = 1 on success, 0 on failure
+ *
+ */
+void        SENET_API   SECln_SetConnectCallback (client_t* cln, SEClnOnConnect on_connect_proc)
+{
+    cln->on_connect = on_connect_proc;
+}
+
+/** \brief Set the function receiving the streams sent by the server (see SECln_SendStream())
+ *
+ * The chunks of a stream are received in order, and the end of the stream as an empty chunk.
+ * Without stream callback, the chunks are received by the receive callback like any data
+ *
+ * \param cln[in] Client pointer
+ * \param on_stream_proc[in] Function called for each chunk of a stream, or 0
+ *
+ */
+void        SENET_API   SECln_SetStreamCallback (client_t* cln, SEClnOnStream on_stream_proc)
+{
+    cln->on_stream = on_stream_proc;
+}
+
 
 /** \brief
  *
@@ -253,6 +363,35 @@ void        SENET_API   SECln_SetLimits (client_t* cln, const uint32 max_in_band
     enet_host_bandwidth_limit(cln->e_host, max_in_bandwidth, max_out_bandwidth);
 }
 
+/** \brief Set the largest datagram size used with the server (1400 by default), for the next connections
+ *
+ * A connection uses the smallest MTU of the client and the server. With probing, it starts at 1400 and
+ * probes the network for the largest datagram size that gets through, up to that MTU (the server must support it)
+ *
+ * \param cln[in] Client pointer
+ * \param mtu[in] MTU (576 to 9000, e.g. 9000 on a jumbo frames network)
+ * \param probe[in] 1 to probe the path MTU, 0 to use the MTU as is
+ *
+ */
+void        SENET_API   SECln_SetMTU (client_t* cln, const uint32 mtu, const int probe)
+{
+    enet_host_mtu(cln->e_host, mtu, probe);
+}
+
+/** \brief Limit the data queued for sending to the server (no limit by default)
+ *
+ * Once a limit would be exceeded, the send functions return -2 instead of queuing the data (see SESrv_SetQueueLimits())
+ *
+ * \param cln[in] Client pointer
+ * \param bytes[in] Maximum bytes queued, 0 for no limit
+ * \param packets[in] Maximum packets queued (large messages count once per fragment being sent), 0 for no limit
+ *
+ */
+void        SENET_API   SECln_SetQueueLimits (client_t* cln, const size_t bytes, const size_t packets)
+{
+    enet_host_queue_limit(cln->e_host, bytes, packets);
+}
+
 /** \brief
  *
  * \param
@@ -277,6 +416,30 @@ void        SENET_API   SECln_SetSendImmediatly (client_t* cln, const int send_i
     cln->send_immediatly = send_immediatly;
 }
 
+/** \brief Set whether small messages sent on a channel are aggregated (deactivated by default)
+ *
+ * Messages sent on an aggregated channel with SECln_Send() are packed into one packet, sent when
+ * SECln_Process() is called. See SESrv_SetAggregation(), the server must aggregate the same channels
+ *
+ * \param cln[in] Client pointer
+ * \param channel[in] Channel N°
+ * \param aggregate[in] 1 to activate, 0 to deactivate
+ * \return 1 on success, -1 if channel is greater than 254
+ *
+ */
+int         SENET_API   SECln_SetAggregation (client_t* cln, const size_t channel, const int aggregate)
+{
+    if (channel >= ENET_PROTOCOL_MAXIMUM_CHANNEL_COUNT) { return -1; }
+
+    if (aggregate != 0) {
+        cln->aggregated[channel / 32] |= 1u << (channel % 32);
+    } else {
+        batch_flush_all(&cln->batches_pending);
+        cln->aggregated[channel / 32] &= ~(1u << (channel % 32));
+    }
+    return 1;
+}
+
 
 /** \brief
  *
@@ -324,21 +487,211 @@ int         SENET_API   SECln_Send (client_t* cln, const size_t channel, const u
         flags += ENET_PACKET_FLAG_NO_ALLOCATE;
     }
 
+    if (AGGREGATED(cln->aggregated, channel)) {
+        return batches_send(cln, channel, flags, data, data_len);
+    }
+
     ENetPacket* packet = enet_packet_create(data, data_len, flags);
     if (packet == NULL) {
         return -1;
     }
 
     int ret = enet_peer_send(cln->e_peer, channel, packet);
+    if (ret != 0 && packet->referenceCount == 0) {
+        enet_packet_destroy(packet);
+    }
+
+    if (cln->send_immediatly) {
+        enet_host_flush(cln->e_host);
+    }
+
+    if (ret == 0) { return 1; }
+    if (ret == -2) { return -2; }
+    return 0;
+}
+
+/** \brief Send state data to the server, replacing any data queued with the same key that was not sent yet
+ *
+ * \param cln[in] Client pointer
+ * \param channel[in] Channel N°
+ * \param key[in] Non-zero key identifying the state
+ * \param data[in] Data to be sent
+ * \param data_len[in] Data size
+ * \param alloc[in] 1 to copy the data, 0 to send it from the user's buffer
+ * \return 1 on succes, 0 on failure, -1 if not connected, -2 if the queue is full (see SECln_SetQueueLimits())
+ *
+ */
+int         SENET_API   SECln_SendState (client_t* cln, const size_t channel, const uint32 key, const uint8* data, const size_t data_len, const int alloc)
+{
+    if (cln->e_peer == NULL) {
+        return -1;
+    }
+    if (AGGREGATED(cln->aggregated, channel)) {
+        return 0;
+    }
+
+    unsigned int flags = 0;
+    if (cln->reliable != 0) {
+        flags += ENET_PACKET_FLAG_RELIABLE;
+    }
+    if (alloc == 0) {
+        flags += ENET_PACKET_FLAG_NO_ALLOCATE;
+    }
+
+    ENetPacket* packet = enet_packet_create(data, data_len, flags);
+    if (packet == NULL) {
+        return -1;
+    }
+
+    int ret = enet_peer_send_coalesced(cln->e_peer, channel, packet, key);
+    if (ret != 0 && packet->referenceCount == 0) {
+        enet_packet_destroy(packet);
+    }
 
     if (cln->send_immediatly) {
         enet_host_flush(cln->e_host);
     }
 
     if (ret == 0) { return 1; }
+    if (ret == -2) { return -2; }
     return 0;
 }
 
+/** \brief Send a stream of data to the server, pulling it in chunks as the server receives the previous ones (see SESrv_SendStream())
+ *
+ * \param cln[in] Client pointer
+ * \param channel[in] Channel N°
+ * \param pull_proc[in] Function supplying the data of the stream
+ * \param user_data[in] User data passed to pull_proc
+ *
+ * \return 1 on succes, 0 on failure, -1 if the client isn't connected
+ *
+ */
+int         SENET_API   SECln_SendStream (client_t* cln, const size_t channel, SEStreamPull pull_proc, void* user_data)
+{
+    if (cln->e_peer == NULL) {
+        return -1;
+    }
+
+    return stream_send(cln->e_peer, channel, pull_proc, user_data);
+}
+
+/** \brief Send a packet created with SE_PacketCreate() to the server
+ *
+ * \param cln[in] Client pointer
+ * \param channel[in] Channel N°
+ * \param packet[in] Packet pointer
+ * \return 1 on succes, 0 on failure, -1 if not connected, -2 if the queue is full (see SECln_SetQueueLimits())
+ *
+ */
+int         SENET_API   SECln_SendPacket (client_t* cln, const size_t channel, packet_t* packet)
+{
+    if (cln->e_peer == NULL) {
+        return -1;
+    }
+
+    int ret = SE_PacketSendTo(packet, (peer_t*)cln->e_peer, channel);
+
+    if (cln->send_immediatly) {
+        enet_host_flush(cln->e_host);
+    }
+
+    return ret;
+}
+
+/** \brief Keep the data being received alive after the receive callback returns
+ *
+ * Must be called from the receive callback. The data pointer passed to the callback then stays valid
+ * until the returned packet is released with SE_PacketRelease(). Data received on an aggregated channel
+ * (see SECln_SetAggregation()) is copied into a new packet, use SE_PacketGetData() to access it
+ *
+ * \param cln[in] Client pointer
+ * \return Packet pointer, or 0 if failure or if called outside of the receive callback
+ *
+ */
+packet_t*   SENET_API   SECln_RecvRetain (client_t* cln)
+{
+    if (cln->recv_packet != NULL) {
+        cln->recv_packet->referenceCount++;
+        return (packet_t*)cln->recv_packet;
+    }
+    if (cln->recv_data != NULL) {
+        return SE_PacketCreate(cln->recv_data, cln->recv_len, 0, 1);
+    }
+    return NULL;
+}
+
+static int batches_send (client_t* cln, size_t channel, enet_uint32 flags, const uint8* data, size_t data_len)
+{
+    if (cln->e_peer->state != ENET_PEER_STATE_CONNECTED) { return 0; }
+
+    if (cln->batches == NULL) {
+        cln->batches = peer_batches_create(cln->e_peer);
+        if (cln->batches == NULL) { return 0; }
+    }
+
+    batch_t* batch = peer_batches_get(cln->batches, channel);
+    if (batch == NULL) { return 0; }
+
+    int ret = batch_append(batch, &cln->batches_pending, cln->e_peer, channel, flags, data, data_len);
+    if (ret != 1) {
+        return ret;
+    }
+
+    if (cln->send_immediatly) {
+        batch_flush_all(&cln->batches_pending);
+        enet_host_flush(cln->e_host);
+    }
+    return 1;
+}
+
+static void host_resolve_start (client_t* cln)
+{
+    if (cln->resolve != NULL) { resolver_release(cln->resolve); }
+
+    cln->host_ip[0] = '\0';
+    cln->resolve = cln->host != NULL ? resolver_request(cln->host) : NULL;
+    cln->resolved = cln->resolve != NULL ? 0 : -1;
+    host_resolve(cln);
+}
+
+/* Returns 1 if the host name is resolved, 0 if it is being resolved, -1 on failure */
+static int host_resolve (client_t* cln)
+{
+    if (cln->resolve == NULL) { return cln->resolved; }
+
+    cln->resolved = resolver_poll(cln->resolve, &cln->e_addr.host);
+    if (cln->resolved != 0) {
+        resolver_release(cln->resolve);
+        cln->resolve = NULL;
+        if (cln->resolved == 1) {
+            enet_address_get_host_ip(&cln->e_addr, cln->host_ip, 16);
+        }
+    }
+    return cln->resolved;
+}
+
+static void connect_failed (client_t* cln)
+{
+    if (cln->e_peer != NULL) {
+        enet_peer_reset(cln->e_peer);
+        cln->e_peer = NULL;
+    }
+    cln->connecting = 0;
+    if (cln->on_connect != NULL) {
+        cln->on_connect(cln, 0);
+    }
+}
+
+/* Free the batches of the connection, dropping their messages */
+static void batches_reset (client_t* cln)
+{
+    if (cln->batches == NULL) { return; }
+
+    peer_batches_destroy(cln->batches, &cln->batches_pending);
+    cln->batches = NULL;
+}
+
 
 /** \brief
  *
@@ -349,29 +702,95 @@ int         SENET_API   SECln_Send (client_t* cln, const size_t channel, const u
  */
 void        SENET_API   SECln_Process (client_t* cln, const uint32 wait_time)
 {
-    if (cln->e_peer == NULL) { DELAY(wait_time); return; }
+    uint32 start = enet_time_get();
+
+    /* the completion of a pending resolution ends the wait, as a network event does */
+    if (cln->connecting != 0 && cln->e_peer == NULL && cln->resolve != NULL) {
+        resolver_wait(cln->resolve, wait_time);
+    }
+
+    if (cln->connecting != 0 && cln->e_peer == NULL && host_resolve(cln) != 0) {
+        if (cln->resolved == 1) {
+            cln->e_peer = enet_host_connect(cln->e_host, &cln->e_addr, cln->e_host->channelLimit, cln->connect_data);
+        }
+        if (cln->e_peer == NULL) {
+            connect_failed(cln);
+            return;
+        }
+    }
+
+    if (cln->connecting != 0 && cln->connect_timeout != 0 && enet_time_get() - cln->connect_time >= cln->connect_timeout) {
+        connect_failed(cln);
+        return;
+    }
 
-    if (enet_host_service(cln->e_host, &cln->e_event, wait_time) > 0) {
+    uint32 elapsed = enet_time_get() - start;
+    uint32 remaining = elapsed < wait_time ? wait_time - elapsed : 0;
+
+    if (cln->e_peer == NULL) {
+        if (cln->resolve == NULL) { DELAY(remaining); }
+        return;
+    }
+
+    batch_flush_all(&cln->batches_pending);
+
+    if (enet_host_service(cln->e_host, &cln->e_event, remaining) > 0) {
         switch (cln->e_event.type) {
             case ENET_EVENT_TYPE_RECEIVE:
                 #ifdef SENET_DEBUG
                 debug("ENET_EVENT_TYPE_RECEIVE\n");
                 #endif
-                if (cln->on_recv != NULL) {
+                if (cln->on_stream != NULL && (cln->e_event.packet->flags & ENET_PACKET_FLAG_STREAM)) {
+                    cln->recv_packet = cln->e_event.packet;
+                    cln->on_stream(cln, cln->e_event.channelID, cln->e_event.packet->data, cln->e_event.packet->dataLength);
+                    cln->recv_packet = NULL;
+                } else if (cln->on_recv != NULL && AGGREGATED(cln->aggregated, cln->e_event.channelID) && !(cln->e_event.packet->flags & ENET_PACKET_FLAG_STREAM)) {
+                    const uint8* data = cln->e_event.packet->data;
+                    size_t data_len = cln->e_event.packet->dataLength;
+
+                    while (batch_next(&data, &data_len, &cln->recv_data, &cln->recv_len) != 0) {
+                        cln->on_recv(cln, cln->e_event.channelID, (uint8*)cln->recv_data, cln->recv_len);
+                    }
+                    cln->recv_data = NULL;
+                } else if (cln->on_recv != NULL) {
+                    cln->recv_packet = cln->e_event.packet;
                     cln->on_recv(cln, cln->e_event.channelID, cln->e_event.packet->data, cln->e_event.packet->dataLength);
+                    cln->recv_packet = NULL;
+                }
+                if (cln->e_event.packet->referenceCount == 0) {
+                    enet_packet_destroy(cln->e_event.packet);
                 }
-                enet_packet_destroy(cln->e_event.packet);
             break;
             case ENET_EVENT_TYPE_DISCONNECT:
                 #ifdef SENET_DEBUG
                 debug("ENET_EVENT_TYPE_DISCONNECT\n");
                 #endif
+                if (cln->connecting != 0) {
+                    cln->connecting = 0;
+                    cln->e_peer = NULL;
+                    if (cln->on_connect != NULL) {
+                        cln->on_connect(cln, 0);
+                    }
+                    break;
+                }
                 if (cln->on_disconnect != NULL) {
                     cln->on_disconnect(cln, cln->e_event.data);
                 }
+                batches_reset(cln);
                 cln->e_peer = NULL;
             break;
             case ENET_EVENT_TYPE_CONNECT:
+                #ifdef SENET_DEBUG
+                debug("ENET_EVENT_TYPE_CONNECT\n");
+                #endif
+                if (cln->connecting != 0) {
+                    cln->connecting = 0;
+                    if (cln->on_connect != NULL) {
+                        cln->on_connect(cln, 1);
+                    }
+                }
+            break;
+            case ENET_EVENT_TYPE_WRITABLE:
             case ENET_EVENT_TYPE_NONE:
             break;
         }
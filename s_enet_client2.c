@@ -5,6 +5,24 @@
 #include "s_enet_internal.h"
 #include "s_enet.h"
 
+typedef struct {
+    resolve_t* resolve;
+    ENetAddress addr;
+    ENetPeer* peer;
+    int state; /* 0 resolving (resolve != NULL) or waiting to start, 1 connecting, -1 failed */
+} endpoint_t;
+
+typedef struct connect_any_t connect_any_t;
+struct connect_any_t {
+    endpoint_t* endpoints;
+    size_t count, active;
+
+    uint32 stagger, last_start, connect_data;
+
+    connect_any_t* prev;
+    connect_any_t* next_set;
+};
+
 struct client2_t {
     ENetHost* e_host;
     ENetEvent e_event;
@@ -18,11 +36,20 @@ struct client2_t {
 
     SECln2OnConnect on_connect;
     SECln2OnRecv on_recv;
+    SECln2OnStream on_stream;
     SECln2OnDisconnect on_disconnect;
 
     void* user_data;
+
+    ENetPacket* recv_packet;
+
+    connect_any_t* connect_sets;
 };
 
+static void connect_any_update (client2_t* cln);
+static connect_any_t* connect_any_find (client2_t* cln, ENetPeer* peer, endpoint_t** endpoint);
+static void connect_any_free (client2_t* cln, connect_any_t* set);
+
 
 client2_t*  SENET_API   SECln2_Create (const size_t max_peers, const size_t channels, const uint32 max_in_bandwidth, const uint32 max_out_bandwidth)
 {
@@ -31,7 +58,7 @@ client2_t*  SENET_API   SECln2_Create (const size_t max_peers, const size_t chan
         return NULL;
     }
 
-    cln->e_host = enet_host_create(NULL, max_peers, channels, max_in_bandwidth, max_out_bandwidth);
+    cln->e_host = enet_host_create_ex(NULL, max_peers, channels, max_in_bandwidth, max_out_bandwidth, ENET_HOST_FLAG_LAZY_PEERS);
     if (cln->e_host == NULL) {
         free(cln);
         return NULL;
@@ -44,15 +71,21 @@ client2_t*  SENET_API   SECln2_Create (const size_t max_peers, const size_t chan
 
     cln->on_connect = NULL;
     cln->on_recv = NULL;
+    cln->on_stream = NULL;
     cln->on_disconnect = NULL;
 
     cln->user_data = NULL;
 
+    cln->recv_packet = NULL;
+
+    cln->connect_sets = NULL;
+
     return cln;
 }
 
 void        SENET_API   SECln2_Destroy (client2_t* cln)
 {
+    while (cln->connect_sets != NULL) { connect_any_free(cln, cln->connect_sets); }
     enet_host_destroy(cln->e_host);
     free(cln);
 }
@@ -61,13 +94,85 @@ void        SENET_API   SECln2_Destroy (client2_t* cln)
 peer_t*     SENET_API   SECln2_Connect (client2_t* cln, const char* host, const uint16 port, const uint32 connect_data)
 {
     ENetAddress addr;
-    enet_address_set_host(&addr, host);
+    if (resolver_resolve(host, &addr.host) == 0) { return NULL; }
     addr.port = port;
 
     ENetPeer* peer = enet_host_connect(cln->e_host, &addr, cln->e_host->channelLimit, connect_data);
     return (peer_t*)peer;
 }
 
+/** \brief Connect to a host without blocking, even if its name has to be resolved
+ *
+ * Unlike SECln2_Connect(), which waits for the name to be resolved unless it is cached, the function returns
+ * at once. The peer is reported to the connect callback once connected; if the name can't be resolved or the
+ * host can't be reached, the disconnect callback is called with peer = 0
+ *
+ * \param cln[in] Client pointer
+ * \param host[in] Host name or IP
+ * \param port[in] Port
+ * \param connect_data[in] Data sent with the connection request
+ *
+ * \return 1 on success, 0 on failure
+ *
+ */
+int         SENET_API   SECln2_ConnectAsync (client2_t* cln, const char* host, const uint16 port, const uint32 connect_data)
+{
+    return SECln2_ConnectAny(cln, &host, &port, 1, 0, connect_data);
+}
+
+/** \brief Connect to the first reachable endpoint of a list (replicas of a service)
+ *
+ * Handshakes are started in the order of the list as the host names get resolved, the next one when the
+ * previous ones didn't complete after stagger ms, or at once when they all failed. An endpoint whose name
+ * is still being resolved doesn't hold back the next ones. The first peer to connect is reported to the connect
+ * callback and the other attempts are cancelled. If no endpoint can be reached, the disconnect callback
+ * is called with peer = 0. Host names are resolved in the background, the function doesn't block
+ *
+ * \param cln[in] Client pointer
+ * \param hosts[in] Array of host names or IPs
+ * \param ports[in] Array of ports
+ * \param count[in] Number of endpoints
+ * \param stagger[in] Delay (ms) before starting the next handshake
+ * \param connect_data[in] Data sent with the connection requests
+ *
+ * \return 1 on success, 0 on failure, -1 if count == 0
+ *
+ */
+int         SENET_API   SECln2_ConnectAny (client2_t* cln, const char* hosts[], const uint16 ports[], const size_t count, const uint32 stagger, const uint32 connect_data)
+{
+    if (count == 0) { return -1; }
+
+    connect_any_t* set = malloc(sizeof(connect_any_t));
+    if (set == NULL) { return 0; }
+
+    set->endpoints = malloc(count * sizeof(endpoint_t));
+    if (set->endpoints == NULL) {
+        free(set);
+        return 0;
+    }
+
+    size_t i;
+    for (i = 0; i < count; i++) {
+        set->endpoints[i].resolve = resolver_request(hosts[i]);
+        set->endpoints[i].addr.port = ports[i];
+        set->endpoints[i].peer = NULL;
+        set->endpoints[i].state = (set->endpoints[i].resolve != NULL) ? 0 : -1;
+    }
+    set->count = count;
+    set->active = 0;
+    set->stagger = stagger;
+    set->last_start = 0;
+    set->connect_data = connect_data;
+
+    set->prev = NULL;
+    set->next_set = cln->connect_sets;
+    if (cln->connect_sets != NULL) { cln->connect_sets->prev = set; }
+    cln->connect_sets = set;
+
+    connect_any_update(cln);
+    return 1;
+}
+
 void        SENET_API   SECln2_PeerDisconnect (client2_t* cln, peer_t* peer, const int force, const uint32 disconnect_data)
 {
     if (force != 0) {
@@ -84,6 +189,8 @@ void        SENET_API   SECln2_PeerDisconnect (client2_t* cln, peer_t* peer, con
 
 void        SENET_API   SECln2_PeersDisconnectAll (client2_t* cln, const int force, const uint32 disconnect_data)
 {
+    while (cln->connect_sets != NULL) { connect_any_free(cln, cln->connect_sets); }
+
     int i = 0;
     if (force != 0) {
         for (i = 0; i < cln->e_host->peerCount; i++) {
@@ -115,6 +222,35 @@ void        SENET_API   SECln2_SetLimits (client2_t* cln, const uint32 max_in_ba
     enet_host_bandwidth_limit(cln->e_host, max_in_bandwidth, max_out_bandwidth);
 }
 
+/** \brief Set the largest datagram size used with the servers (1400 by default), for the next connections
+ *
+ * A connection uses the smallest MTU of the client and the server. With probing, it starts at 1400 and
+ * probes the network for the largest datagram size that gets through, up to that MTU (the server must support it)
+ *
+ * \param cln[in] Client pointer
+ * \param mtu[in] MTU (576 to 9000, e.g. 9000 on a jumbo frames network)
+ * \param probe[in] 1 to probe the path MTU of each connection, 0 to use the MTU as is
+ *
+ */
+void        SENET_API   SECln2_SetMTU (client2_t* cln, const uint32 mtu, const int probe)
+{
+    enet_host_mtu(cln->e_host, mtu, probe);
+}
+
+/** \brief Limit the data queued for sending to all the peers together (no limit by default)
+ *
+ * Once a limit would be exceeded, the send functions return -2 instead of queuing the data (see SESrv_SetQueueLimits())
+ *
+ * \param cln[in] Client pointer
+ * \param bytes[in] Maximum bytes queued, 0 for no limit
+ * \param packets[in] Maximum packets queued (large messages count once per fragment being sent), 0 for no limit
+ *
+ */
+void        SENET_API   SECln2_SetQueueLimits (client2_t* cln, const size_t bytes, const size_t packets)
+{
+    enet_host_queue_limit(cln->e_host, bytes, packets);
+}
+
 void        SENET_API   SECln2_SetReliability (client2_t* cln, const int reliable)
 {
     cln->reliable = reliable;
@@ -133,6 +269,17 @@ void        SENET_API   SECln2_SetCallbacks (client2_t* cln, SECln2OnConnect on_
     cln->on_disconnect = on_disconnect_proc;
 }
 
+/** \brief Set the function receiving the streams sent by peers (see SECln2_SendStream())
+ *
+ * \param cln[in] Client pointer
+ * \param on_stream_proc[in] Function called for each chunk of a stream, the end of a stream being an empty chunk, or 0 to receive the chunks with the receive callback
+ *
+ */
+void        SENET_API   SECln2_SetStreamCallback (client2_t* cln, SECln2OnStream on_stream_proc)
+{
+    cln->on_stream = on_stream_proc;
+}
+
 
 void        SENET_API   SECln2_SetUserData (client2_t* cln, void* user_data)
 {
@@ -159,7 +306,7 @@ size_t      SENET_API   SECln2_PeersGetAll (client2_t* cln, peer_t* peers[], siz
     int i = 0, added = 0;
 
     do {
-        if (cln->e_host->peers[i].state == ENET_PEER_STATE_CONNECTED) {
+        if (cln->e_host->peerStates[i] == ENET_PEER_STATE_CONNECTED) {
             peers[added] = (peer_t*)&cln->e_host->peers[i];
             added++;
         }
@@ -176,7 +323,7 @@ void        SENET_API   SECln2_PeersIterate (client2_t* cln, SECln2IterateProc p
 
     int i = 0;
     for (i = 0; i < cln->e_host->peerCount; i++) {
-        if (cln->e_host->peers[i].state == ENET_PEER_STATE_CONNECTED) {
+        if (cln->e_host->peerStates[i] == ENET_PEER_STATE_CONNECTED) {
             proc(cln, (peer_t*)&cln->e_host->peers[i], user_data);
         }
     }
@@ -211,6 +358,8 @@ void*       SENET_API   SECln2_PeerGetUserData (client2_t* cln, peer_t* peer)
 
 int         SENET_API   SECln2_Send (client2_t* cln, peer_t* peer, const size_t channel, const uint8* data, const size_t data_len, const int alloc)
 {
+    if (peer == NULL) { return -1; }
+
     unsigned int flags = 0;
     if (cln->reliable != 0) {
         flags += ENET_PACKET_FLAG_RELIABLE;
@@ -225,15 +374,90 @@ int         SENET_API   SECln2_Send (client2_t* cln, peer_t* peer, const size_t
     }
 
     int ret = enet_peer_send((ENetPeer*)peer, channel, packet);
+    if (ret != 0 && packet->referenceCount == 0) {
+        enet_packet_destroy(packet);
+    }
 
     if (cln->send_immediatly != 0) {
         enet_host_flush(cln->e_host);
     }
 
     if (ret == 0) { return 1; }
+    if (ret == -2) { return -2; }
     return 0;
 }
 
+/** \brief Send a stream of data to a peer, pulling it in chunks as the peer receives the previous ones (see SESrv_SendStream())
+ *
+ * \param cln[in] Client pointer
+ * \param peer[in] Peer pointer
+ * \param channel[in] Channel N°
+ * \param pull_proc[in] Function supplying the data of the stream
+ * \param user_data[in] User data passed to pull_proc
+ *
+ * \return 1 on succes, 0 on failure, -1 if peer == NULL
+ *
+ */
+int         SENET_API   SECln2_SendStream (client2_t* cln, peer_t* peer, const size_t channel, SEStreamPull pull_proc, void* user_data)
+{
+    if (peer == NULL) { return -1; }
+
+    return stream_send((ENetPeer*)peer, channel, pull_proc, user_data);
+}
+
+/** \brief Send state data to a peer, replacing any data queued with the same key that was not sent yet (see SESrv_SendState())
+ *
+ * \param cln[in] Client pointer
+ * \param peer[in] Peer pointer
+ * \param channel[in] Channel N°
+ * \param key[in] Non-zero key identifying the state
+ * \param data[in] Data to be sent
+ * \param data_len[in] Data size
+ * \param alloc[in] 1 to copy the data, 0 to send it from the user's buffer
+ * \return 1 on succes, 0 on failure, -1 if peer == NULL or the packet couldn't be created, -2 if the queue is full (see SECln2_SetQueueLimits())
+ *
+ */
+int         SENET_API   SECln2_SendState (client2_t* cln, peer_t* peer, const size_t channel, const uint32 key, const uint8* data, const size_t data_len, const int alloc)
+{
+    if (peer == NULL) { return -1; }
+
+    unsigned int flags = 0;
+    if (cln->reliable != 0) {
+        flags += ENET_PACKET_FLAG_RELIABLE;
+    }
+    if (alloc == 0) {
+        flags += ENET_PACKET_FLAG_NO_ALLOCATE;
+    }
+
+    ENetPacket* packet = enet_packet_create(data, data_len, flags);
+    if (packet == NULL) {
+        return -1;
+    }
+
+    int ret = enet_peer_send_coalesced((ENetPeer*)peer, channel, packet, key);
+    if (ret != 0 && packet->referenceCount == 0) {
+        enet_packet_destroy(packet);
+    }
+
+    if (cln->send_immediatly != 0) {
+        enet_host_flush(cln->e_host);
+    }
+
+    if (ret == 0) { return 1; }
+    if (ret == -2) { return -2; }
+    return 0;
+}
+
+packet_t*   SENET_API   SECln2_RecvRetain (client2_t* cln)
+{
+    if (cln->recv_packet == NULL) {
+        return NULL;
+    }
+
+    cln->recv_packet->referenceCount++;
+    return (packet_t*)cln->recv_packet;
+}
+
 void        SENET_API   SECln2_Broadcast (client2_t* cln, const size_t channel, const uint8* data, const size_t data_len, const int alloc)
 {
     //if (cln->peers == 0) { return; }
@@ -260,23 +484,132 @@ void        SENET_API   SECln2_Broadcast (client2_t* cln, const size_t channel,
 }
 
 
+static void connect_any_update (client2_t* cln)
+{
+    size_t failed = 0;
+    connect_any_t* set = cln->connect_sets;
+    while (set != NULL) {
+        connect_any_t* next_set = set->next_set;
+        size_t waiting = 0;
+        size_t i;
+
+        for (i = 0; i < set->count; i++) {
+            endpoint_t* endpoint = &set->endpoints[i];
+            if (endpoint->state != 0) { continue; }
+
+            if (endpoint->resolve != NULL) {
+                int resolved = resolver_poll(endpoint->resolve, &endpoint->addr.host);
+                if (resolved == 0) {
+                    waiting++;
+                    continue;
+                }
+
+                resolver_release(endpoint->resolve);
+                endpoint->resolve = NULL;
+                if (resolved != 1) {
+                    endpoint->state = -1;
+                    continue;
+                }
+            }
+
+            if (set->active != 0 && enet_time_get() - set->last_start < set->stagger) {
+                waiting++;
+                continue;
+            }
+
+            endpoint->peer = enet_host_connect(cln->e_host, &endpoint->addr, cln->e_host->channelLimit, set->connect_data);
+            if (endpoint->peer == NULL) {
+                endpoint->state = -1;
+                continue;
+            }
+            endpoint->state = 1;
+            set->active++;
+            set->last_start = enet_time_get();
+            enet_host_flush(cln->e_host);
+        }
+
+        if (waiting == 0 && set->active == 0) {
+            connect_any_free(cln, set);
+            failed++;
+        }
+        set = next_set;
+    }
+
+    /* reported once the list is walked, the callback may add or free sets */
+    for (; failed > 0; failed--) {
+        if (cln->on_disconnect != NULL) {
+            cln->on_disconnect(cln, NULL, 0);
+        }
+    }
+}
+
+static connect_any_t* connect_any_find (client2_t* cln, ENetPeer* peer, endpoint_t** endpoint)
+{
+    connect_any_t* set = cln->connect_sets;
+    while (set != NULL) {
+        size_t i;
+        for (i = 0; i < set->count; i++) {
+            if (set->endpoints[i].state == 1 && set->endpoints[i].peer == peer) {
+                *endpoint = &set->endpoints[i];
+                return set;
+            }
+        }
+        set = set->next_set;
+    }
+    return NULL;
+}
+
+static void connect_any_free (client2_t* cln, connect_any_t* set)
+{
+    size_t i;
+    for (i = 0; i < set->count; i++) {
+        if (set->endpoints[i].resolve != NULL) { resolver_release(set->endpoints[i].resolve); }
+    }
+
+    if (set->prev != NULL) { set->prev->next_set = set->next_set; } else { cln->connect_sets = set->next_set; }
+    if (set->next_set != NULL) { set->next_set->prev = set->prev; }
+
+    free(set->endpoints);
+    free(set);
+}
+
 void        SENET_API   SECln2_Process (client2_t* cln, const uint32 wait_time)
 {
+    if (cln->connect_sets != NULL) { connect_any_update(cln); }
+
+    connect_any_t* set;
+    endpoint_t* endpoint;
+
     if (enet_host_service(cln->e_host, &cln->e_event, wait_time) > 0) {
         switch (cln->e_event.type) {
             case ENET_EVENT_TYPE_RECEIVE:
                 #ifdef SENET_DEBUG
                 debug("ENET_EVENT_TYPE_RECEIVE\n");
                 #endif
-                if (cln->on_recv != NULL) {
+                if (cln->on_stream != NULL && (cln->e_event.packet->flags & ENET_PACKET_FLAG_STREAM)) {
+                    cln->recv_packet = cln->e_event.packet;
+                    cln->on_stream(cln, (peer_t*)cln->e_event.peer, cln->e_event.channelID, cln->e_event.packet->data, cln->e_event.packet->dataLength);
+                    cln->recv_packet = NULL;
+                } else if (cln->on_recv != NULL) {
+                    cln->recv_packet = cln->e_event.packet;
                     cln->on_recv(cln, (peer_t*)cln->e_event.peer, cln->e_event.channelID, cln->e_event.packet->data, cln->e_event.packet->dataLength);
+                    cln->recv_packet = NULL;
+                }
+                if (cln->e_event.packet->referenceCount == 0) {
+                    enet_packet_destroy(cln->e_event.packet);
                 }
-                enet_packet_destroy(cln->e_event.packet);
             break;
             case ENET_EVENT_TYPE_DISCONNECT:
                 #ifdef SENET_DEBUG
                 debug("ENET_EVENT_TYPE_DISCONNECT\n");
                 #endif
+                set = connect_any_find(cln, cln->e_event.peer, &endpoint);
+                if (set != NULL) {
+                    endpoint->state = -1;
+                    set->active--;
+                    enet_peer_reset(cln->e_event.peer);
+                    break;
+                }
                 if (cln->on_disconnect != NULL) {
                     cln->on_disconnect(cln, (peer_t*)cln->e_event.peer, cln->e_event.data);
                 }
@@ -288,10 +621,21 @@ void        SENET_API   SECln2_Process (client2_t* cln, const uint32 wait_time)
                 debug("ENET_EVENT_TYPE_CONNECT\n");
                 #endif
                 //cln->peers++;
+                set = connect_any_find(cln, cln->e_event.peer, &endpoint);
+                if (set != NULL) {
+                    size_t i;
+                    for (i = 0; i < set->count; i++) {
+                        if (set->endpoints[i].state == 1 && &set->endpoints[i] != endpoint) {
+                            enet_peer_disconnect_now(set->endpoints[i].peer, 0);
+                        }
+                    }
+                    connect_any_free(cln, set);
+                }
                 if (cln->on_connect != NULL) {
                     cln->on_connect(cln, (peer_t*)cln->e_event.peer, cln->e_event.data);
                 }
             break;
+            case ENET_EVENT_TYPE_WRITABLE:
             case ENET_EVENT_TYPE_NONE:
             break;
         }
@@ -9,9 +9,62 @@
     #define DELAY(ms) usleep(ms * 1000)
 #endif
 
+#include "s_enet.h"
+
 #define DEFAULT_PROCESS_TIME 100
 //#define SENET_DEBUG
 
+/* Message aggregation: small messages sent on an aggregated channel are framed with their length
+   and packed into one ENet packet per peer and channel, flushed on the next process call */
+#define AGGREGATED(mask, channel) ((mask)[(channel) / 32] & (1u << ((channel) % 32)))
+
+typedef struct batch_t batch_t;
+struct batch_t {
+    ENetPeer* peer;
+    enet_uint8 channel;
+    ENetPacket* packet;
+    size_t len;
+
+    int pending;
+    batch_t* next;
+};
+
+int  batch_append (batch_t* batch, batch_t** pending, ENetPeer* peer, enet_uint8 channel, enet_uint32 flags, const enet_uint8* data, size_t data_len);
+int  batch_flush (batch_t* batch);
+void batch_flush_all (batch_t** pending);
+void batch_reset (batch_t* batch);
+int  batch_next (const enet_uint8** data, size_t* data_len, const enet_uint8** msg, size_t* msg_len);
+
+/* The batches of a connected peer: a slot per channel, a batch allocated on the first message of the
+   channel. All of it is charged to the peer (see SESrv_SetMemoryBudget()) */
+typedef struct {
+    ENetPeer* peer;
+    size_t count;
+    batch_t** channels;
+} peer_batches_t;
+
+peer_batches_t* peer_batches_create (ENetPeer* peer);
+batch_t*        peer_batches_get (peer_batches_t* batches, size_t channel);
+void            peer_batches_destroy (peer_batches_t* batches, batch_t** pending);
+
+/* Streams: the pull function of the user is called through a trampoline holding its user data */
+int  stream_send (ENetPeer* peer, size_t channel, SEStreamPull pull_proc, void* user_data);
+
+/* Read-only mapping of a whole file. Returns 1 on success (data is 0 for an empty file), 0 on failure */
+int  file_map (const char* path, void** data, size_t* len);
+void file_unmap (void* data, size_t len);
+
+/* Host name resolution in a background thread, with a cache (s_enet_resolver.c) */
+typedef struct resolve_t resolve_t;
+
+void       resolver_startup ();
+void       resolver_shutdown ();
+resolve_t* resolver_request (const char* host);
+int        resolver_poll (resolve_t* req, enet_uint32* ip);
+void       resolver_wait (resolve_t* req, enet_uint32 timeout);
+void       resolver_release (resolve_t* req);
+int        resolver_resolve (const char* host, enet_uint32* ip);
+
 inline void debug (const char* data);
 
 #endif // __S_ENET_INTERNAL__
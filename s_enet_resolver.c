@@ -0,0 +1,369 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "enet/enet.h"
+#include "s_enet_internal.h"
+#include "s_enet.h"
+
+#if defined(__WIN32__) || defined(_WIN32) || defined(WIN32) || defined(__WINDOWS__) || defined(__TOS_WIN__)
+    typedef HANDLE thread_t;
+    typedef CRITICAL_SECTION mutex_t;
+    typedef CONDITION_VARIABLE cond_t;
+    #define THREAD_PROC DWORD WINAPI
+    #define THREAD_START(thread, proc) ((thread = CreateThread(NULL, 0, proc, NULL, 0, NULL)) != NULL)
+    #define THREAD_JOIN(thread) (WaitForSingleObject(thread, INFINITE), CloseHandle(thread))
+    #define MUTEX_INIT(mutex) InitializeCriticalSection(&mutex)
+    #define MUTEX_DESTROY(mutex) DeleteCriticalSection(&mutex)
+    #define MUTEX_LOCK(mutex) EnterCriticalSection(&mutex)
+    #define MUTEX_UNLOCK(mutex) LeaveCriticalSection(&mutex)
+    #define COND_INIT(cond) InitializeConditionVariable(&cond)
+    #define COND_DESTROY(cond)
+    #define COND_WAIT(cond, mutex) SleepConditionVariableCS(&cond, &mutex, INFINITE)
+    #define COND_TIMEDWAIT(cond, mutex, ms) SleepConditionVariableCS(&cond, &mutex, ms)
+    #define COND_SIGNAL(cond) WakeConditionVariable(&cond)
+    #define COND_BROADCAST(cond) WakeAllConditionVariable(&cond)
+#else  /* presume POSIX */
+    #include <pthread.h>
+    #include <time.h>
+    typedef pthread_t thread_t;
+    typedef pthread_mutex_t mutex_t;
+    typedef pthread_cond_t cond_t;
+    #define THREAD_PROC void*
+    #define THREAD_START(thread, proc) (pthread_create(&thread, NULL, proc, NULL) == 0)
+    #define THREAD_JOIN(thread) pthread_join(thread, NULL)
+    #define MUTEX_INIT(mutex) pthread_mutex_init(&mutex, NULL)
+    #define MUTEX_DESTROY(mutex) pthread_mutex_destroy(&mutex)
+    #define MUTEX_LOCK(mutex) pthread_mutex_lock(&mutex)
+    #define MUTEX_UNLOCK(mutex) pthread_mutex_unlock(&mutex)
+    #define COND_INIT(cond) pthread_cond_init(&cond, NULL)
+    #define COND_DESTROY(cond) pthread_cond_destroy(&cond)
+    #define COND_WAIT(cond, mutex) pthread_cond_wait(&cond, &mutex)
+    #define COND_TIMEDWAIT(cond, mutex, ms) cond_timedwait(&cond, &mutex, ms)
+    #define COND_SIGNAL(cond) pthread_cond_signal(&cond)
+    #define COND_BROADCAST(cond) pthread_cond_broadcast(&cond)
+
+    static void cond_timedwait (pthread_cond_t* cond, pthread_mutex_t* mutex, uint32 ms)
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += ms / 1000;
+        ts.tv_nsec += (long)(ms % 1000) * 1000000;
+        if (ts.tv_nsec >= 1000000000) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(cond, mutex, &ts);
+    }
+#endif
+
+#define RESOLVER_CACHE_SIZE 32
+#define RESOLVER_HOST_MAX 256
+#define RESOLVER_DEFAULT_TTL 60000
+
+struct resolve_t {
+    char* host;
+    enet_uint32 ip;
+    int state;
+    int refs;
+
+    resolve_t* next;
+};
+
+typedef struct {
+    char host[RESOLVER_HOST_MAX];
+    enet_uint32 ip;
+    enet_uint32 time;
+    int valid;
+} cache_entry_t;
+
+/* proc and ttl may be set before the resolver is started, and are kept by resolver_startup() */
+static struct {
+    int initialized;
+    mutex_t mutex;
+    cond_t cond;
+    cond_t done;
+
+    thread_t thread;
+    int running, stop;
+
+    resolve_t* queue_first;
+    resolve_t* queue_last;
+
+    SEResolveProc proc;
+    void* user_data;
+
+    uint32 ttl;
+    int ttl_set;
+    cache_entry_t cache[RESOLVER_CACHE_SIZE];
+} resolver;
+
+static int resolve_default (const char* host, uint32* ip, void* user_data)
+{
+    (void)user_data;
+
+    ENetAddress addr;
+    if (enet_address_set_host(&addr, host) != 0) { return 0; }
+
+    *ip = addr.host;
+    return 1;
+}
+
+/* Must be called with the mutex locked */
+static int cache_lookup (const char* host, enet_uint32* ip)
+{
+    size_t i;
+    for (i = 0; i < RESOLVER_CACHE_SIZE; i++) {
+        cache_entry_t* entry = &resolver.cache[i];
+        if (entry->valid != 0 && enet_time_get() - entry->time < resolver.ttl && strcmp(entry->host, host) == 0) {
+            *ip = entry->ip;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Must be called with the mutex locked. Replaces the entry of the same host, or else the oldest one */
+static void cache_store (const char* host, enet_uint32 ip)
+{
+    if (resolver.ttl == 0 || strlen(host) >= RESOLVER_HOST_MAX) { return; }
+
+    cache_entry_t* slot = NULL;
+    size_t i;
+    for (i = 0; i < RESOLVER_CACHE_SIZE; i++) {
+        cache_entry_t* entry = &resolver.cache[i];
+        if (entry->valid != 0 && strcmp(entry->host, host) == 0) {
+            slot = entry;
+            break;
+        }
+        if (slot == NULL || entry->valid == 0 || (slot->valid != 0 && enet_time_get() - entry->time > enet_time_get() - slot->time)) {
+            slot = entry;
+        }
+    }
+
+    strcpy(slot->host, host);
+    slot->ip = ip;
+    slot->time = enet_time_get();
+    slot->valid = 1;
+}
+
+/* Must be called with the mutex locked */
+static void request_unref (resolve_t* req)
+{
+    if (--req->refs == 0) {
+        free(req->host);
+        free(req);
+    }
+}
+
+/* Only this thread calls the resolve function, which need not be reentrant (gethostbyname() isn't) */
+static THREAD_PROC resolver_thread (void* param)
+{
+    (void)param;
+
+    MUTEX_LOCK(resolver.mutex);
+    while (resolver.stop == 0) {
+        resolve_t* req = resolver.queue_first;
+        if (req == NULL) {
+            COND_WAIT(resolver.cond, resolver.mutex);
+            continue;
+        }
+        resolver.queue_first = req->next;
+        if (resolver.queue_first == NULL) { resolver.queue_last = NULL; }
+
+        enet_uint32 ip = 0;
+        int ret = 0;
+        if (req->refs > 1 && (ret = cache_lookup(req->host, &ip)) == 0) {
+            SEResolveProc proc = resolver.proc;
+            void* user_data = resolver.user_data;
+
+            MUTEX_UNLOCK(resolver.mutex);
+            ret = proc(req->host, &ip, user_data);
+            MUTEX_LOCK(resolver.mutex);
+
+            if (ret != 0) { cache_store(req->host, ip); }
+        }
+
+        req->ip = ip;
+        req->state = ret != 0 ? 1 : -1;
+        COND_BROADCAST(resolver.done);
+        request_unref(req);
+    }
+    MUTEX_UNLOCK(resolver.mutex);
+    return 0;
+}
+
+void resolver_startup ()
+{
+    if (resolver.initialized != 0) { return; }
+
+    MUTEX_INIT(resolver.mutex);
+    COND_INIT(resolver.cond);
+    COND_INIT(resolver.done);
+    resolver.running = 0;
+    resolver.stop = 0;
+    resolver.queue_first = NULL;
+    resolver.queue_last = NULL;
+    if (resolver.proc == NULL) { resolver.proc = resolve_default; }
+    if (resolver.ttl_set == 0) { resolver.ttl = RESOLVER_DEFAULT_TTL; }
+    memset(resolver.cache, 0, sizeof(resolver.cache));
+    resolver.initialized = 1;
+}
+
+void resolver_shutdown ()
+{
+    if (resolver.initialized == 0) { return; }
+
+    MUTEX_LOCK(resolver.mutex);
+    resolver.stop = 1;
+    COND_SIGNAL(resolver.cond);
+    MUTEX_UNLOCK(resolver.mutex);
+
+    if (resolver.running != 0) {
+        THREAD_JOIN(resolver.thread);
+        resolver.running = 0;
+    }
+
+    while (resolver.queue_first != NULL) {
+        resolve_t* req = resolver.queue_first;
+        resolver.queue_first = req->next;
+        req->state = -1;
+        request_unref(req);
+    }
+    COND_BROADCAST(resolver.done);
+
+    COND_DESTROY(resolver.done);
+    COND_DESTROY(resolver.cond);
+    MUTEX_DESTROY(resolver.mutex);
+    resolver.initialized = 0;
+}
+
+/* Start resolving a host name in the background thread. The request completes at once if the name is cached */
+resolve_t* resolver_request (const char* host)
+{
+    resolve_t* req = malloc(sizeof(resolve_t));
+    if (req == NULL) { return NULL; }
+
+    req->host = malloc(strlen(host) + 1);
+    if (req->host == NULL) {
+        free(req);
+        return NULL;
+    }
+    strcpy(req->host, host);
+    req->state = 0;
+    req->refs = 1;
+    req->next = NULL;
+
+    MUTEX_LOCK(resolver.mutex);
+    if (cache_lookup(host, &req->ip) != 0) {
+        req->state = 1;
+        MUTEX_UNLOCK(resolver.mutex);
+        return req;
+    }
+
+    if (resolver.running == 0) {
+        resolver.running = THREAD_START(resolver.thread, resolver_thread);
+        if (resolver.running == 0) {
+            MUTEX_UNLOCK(resolver.mutex);
+            free(req->host);
+            free(req);
+            return NULL;
+        }
+    }
+
+    req->refs++;
+    if (resolver.queue_last != NULL) {
+        resolver.queue_last->next = req;
+    } else {
+        resolver.queue_first = req;
+    }
+    resolver.queue_last = req;
+
+    COND_SIGNAL(resolver.cond);
+    MUTEX_UNLOCK(resolver.mutex);
+    return req;
+}
+
+/* Returns 1 and sets ip if the host is resolved, 0 if the request is pending, -1 if the resolution failed */
+int resolver_poll (resolve_t* req, enet_uint32* ip)
+{
+    MUTEX_LOCK(resolver.mutex);
+    int state = req->state;
+    if (state == 1) { *ip = req->ip; }
+    MUTEX_UNLOCK(resolver.mutex);
+    return state;
+}
+
+/* Wait until a request completes or timeout (ms) has elapsed, then use resolver_poll() */
+void resolver_wait (resolve_t* req, enet_uint32 timeout)
+{
+    enet_uint32 start = enet_time_get();
+
+    MUTEX_LOCK(resolver.mutex);
+    while (req->state == 0) {
+        enet_uint32 elapsed = enet_time_get() - start;
+        if (elapsed >= timeout) { break; }
+        COND_TIMEDWAIT(resolver.done, resolver.mutex, timeout - elapsed);
+    }
+    MUTEX_UNLOCK(resolver.mutex);
+}
+
+/* Release a request, whether completed or not */
+void resolver_release (resolve_t* req)
+{
+    MUTEX_LOCK(resolver.mutex);
+    request_unref(req);
+    MUTEX_UNLOCK(resolver.mutex);
+}
+
+/* Resolve a host name, waiting for the resolver thread unless it is cached. Returns 1 on success, 0 on failure */
+int resolver_resolve (const char* host, enet_uint32* ip)
+{
+    resolve_t* req = resolver_request(host);
+    if (req == NULL) { return 0; }
+
+    int state;
+    while ((state = resolver_poll(req, ip)) == 0) {
+        resolver_wait(req, 1000);
+    }
+    resolver_release(req);
+    return state == 1 ? 1 : 0;
+}
+
+
+/** \brief Replace the function used to resolve host names (by default, enet_address_set_host())
+ *
+ * The function is only called from the resolver thread, one name at a time. The cache is cleared.
+ * May be called before SE_Startup(), the function is then kept
+ *
+ * \param resolve_proc[in] Resolve function, or 0 to restore the default one
+ * \param user_data[in] User data passed to the function
+ *
+ */
+void        SENET_API   SE_SetResolver (SEResolveProc resolve_proc, void* user_data)
+{
+    int initialized = resolver.initialized;
+
+    if (initialized != 0) { MUTEX_LOCK(resolver.mutex); }
+    resolver.proc = resolve_proc != NULL ? resolve_proc : resolve_default;
+    resolver.user_data = user_data;
+    memset(resolver.cache, 0, sizeof(resolver.cache));
+    if (initialized != 0) { MUTEX_UNLOCK(resolver.mutex); }
+}
+
+/** \brief Set how long resolved host names are cached (60 seconds by default)
+ *
+ * May be called before SE_Startup(), the setting is then kept
+ *
+ * \param ttl[in] Time (ms) a resolved host name is kept, 0 to disable the cache
+ *
+ */
+void        SENET_API   SE_SetResolverCacheTTL (const uint32 ttl)
+{
+    int initialized = resolver.initialized;
+
+    if (initialized != 0) { MUTEX_LOCK(resolver.mutex); }
+    resolver.ttl = ttl;
+    resolver.ttl_set = 1;
+    if (ttl == 0) { memset(resolver.cache, 0, sizeof(resolver.cache)); }
+    if (initialized != 0) { MUTEX_UNLOCK(resolver.mutex); }
+}
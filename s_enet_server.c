@@ -1,10 +1,21 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "enet/enet.h"
 #include "s_enet_internal.h"
 #include "s_enet.h"
 
+struct group_t {
+    server_t* srv;
+
+    ENetPeer** peers;
+    size_t count, size;
+
+    group_t* prev;
+    group_t* next;
+};
+
 struct server_t {
     ENetAddress e_addr;
     ENetHost* e_host;
@@ -23,17 +34,145 @@ struct server_t {
     SESrvOnConnect on_connect;
     SESrvOnDisconnect on_disconnect;
     SESrvOnRecv on_recv;
+    SESrvOnStream on_stream;
+    SESrvOnWritable on_writable;
 
     void* user_data;
+
+    group_t* groups;
+
+    int direct_recv;
+    int connect_cookies;
+    uint32 mtu;
+    int mtu_probe;
+    uint32 source_rate, source_burst;
+    size_t queue_peer_len, queue_peer_count;
+    size_t queue_total_len, queue_total_count;
+    size_t memory_budget, peer_memory_budget;
+    ENetAllocator allocator;
+    ENetPacket* recv_packet;
+    const uint8* recv_data;
+    size_t recv_len;
+
+    uint32 aggregated[8];
+    peer_batches_t** batches; /* by slot in the peer array, grown as peers connect */
+    size_t batches_size;
+    batch_t* batches_pending;
 };
 
+static void recv_batch (server_t* srv, ENetPeer* peer, size_t channel, const uint8* data, size_t data_len)
+{
+    const uint8* msg;
+    size_t msg_len;
+
+    while (batch_next(&data, &data_len, &msg, &msg_len) != 0) {
+        srv->recv_data = msg;
+        srv->recv_len = msg_len;
+        srv->on_recv(srv, (peer_t*)peer, channel, (uint8*)msg, msg_len);
+    }
+    srv->recv_data = NULL;
+}
+
+/* Get the batches slot of a peer, growing the slots to the peers committed so far. Returns 0 on failure */
+static peer_batches_t** batches_slot (server_t* srv, ENetPeer* peer)
+{
+    size_t index = peer - srv->e_host->peers;
+
+    if (index >= srv->batches_size) {
+        size_t size = srv->e_host->peerCount;
+        peer_batches_t** slots = enet_host_malloc(srv->e_host, NULL, size * sizeof(peer_batches_t*));
+        if (slots == NULL) { return NULL; }
+
+        memset(slots, 0, size * sizeof(peer_batches_t*));
+        if (srv->batches != NULL) {
+            memcpy(slots, srv->batches, srv->batches_size * sizeof(peer_batches_t*));
+            enet_host_free(srv->e_host, NULL, srv->batches, srv->batches_size * sizeof(peer_batches_t*));
+        }
+        srv->batches = slots;
+        srv->batches_size = size;
+    }
+    return &srv->batches[index];
+}
+
+/* Allocate the batches of a peer that just connected, if a channel is aggregated */
+static void batches_add_peer (server_t* srv, ENetPeer* peer)
+{
+    size_t i;
+    for (i = 0; i < 8 && srv->aggregated[i] == 0; i++) {}
+    if (i == 8) { return; }
+
+    peer_batches_t** slot = batches_slot(srv, peer);
+    if (slot != NULL && *slot == NULL) {
+        *slot = peer_batches_create(peer);
+    }
+}
+
+static int batches_send (server_t* srv, ENetPeer* peer, size_t channel, enet_uint32 flags, const uint8* data, size_t data_len)
+{
+    if (peer->state != ENET_PEER_STATE_CONNECTED) { return 0; }
+
+    /* aggregation may have been activated after the peer connected */
+    peer_batches_t** slot = batches_slot(srv, peer);
+    if (slot == NULL) { return 0; }
+    if (*slot == NULL) {
+        *slot = peer_batches_create(peer);
+        if (*slot == NULL) { return 0; }
+    }
+
+    batch_t* batch = peer_batches_get(*slot, channel);
+    if (batch == NULL) { return 0; }
+
+    int ret = batch_append(batch, &srv->batches_pending, peer, channel, flags, data, data_len);
+    if (ret != 1) {
+        return ret;
+    }
+
+    if (srv->send_immediatly != 0) {
+        batch_flush_all(&srv->batches_pending);
+        enet_host_flush(srv->e_host);
+    }
+    return 1;
+}
+
+/* Free the batches of a peer that disconnected, dropping its messages */
+static void batches_free_peer (server_t* srv, ENetPeer* peer)
+{
+    size_t index = peer - srv->e_host->peers;
+    if (index >= srv->batches_size || srv->batches[index] == NULL) { return; }
+
+    peer_batches_destroy(srv->batches[index], &srv->batches_pending);
+    srv->batches[index] = NULL;
+}
+
+static void batches_free (server_t* srv)
+{
+    if (srv->batches == NULL) { return; }
+
+    size_t i;
+    for (i = 0; i < srv->batches_size; i++) {
+        if (srv->batches[i] != NULL) { peer_batches_destroy(srv->batches[i], &srv->batches_pending); }
+    }
+    enet_host_free(srv->e_host, NULL, srv->batches, srv->batches_size * sizeof(peer_batches_t*));
+    srv->batches = NULL;
+    srv->batches_size = 0;
+    srv->batches_pending = NULL;
+}
+
+static void groups_remove_peer (server_t* srv, ENetPeer* peer);
+static void groups_clear (server_t* srv);
+static int  batches_send (server_t* srv, ENetPeer* peer, size_t channel, enet_uint32 flags, const uint8* data, size_t data_len);
+static void batches_free_peer (server_t* srv, ENetPeer* peer);
+static void batches_free (server_t* srv);
+static void recv_batch (server_t* srv, ENetPeer* peer, size_t channel, const uint8* data, size_t data_len);
+static int ENET_CALLBACK recv_direct (ENetHost* host, ENetPeer* peer, enet_uint8 channel, const enet_uint8* data, size_t data_len);
+
 
 /** \brief Create a server
  *
  * The server will not yet accept incoming connections until you start it (SESrv_Start())
  *
  * \param port[in] Listening port
- * \param max_peers[in] Maximum peers that the server will accept (the maximum is 4095)
+ * \param max_peers[in] Maximum peers that the server will accept (the maximum is 65535, clients using an older ENet only get the first 4094 peers). Memory is only committed to peers as they connect
  * \param channels[in] Channels count (the maximum is 255)
  * \param max_in_bandwidth[in] Maximum downstream bandwidth (bytes/s) - 0 means unlimited
  * \param max_out_bandwidth[in] Maximum upstream bandwidth (bytes/s) - 0 means unlimited
@@ -68,9 +207,37 @@ server_t*   SENET_API   SESrv_Create (const uint16 port, const size_t max_peers,
     srv->on_connect = NULL;
     srv->on_disconnect = NULL;
     srv->on_recv = NULL;
+    srv->on_stream = NULL;
+    srv->on_writable = NULL;
 
     srv->user_data = NULL;
 
+    srv->groups = NULL;
+
+    srv->direct_recv = 0;
+    srv->connect_cookies = 0;
+    srv->mtu = 0;
+    srv->mtu_probe = 0;
+    srv->source_rate = 0;
+    srv->source_burst = 0;
+    srv->queue_peer_len = 0;
+    srv->queue_peer_count = 0;
+    srv->queue_total_len = 0;
+    srv->queue_total_count = 0;
+    srv->memory_budget = 0;
+    srv->peer_memory_budget = 0;
+    srv->allocator.context = NULL;
+    srv->allocator.malloc = NULL;
+    srv->allocator.free = NULL;
+    srv->recv_packet = NULL;
+    srv->recv_data = NULL;
+    srv->recv_len = 0;
+
+    memset(srv->aggregated, 0, sizeof(srv->aggregated));
+    srv->batches = NULL;
+    srv->batches_size = 0;
+    srv->batches_pending = NULL;
+
     return srv;
 }
 
@@ -85,8 +252,10 @@ server_t*   SENET_API   SESrv_Create (const uint16 port, const size_t max_peers,
  */
 void        SENET_API   SESrv_Destroy (server_t* srv)
 {
+    batches_free(srv);
     if (srv->e_host != NULL) { enet_host_destroy(srv->e_host); }
     if (srv->peer_ip != NULL) { free(srv->peer_ip); }
+    while (srv->groups != NULL) { SESrv_GroupDestroy(srv, srv->groups); }
     free(srv);
 }
 
@@ -103,10 +272,32 @@ int         SENET_API   SESrv_Start (server_t* srv)
 
     //srv->peers = 0;
 
-    srv->e_host = enet_host_create(&srv->e_addr, srv->max_peers, srv->channels, srv->max_in, srv->max_out);
+    srv->e_host = enet_host_create_with_allocator(&srv->e_addr, srv->max_peers, srv->channels, srv->max_in, srv->max_out, ENET_HOST_FLAG_LAZY_PEERS,
+                                                  srv->allocator.malloc != NULL ? &srv->allocator : NULL);
     if (srv->e_host == NULL) {
         return 0;
     }
+    srv->e_host->data = srv;
+    if (srv->direct_recv != 0) {
+        srv->e_host->receive = recv_direct;
+    }
+    if (srv->connect_cookies != 0) {
+        enet_host_connect_cookies(srv->e_host, 1, NULL);
+    }
+    if (srv->mtu != 0) {
+        enet_host_mtu(srv->e_host, srv->mtu, srv->mtu_probe);
+    }
+    if (srv->source_rate != 0 && enet_host_source_limit(srv->e_host, srv->source_rate, srv->source_burst) != 0) {
+        enet_host_destroy(srv->e_host);
+        srv->e_host = NULL;
+        return 0;
+    }
+    enet_host_queue_limit(srv->e_host, srv->queue_total_len, srv->queue_total_count);
+    if (enet_host_memory_budget(srv->e_host, srv->memory_budget, srv->peer_memory_budget) != 0) {
+        enet_host_destroy(srv->e_host);
+        srv->e_host = NULL;
+        return 0;
+    }
     return 1;
 }
 
@@ -127,8 +318,11 @@ void        SENET_API   SESrv_Stop (server_t* srv, const int force, const uint32
 
     SESrv_DisconnectAll(srv, force, disconnect_data);
 
+    batches_free(srv);
     enet_host_destroy(srv->e_host);
     srv->e_host = NULL;
+
+    groups_clear(srv);
 }
 
 /** \brief Check if a server is started
@@ -186,6 +380,31 @@ void        SENET_API   SESrv_SetCallbacks (server_t* srv, SESrvOnConnect on_con
     srv->on_disconnect = on_disconnect_proc;
 }
 
+/** \brief Set the function receiving the streams sent by peers (see SESrv_SendStream())
+ *
+ * The chunks of a stream are received in order, and the end of the stream as an empty chunk.
+ * Without stream callback, the chunks are received by the receive callback like any data
+ *
+ * \param srv[in] Server pointer
+ * \param on_stream_proc[in] Function called for each chunk of a stream, or 0
+ *
+ */
+void        SENET_API   SESrv_SetStreamCallback (server_t* srv, SESrvOnStream on_stream_proc)
+{
+    srv->on_stream = on_stream_proc;
+}
+
+/** \brief Set the function called when a peer can be sent to again (see SESrv_SetQueueLimits())
+ *
+ * \param srv[in] Server pointer
+ * \param on_writable_proc[in] Function called when the queue of a peer that refused data has drained, or 0
+ *
+ */
+void        SENET_API   SESrv_SetWritableCallback (server_t* srv, SESrvOnWritable on_writable_proc)
+{
+    srv->on_writable = on_writable_proc;
+}
+
 
 /** \brief Set server's bandwidth limits
  *
@@ -233,6 +452,232 @@ void        SENET_API   SESrv_SetSendImmediatly (server_t* srv, const int send_i
     srv->send_immediatly = send_immediatly;
 }
 
+/** \brief Set server's "direct receive" option (deactivated by default)
+ *
+ * When activated, small unreliable data that fits in a single datagram is passed to the receive
+ * callback straight from the receive buffer, without allocating a packet. The callback is then
+ * called from inside SESrv_Process() while the datagram is processed: it may send data, but must
+ * not disconnect peers nor stop the server
+ *
+ * \param srv[in] Server pointer
+ * \param direct_recv[in] 1 to activate, 0 to deactivate
+ *
+ */
+void        SENET_API   SESrv_SetDirectRecv (server_t* srv, const int direct_recv)
+{
+    srv->direct_recv = direct_recv;
+
+    if (srv->e_host != NULL) {
+        srv->e_host->receive = direct_recv != 0 ? recv_direct : NULL;
+    }
+}
+
+/** \brief Set server's "connect cookies" option (deactivated by default)
+ *
+ * When activated, a peer is only allocated for a connection request once the client has echoed a
+ * cookie sent back to it, so a flood of spoofed requests doesn't fill the server. Connecting takes
+ * one more round trip, and clients built without cookie support can't connect anymore
+ *
+ * \param srv[in] Server pointer
+ * \param connect_cookies[in] 1 to activate, 0 to deactivate
+ *
+ */
+void        SENET_API   SESrv_SetConnectCookies (server_t* srv, const int connect_cookies)
+{
+    srv->connect_cookies = connect_cookies;
+
+    if (srv->e_host != NULL) {
+        enet_host_connect_cookies(srv->e_host, connect_cookies != 0, NULL);
+    }
+}
+
+/** \brief Set the largest datagram size used with clients (1400 by default)
+ *
+ * A connection uses the smallest MTU of the server and the client. With probing, connections start at 1400 and
+ * probe the network for the largest datagram size that gets through, up to that MTU (clients must support it)
+ *
+ * \param srv[in] Server pointer
+ * \param mtu[in] MTU (576 to 9000, e.g. 9000 on a jumbo frames network)
+ * \param probe[in] 1 to probe the path MTU of each connection, 0 to use the MTU as is
+ *
+ */
+void        SENET_API   SESrv_SetMTU (server_t* srv, const uint32 mtu, const int probe)
+{
+    srv->mtu = mtu;
+    srv->mtu_probe = probe;
+
+    if (srv->e_host != NULL) {
+        enet_host_mtu(srv->e_host, mtu, probe);
+    }
+}
+
+/** \brief Limit the rate of datagrams accepted from each IP address that isn't a connected peer (no limit by default)
+ *
+ * Connection requests and junk datagrams beyond the limit are dropped as soon as they are received,
+ * before any other processing, and counted (see SESrv_GetDropCount()). Addresses may share their limit with a few others
+ *
+ * \param srv[in] Server pointer
+ * \param rate[in] Datagrams per second accepted from each address, 0 to remove the limit
+ * \param burst[in] Datagrams an address may send at once after being idle (1 to 65535)
+ *
+ * \return 1 on success, 0 on failure
+ *
+ */
+int         SENET_API   SESrv_SetSourceLimit (server_t* srv, const uint32 rate, const uint32 burst)
+{
+    if (srv->e_host != NULL && enet_host_source_limit(srv->e_host, rate, burst) != 0) { return 0; }
+
+    srv->source_rate = rate;
+    srv->source_burst = burst;
+    return 1;
+}
+
+/** \brief Limit the data queued for sending, per peer and for all peers together (no limit by default)
+ *
+ * Data counts from the moment it is sent until the peer acknowledges it (or until it goes out, if unreliable).
+ * Once a limit would be exceeded, the send functions return -2 instead of queuing the data, and broadcasts
+ * skip the peers concerned. When the queues of a peer that refused data have drained below half of the
+ * limits, the writable callback is called for it (see SESrv_SetWritableCallback()). A message is always
+ * accepted by an empty queue, whatever its size
+ *
+ * \param srv[in] Server pointer
+ * \param peer_bytes[in] Maximum bytes queued for each peer, 0 for no limit
+ * \param peer_packets[in] Maximum packets queued for each peer (large messages count once per fragment being sent), 0 for no limit
+ * \param total_bytes[in] Maximum bytes queued for all peers, 0 for no limit
+ * \param total_packets[in] Maximum packets queued for all peers, 0 for no limit
+ *
+ */
+void        SENET_API   SESrv_SetQueueLimits (server_t* srv, const size_t peer_bytes, const size_t peer_packets, const size_t total_bytes, const size_t total_packets)
+{
+    srv->queue_peer_len = peer_bytes;
+    srv->queue_peer_count = peer_packets;
+    srv->queue_total_len = total_bytes;
+    srv->queue_total_count = total_packets;
+
+    if (srv->e_host == NULL) { return; }
+
+    enet_host_queue_limit(srv->e_host, total_bytes, total_packets);
+
+    ENetPeer* peer;
+    for (peer = srv->e_host->peers; peer < &srv->e_host->peers[srv->e_host->peerCount]; peer++) {
+        if (peer->state == ENET_PEER_STATE_CONNECTED) {
+            enet_peer_queue_limit(peer, peer_bytes, peer_packets);
+        }
+    }
+}
+
+/** \brief Limit the memory used by the server, per peer and in total (no limit by default)
+ *
+ * The memory of a peer covers the data received from it and not passed to the receive callback yet, and the
+ * protocol state kept for it; data sent is limited by SESrv_SetQueueLimits(). When a peer goes over its budget,
+ * its pending unreliable data is dropped, then it is disconnected if it is still over. When the server goes over
+ * its budget, all pending unreliable data is dropped, then the peers using the most memory are disconnected
+ * until the server is back within budget. Disconnected peers get the disconnect callback as usual.
+ * The budget must exceed the memory the server holds for itself (see SESrv_GetMemoryUsage() right after
+ * SESrv_Start()); a smaller budget is refused, or makes SESrv_Start() fail if set before
+ *
+ * \param srv[in] Server pointer
+ * \param budget[in] Maximum memory of the server in bytes, including its peer array, 0 for no limit
+ * \param peer_budget[in] Maximum memory of each peer in bytes, 0 for no limit
+ *
+ * \return 1 on success, 0 if the budget is too small
+ *
+ */
+int         SENET_API   SESrv_SetMemoryBudget (server_t* srv, const size_t budget, const size_t peer_budget)
+{
+    if (srv->e_host != NULL && enet_host_memory_budget(srv->e_host, budget, peer_budget) != 0) { return 0; }
+
+    srv->memory_budget = budget;
+    srv->peer_memory_budget = peer_budget;
+    return 1;
+}
+
+/** \brief Get the memory used by the server
+ *
+ * \param srv[in] Server pointer
+ * \param shed_peers[out] Number of peers disconnected to keep within the memory budgets since the server was started (optional)
+ *
+ * \return Memory used in bytes, 0 if the server isn't started
+ *
+ */
+size_t      SENET_API   SESrv_GetMemoryUsage (server_t* srv, uint32* shed_peers)
+{
+    if (srv->e_host == NULL) {
+        if (shed_peers != NULL) { *shed_peers = 0; }
+        return 0;
+    }
+
+    if (shed_peers != NULL) { *shed_peers = srv->e_host->shedPeers; }
+    return srv->e_host->memoryUsage;
+}
+
+/** \brief Allocate the memory of the server with custom functions instead of the global ones (malloc() and free())
+ *
+ * This covers the network state of the server, its peers and the packets it sends and receives, so that servers run from different
+ * threads may each use their own memory pool. Received packets kept with SESrv_RecvRetain() are copied with the global allocator,
+ * so no memory of the custom allocator outlives the server: the functions are only called from the functions of the server, up
+ * to SESrv_Stop() or SESrv_Destroy(). Can only be set while the server is stopped, and takes effect when it is started
+ *
+ * \param srv[in] Server pointer
+ * \param alloc_proc[in] Function allocating memory, 0 to restore the global allocator
+ * \param free_proc[in] Function freeing memory returned by alloc_proc
+ * \param user_data[in] User data passed to both functions
+ *
+ * \return 1 on success, 0 if the server is started or only one of the functions is given
+ *
+ */
+int         SENET_API   SESrv_SetAllocator (server_t* srv, SEAllocProc alloc_proc, SEFreeProc free_proc, void* user_data)
+{
+    if (srv->e_host != NULL || (alloc_proc == NULL) != (free_proc == NULL)) { return 0; }
+
+    srv->allocator.context = user_data;
+    srv->allocator.malloc = alloc_proc;
+    srv->allocator.free = free_proc;
+    return 1;
+}
+
+/** \brief Get the number of datagrams the server dropped on receive for a reason, since it was started
+ *
+ * \param srv[in] Server pointer
+ * \param reason[in] One of SE_DROP_MALFORMED, SE_DROP_SOURCE_LIMIT, SE_DROP_UNKNOWN_PEER, SE_DROP_DECOMPRESS, SE_DROP_CHECKSUM
+ *
+ * \return Number of dropped datagrams, 0 if the server isn't started or reason is invalid
+ *
+ */
+uint32      SENET_API   SESrv_GetDropCount (server_t* srv, const int reason)
+{
+    if (srv->e_host == NULL || reason < 0 || reason >= ENET_DROP_REASON_COUNT) { return 0; }
+
+    return srv->e_host->droppedDatagrams[reason];
+}
+
+/** \brief Set whether small messages sent on a channel are aggregated (deactivated by default)
+ *
+ * Messages sent on an aggregated channel with SESrv_Send(), SESrv_Broadcast() or SESrv_GroupSend() are
+ * packed with their length into one packet per peer, sent when SESrv_Process() is called, and unpacked
+ * on receive into one callback call per message. The peers must aggregate the same channels, and the
+ * other send functions (SESrv_SendState(), SE_PacketSendTo()) must not be used on them
+ *
+ * \param srv[in] Server pointer
+ * \param channel[in] Channel N°
+ * \param aggregate[in] 1 to activate, 0 to deactivate
+ *
+ * \return 1 on success, -1 if channel is greater than 254
+ *
+ */
+int         SENET_API   SESrv_SetAggregation (server_t* srv, const size_t channel, const int aggregate)
+{
+    if (channel >= ENET_PROTOCOL_MAXIMUM_CHANNEL_COUNT) { return -1; }
+
+    if (aggregate != 0) {
+        srv->aggregated[channel / 32] |= 1u << (channel % 32);
+    } else {
+        batch_flush_all(&srv->batches_pending);
+        srv->aggregated[channel / 32] &= ~(1u << (channel % 32));
+    }
+    return 1;
+}
+
 
 /** \brief Set server's user data. Can be freely modified
  *
@@ -276,8 +721,11 @@ void        SENET_API   SESrv_Disconnect (server_t* srv, peer_t* peer, const int
     if (srv->e_host == NULL) { return; }
 
     if (force != 0) {
+        groups_remove_peer(srv, (ENetPeer*)peer);
+        batches_free_peer(srv, (ENetPeer*)peer);
         enet_peer_reset((ENetPeer*)peer);
     } else {
+        batch_flush_all(&srv->batches_pending);
         if (srv->send_immediatly != 0) {
             enet_peer_disconnect((ENetPeer*)peer, disconnect_data);
             enet_host_flush(srv->e_host);
@@ -303,9 +751,12 @@ void        SENET_API   SESrv_DisconnectAll (server_t* srv, const int force, con
     int i = 0;
     if (force != 0) {
         for (i = 0; i < srv->e_host->peerCount; i++) {
+            batches_free_peer(srv, &srv->e_host->peers[i]);
             enet_peer_reset(&srv->e_host->peers[i]);
         }
+        groups_clear(srv);
     } else {
+        batch_flush_all(&srv->batches_pending);
         if (srv->send_immediatly != 0) {
             for (i = 0; i < srv->e_host->peerCount; i++) {
                 enet_peer_disconnect(&srv->e_host->peers[i], disconnect_data);
@@ -353,7 +804,7 @@ size_t      SENET_API   SESrv_PeersGetAll (server_t* srv, peer_t* peers[], size_
     int i = 0, added = 0;
 
     do {
-        if (srv->e_host->peers[i].state == ENET_PEER_STATE_CONNECTED) {
+        if (srv->e_host->peerStates[i] == ENET_PEER_STATE_CONNECTED) {
             peers[added] = (peer_t*)&srv->e_host->peers[i];
             added++;
         }
@@ -378,7 +829,7 @@ void        SENET_API   SESrv_PeersIterate (server_t* srv, SESrvIterateProc proc
 
     int i = 0;
     for (i = 0; i < srv->e_host->peerCount; i++) {
-        if ((peer_t*)&srv->e_host->peers[i].state != ENET_PEER_STATE_DISCONNECTED) {
+        if (srv->e_host->peerStates[i] != ENET_PEER_STATE_DISCONNECTED) {
             proc(srv, (peer_t*)&srv->e_host->peers[i], user_data);
         }
     }
@@ -454,6 +905,76 @@ uint32      SENET_API   SESrv_PeerGetRoundTripTime (server_t* srv, peer_t* peer)
     return ((ENetPeer*)peer)->roundTripTime;
 }
 
+/** \brief Set how long unreliable data sent to a peer on a channel may wait in the queue
+ *
+ * Unreliable data still queued when its lifetime has passed is dropped instead of being sent,
+ * so that a congested peer receives fresh data. The setting is reset when the peer disconnects
+ *
+ * \param srv[in] Server pointer
+ * \param peer[in] Peer pointer
+ * \param channel[in] Channel N°
+ * \param lifetime[in] Lifetime in ms, 0 to never drop queued data (default)
+ *
+ * \return 1 on succes, 0 on failure, -1 if peer == NULL
+ *
+ */
+int         SENET_API   SESrv_PeerSetChannelLifetime (server_t* srv, peer_t* peer, const size_t channel, const uint32 lifetime)
+{
+    if (peer == NULL) { return -1; }
+
+    if (enet_peer_channel_lifetime((ENetPeer*)peer, channel, lifetime) == 0) { return 1; }
+    return 0;
+}
+
+/** \brief Limit the data queued for sending to a peer, replacing the limits set by SESrv_SetQueueLimits()
+ *
+ * The setting is reset when the peer disconnects
+ *
+ * \param srv[in] Server pointer
+ * \param peer[in] Peer pointer
+ * \param bytes[in] Maximum bytes queued, 0 for no limit
+ * \param packets[in] Maximum packets queued, 0 for no limit
+ *
+ */
+void        SENET_API   SESrv_PeerSetQueueLimits (server_t* srv, peer_t* peer, const size_t bytes, const size_t packets)
+{
+    if (peer == NULL) { return; }
+
+    enet_peer_queue_limit((ENetPeer*)peer, bytes, packets);
+}
+
+/** \brief Get the memory used for a peer (see SESrv_SetMemoryBudget())
+ *
+ * \param srv[in] Server pointer
+ * \param peer[in] Peer pointer
+ *
+ * \return Memory used in bytes
+ *
+ */
+size_t      SENET_API   SESrv_PeerGetMemoryUsage (server_t* srv, peer_t* peer)
+{
+    if (peer == NULL) { return 0; }
+
+    return ((ENetPeer*)peer)->memoryUsage;
+}
+
+/** \brief Get the data queued for sending to a peer
+ *
+ * \param srv[in] Server pointer
+ * \param peer[in] Peer pointer
+ * \param packets[out] Number of packets queued (optional)
+ *
+ * \return Bytes queued, whether waiting to be sent or to be acknowledged
+ *
+ */
+size_t      SENET_API   SESrv_PeerGetQueued (server_t* srv, peer_t* peer, size_t* packets)
+{
+    if (peer == NULL) { return 0; }
+
+    if (packets != NULL) { *packets = ((ENetPeer*)peer)->queuedCommands; }
+    return ((ENetPeer*)peer)->queuedLength;
+}
+
 
 /** \brief Send data to a peer
  *
@@ -464,7 +985,7 @@ uint32      SENET_API   SESrv_PeerGetRoundTripTime (server_t* srv, peer_t* peer)
  * \param data_len[in] Data size
  * \param alloc[in] If set to 1, the function will allocate memory for the data, otherwise, the user have to not deallocate the data buffer until the send occures (see SESrv_SetSendImmediatly())
  *
- * \return 1 on succes, 0 on failure, -1 if peer == NULL or the server isn't started
+ * \return 1 on succes, 0 on failure, -1 if peer == NULL or the server isn't started, -2 if the queue of the peer is full (see SESrv_SetQueueLimits())
  *
  */
 int         SENET_API   SESrv_Send (server_t* srv, peer_t* peer, const size_t channel, const uint8* data, const size_t data_len, const int alloc)
@@ -479,21 +1000,181 @@ int         SENET_API   SESrv_Send (server_t* srv, peer_t* peer, const size_t ch
         flags += ENET_PACKET_FLAG_NO_ALLOCATE;
     }
 
-    ENetPacket* packet = enet_packet_create(data, data_len, flags);
+    if (AGGREGATED(srv->aggregated, channel)) {
+        return batches_send(srv, (ENetPeer*)peer, channel, flags, data, data_len);
+    }
+
+    ENetPacket* packet = enet_packet_create_with_allocator(srv->e_host->allocator, data, data_len, flags);
     if (packet == NULL) {
         return -1;
     }
 
     int ret = enet_peer_send((ENetPeer*)peer, channel, packet);
+    if (ret != 0 && packet->referenceCount == 0) {
+        enet_packet_destroy(packet);
+    }
+
+    if (srv->send_immediatly != 0) {
+        enet_host_flush(srv->e_host);
+    }
+
+    if (ret == 0) { return 1; }
+    if (ret == -2) { return -2; }
+    return 0;
+}
+
+/** \brief Send state data to a peer, replacing any data queued with the same key that was not sent yet
+ *
+ * Only the newest data of each key is transmitted, so a slow peer does not accumulate outdated
+ * state updates. Data larger than one fragment is sent as with SESrv_Send(). Not available on aggregated channels
+ *
+ * \param srv[in] Server pointer
+ * \param peer[in] Peer pointer
+ * \param channel[in] Channel N°
+ * \param key[in] Non-zero key identifying the state (entity ID...)
+ * \param data[in] Data to be sent
+ * \param data_len[in] Data size
+ * \param alloc[in] If set to 1, the function will allocate memory for the data, otherwise, the user have to not deallocate the data buffer until the send occures (see SESrv_SetSendImmediatly())
+ *
+ * \return 1 on succes, 0 on failure, -1 if peer == NULL or the server isn't started, -2 if the queue of the peer is full (see SESrv_SetQueueLimits())
+ *
+ */
+int         SENET_API   SESrv_SendState (server_t* srv, peer_t* peer, const size_t channel, const uint32 key, const uint8* data, const size_t data_len, const int alloc)
+{
+    if (srv->e_host == NULL || peer == NULL) { return -1; }
+    if (AGGREGATED(srv->aggregated, channel)) { return 0; }
+
+    unsigned int flags = 0;
+    if (srv->reliable != 0) {
+        flags += ENET_PACKET_FLAG_RELIABLE;
+    }
+    if (alloc == 0) {
+        flags += ENET_PACKET_FLAG_NO_ALLOCATE;
+    }
+
+    ENetPacket* packet = enet_packet_create_with_allocator(srv->e_host->allocator, data, data_len, flags);
+    if (packet == NULL) {
+        return -1;
+    }
+
+    int ret = enet_peer_send_coalesced((ENetPeer*)peer, channel, packet, key);
+    if (ret != 0 && packet->referenceCount == 0) {
+        enet_packet_destroy(packet);
+    }
 
     if (srv->send_immediatly != 0) {
         enet_host_flush(srv->e_host);
     }
 
     if (ret == 0) { return 1; }
+    if (ret == -2) { return -2; }
     return 0;
 }
 
+typedef struct {
+    server_t* srv;
+    ENetPeer* peer;
+    SESrvOnFileSent on_sent;
+    void* user_data;
+} file_send_t;
+
+static void ENET_CALLBACK file_free_callback (ENetPacket* packet)
+{
+    file_send_t* send = packet->userData;
+
+    file_unmap(packet->data, packet->dataLength);
+
+    /* a reliable packet is flagged sent only when its last fragment is acknowledged */
+    if (send->on_sent != NULL) {
+        send->on_sent(send->srv, (peer_t*)send->peer, (packet->flags & ENET_PACKET_FLAG_SENT) != 0, send->user_data);
+    }
+    free(send);
+}
+
+/** \brief Send a file to a peer, reliably and without copying it in memory
+ *
+ * The file is mapped in memory and its fragments are sent directly from the mapping, which is
+ * released once the file is delivered or the peer has disconnected. The file is received as one
+ * message of the file size, so it must fit in memory on the peer side, and be at most 1 GB (see
+ * SESrv_SendStream() for larger data). Not available on aggregated channels
+ *
+ * \param srv[in] Server pointer
+ * \param peer[in] Peer pointer
+ * \param channel[in] Channel N°
+ * \param path[in] Path of the file
+ * \param on_sent_proc[in] Function called when the file is released, with delivered = 1 if the peer received all of it, or 0
+ * \param user_data[in] User data passed to on_sent_proc
+ *
+ * \return 1 on succes, 0 on failure, -1 if peer == NULL or the server isn't started, -2 if the queue of the peer is full (see SESrv_SetQueueLimits())
+ *
+ */
+int         SENET_API   SESrv_SendFile (server_t* srv, peer_t* peer, const size_t channel, const char* path, SESrvOnFileSent on_sent_proc, void* user_data)
+{
+    if (srv->e_host == NULL || peer == NULL) { return -1; }
+    if (AGGREGATED(srv->aggregated, channel)) { return 0; }
+
+    void* data;
+    size_t data_len;
+    if (file_map(path, &data, &data_len) == 0) { return 0; }
+
+    file_send_t* send = NULL;
+    ENetPacket* packet = NULL;
+    if (data_len <= ENET_PROTOCOL_MAXIMUM_PACKET_SIZE) {
+        send = malloc(sizeof(file_send_t));
+        packet = enet_packet_create_with_allocator(srv->e_host->allocator, data, data_len, ENET_PACKET_FLAG_RELIABLE | ENET_PACKET_FLAG_NO_ALLOCATE);
+    }
+    if (send == NULL || packet == NULL) {
+        if (packet != NULL) { enet_packet_destroy(packet); }
+        free(send);
+        file_unmap(data, data_len);
+        return 0;
+    }
+
+    send->srv = srv;
+    send->peer = (ENetPeer*)peer;
+    send->on_sent = on_sent_proc;
+    send->user_data = user_data;
+
+    packet->userData = send;
+    packet->freeCallback = file_free_callback;
+
+    int ret = enet_peer_send((ENetPeer*)peer, channel, packet);
+    if (ret != 0) {
+        send->on_sent = NULL;
+        enet_packet_destroy(packet);
+        return ret == -2 ? -2 : 0;
+    }
+
+    if (srv->send_immediatly != 0) {
+        enet_host_flush(srv->e_host);
+    }
+    return 1;
+}
+
+/** \brief Send a stream of data to a peer, pulling it in chunks as the peer receives the previous ones
+ *
+ * Large data can be sent this way without holding it in memory: pull_proc is called from SESrv_Process()
+ * to write at most data_len bytes in data, and returns how many were written, 0 at the end of the stream,
+ * or -1 if no data is available yet. It is called a last time with data == 0 once the stream has ended or
+ * the peer has disconnected, to release user_data. Streams are reliable and only one stream at a time
+ * may be sent on a channel
+ *
+ * \param srv[in] Server pointer
+ * \param peer[in] Peer pointer
+ * \param channel[in] Channel N°
+ * \param pull_proc[in] Function supplying the data of the stream
+ * \param user_data[in] User data passed to pull_proc
+ *
+ * \return 1 on succes, 0 on failure, -1 if peer == NULL or the server isn't started
+ *
+ */
+int         SENET_API   SESrv_SendStream (server_t* srv, peer_t* peer, const size_t channel, SEStreamPull pull_proc, void* user_data)
+{
+    if (srv->e_host == NULL || peer == NULL) { return -1; }
+
+    return stream_send((ENetPeer*)peer, channel, pull_proc, user_data);
+}
+
 /** \brief Send data to all connected peers
  *
  * \param srv[in] Server pointer
@@ -515,7 +1196,17 @@ void        SENET_API   SESrv_Broadcast (server_t* srv, const size_t channel, co
         flags += ENET_PACKET_FLAG_NO_ALLOCATE;
     }
 
-    ENetPacket* packet = enet_packet_create(data, data_len, flags);
+    if (AGGREGATED(srv->aggregated, channel)) {
+        size_t i;
+        for (i = 0; i < srv->e_host->peerCount; i++) {
+            if (srv->e_host->peerStates[i] == ENET_PEER_STATE_CONNECTED) {
+                batches_send(srv, &srv->e_host->peers[i], channel, flags, data, data_len);
+            }
+        }
+        return;
+    }
+
+    ENetPacket* packet = enet_packet_create_with_allocator(srv->e_host->allocator, data, data_len, flags);
     if (packet == NULL) {
         return;
     }
@@ -528,6 +1219,234 @@ void        SENET_API   SESrv_Broadcast (server_t* srv, const size_t channel, co
 }
 
 
+/** \brief Create a group of peers (match, zone, team...) that can be sent data at once
+ *
+ * Peers are removed from all their groups when they disconnect
+ *
+ * \param srv[in] Server pointer
+ *
+ * \return Group pointer, or 0 if failure
+ *
+ */
+group_t*    SENET_API   SESrv_GroupCreate (server_t* srv)
+{
+    group_t* group = malloc(sizeof(group_t));
+    if (group == NULL) {
+        return NULL;
+    }
+
+    group->srv = srv;
+
+    group->peers = NULL;
+    group->count = 0;
+    group->size = 0;
+
+    group->prev = NULL;
+    group->next = srv->groups;
+    if (srv->groups != NULL) { srv->groups->prev = group; }
+    srv->groups = group;
+
+    return group;
+}
+
+/** \brief Destroy a group. The peers of the group are not disconnected
+ *
+ * \param srv[in] Server pointer
+ * \param group[in] Group pointer
+ *
+ */
+void        SENET_API   SESrv_GroupDestroy (server_t* srv, group_t* group)
+{
+    if (group->prev != NULL) { group->prev->next = group->next; }
+    else { srv->groups = group->next; }
+    if (group->next != NULL) { group->next->prev = group->prev; }
+
+    if (group->peers != NULL) { free(group->peers); }
+    free(group);
+}
+
+/** \brief Add a peer to a group
+ *
+ * \param srv[in] Server pointer
+ * \param group[in] Group pointer
+ * \param peer[in] Peer pointer
+ *
+ * \return 1 on succes, 0 on failure or if the peer is already in the group, -1 if peer == NULL
+ *
+ */
+int         SENET_API   SESrv_GroupAdd (server_t* srv, group_t* group, peer_t* peer)
+{
+    if (peer == NULL) { return -1; }
+
+    size_t i = 0;
+    for (i = 0; i < group->count; i++) {
+        if (group->peers[i] == (ENetPeer*)peer) { return 0; }
+    }
+
+    if (group->count == group->size) {
+        size_t size = group->size == 0 ? 16 : group->size * 2;
+        ENetPeer** peers = realloc(group->peers, size * sizeof(ENetPeer*));
+        if (peers == NULL) {
+            return 0;
+        }
+        group->peers = peers;
+        group->size = size;
+    }
+
+    group->peers[group->count++] = (ENetPeer*)peer;
+    return 1;
+}
+
+/** \brief Remove a peer from a group
+ *
+ * \param srv[in] Server pointer
+ * \param group[in] Group pointer
+ * \param peer[in] Peer pointer
+ *
+ * \return 1 on succes, 0 if the peer isn't in the group, -1 if peer == NULL
+ *
+ */
+int         SENET_API   SESrv_GroupRemove (server_t* srv, group_t* group, peer_t* peer)
+{
+    if (peer == NULL) { return -1; }
+
+    size_t i = 0;
+    for (i = 0; i < group->count; i++) {
+        if (group->peers[i] == (ENetPeer*)peer) {
+            group->peers[i] = group->peers[--group->count];
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/** \brief Get the number of peers in a group
+ *
+ * \param srv[in] Server pointer
+ * \param group[in] Group pointer
+ *
+ * \return Peers count
+ *
+ */
+size_t      SENET_API   SESrv_GroupPeersCount (server_t* srv, group_t* group)
+{
+    return group->count;
+}
+
+/** \brief Send data to all the peers of a group
+ *
+ * A single packet is shared between all the peers
+ *
+ * \param srv[in] Server pointer
+ * \param group[in] Group pointer
+ * \param channel[in] Channel N°
+ * \param data[in] Data to be sent
+ * \param data_len[in] Data size
+ * \param alloc[in] If set to 1, the function will allocate memory for the data, otherwise, the user have to not deallocate the data buffer until the send occures (see SESrv_SetSendImmediatly())
+ *
+ * \return 1 on succes, 0 on failure, -1 if the server isn't started
+ *
+ */
+int         SENET_API   SESrv_GroupSend (server_t* srv, group_t* group, const size_t channel, const uint8* data, const size_t data_len, const int alloc)
+{
+    if (srv->e_host == NULL) { return -1; }
+    if (group->count == 0) { return 1; }
+
+    unsigned int flags = 0;
+    if (srv->reliable != 0) {
+        flags += ENET_PACKET_FLAG_RELIABLE;
+    }
+    if (alloc == 0) {
+        flags += ENET_PACKET_FLAG_NO_ALLOCATE;
+    }
+
+    if (AGGREGATED(srv->aggregated, channel)) {
+        size_t i;
+        int ret = 1;
+        for (i = 0; i < group->count; i++) {
+            if (batches_send(srv, group->peers[i], channel, flags, data, data_len) != 1) { ret = 0; }
+        }
+        return ret;
+    }
+
+    ENetPacket* packet = enet_packet_create_with_allocator(srv->e_host->allocator, data, data_len, flags);
+    if (packet == NULL) {
+        return 0;
+    }
+
+    enet_host_broadcast_peers(srv->e_host, group->peers, group->count, channel, packet);
+
+    if (srv->send_immediatly != 0) {
+        enet_host_flush(srv->e_host);
+    }
+    return 1;
+}
+
+
+/** \brief Keep the data being received alive after the receive callback returns
+ *
+ * Must be called from the receive callback. The data pointer passed to the callback then stays valid
+ * until the returned packet is released with SE_PacketRelease(). Data received directly from the receive
+ * buffer (see SESrv_SetDirectRecv()), on an aggregated channel (see SESrv_SetAggregation()) or by a server
+ * with its own allocator (see SESrv_SetAllocator()) is copied into a new packet, use SE_PacketGetData() to access it
+ *
+ * \param srv[in] Server pointer
+ *
+ * \return Packet pointer, or 0 if failure or if called outside of the receive callback
+ *
+ */
+packet_t*   SENET_API   SESrv_RecvRetain (server_t* srv)
+{
+    /* packets of the allocator of the server must not outlive it */
+    if (srv->recv_packet != NULL && srv->recv_packet->allocator != NULL) {
+        return SE_PacketCreate(srv->recv_packet->data, srv->recv_packet->dataLength, 0, 1);
+    }
+    if (srv->recv_packet != NULL) {
+        srv->recv_packet->referenceCount++;
+        return (packet_t*)srv->recv_packet;
+    }
+    if (srv->recv_data != NULL) {
+        return SE_PacketCreate(srv->recv_data, srv->recv_len, 0, 1);
+    }
+    return NULL;
+}
+
+static int ENET_CALLBACK recv_direct (ENetHost* host, ENetPeer* peer, enet_uint8 channel, const enet_uint8* data, size_t data_len)
+{
+    server_t* srv = host->data;
+    if (srv->on_recv == NULL) { return 0; }
+
+    if (AGGREGATED(srv->aggregated, channel)) {
+        recv_batch(srv, peer, channel, data, data_len);
+        return 1;
+    }
+
+    srv->recv_data = data;
+    srv->recv_len = data_len;
+    srv->on_recv(srv, (peer_t*)peer, channel, (uint8*)data, data_len);
+    srv->recv_data = NULL;
+    return 1;
+}
+
+static void groups_remove_peer (server_t* srv, ENetPeer* peer)
+{
+    group_t* group = srv->groups;
+    while (group != NULL) {
+        SESrv_GroupRemove(srv, group, (peer_t*)peer);
+        group = group->next;
+    }
+}
+
+static void groups_clear (server_t* srv)
+{
+    group_t* group = srv->groups;
+    while (group != NULL) {
+        group->count = 0;
+        group = group->next;
+    }
+}
+
+
 /** \brief
  *
  * \param srv[in] Server pointer
@@ -539,16 +1458,28 @@ void        SENET_API   SESrv_Process (server_t* srv, const uint32 wait_time)
 {
     if (srv->e_host == NULL) { DELAY(wait_time); return; }
 
+    batch_flush_all(&srv->batches_pending);
+
     if (enet_host_service(srv->e_host, &srv->e_event, wait_time) > 0) {
         switch (srv->e_event.type) {
             case ENET_EVENT_TYPE_RECEIVE:
                 #ifdef SENET_DEBUG
                 debug("ENET_EVENT_TYPE_RECEIVE\n");
                 #endif
-                if (srv->on_recv != NULL) {
+                if (srv->on_stream != NULL && (srv->e_event.packet->flags & ENET_PACKET_FLAG_STREAM)) {
+                    srv->recv_packet = srv->e_event.packet;
+                    srv->on_stream(srv, (peer_t*)srv->e_event.peer, srv->e_event.channelID, srv->e_event.packet->data, srv->e_event.packet->dataLength);
+                    srv->recv_packet = NULL;
+                } else if (srv->on_recv != NULL && AGGREGATED(srv->aggregated, srv->e_event.channelID) && !(srv->e_event.packet->flags & ENET_PACKET_FLAG_STREAM)) {
+                    recv_batch(srv, srv->e_event.peer, srv->e_event.channelID, srv->e_event.packet->data, srv->e_event.packet->dataLength);
+                } else if (srv->on_recv != NULL) {
+                    srv->recv_packet = srv->e_event.packet;
                     srv->on_recv(srv, (peer_t*)srv->e_event.peer, srv->e_event.channelID, srv->e_event.packet->data, srv->e_event.packet->dataLength);
+                    srv->recv_packet = NULL;
+                }
+                if (srv->e_event.packet->referenceCount == 0) {
+                    enet_packet_destroy(srv->e_event.packet);
                 }
-                enet_packet_destroy(srv->e_event.packet);
             break;
             case ENET_EVENT_TYPE_DISCONNECT:
                 #ifdef SENET_DEBUG
@@ -557,6 +1488,8 @@ void        SENET_API   SESrv_Process (server_t* srv, const uint32 wait_time)
                 if (srv->on_disconnect != NULL) {
                     srv->on_disconnect(srv, (peer_t*)srv->e_event.peer, srv->e_event.data);
                 }
+                groups_remove_peer(srv, srv->e_event.peer);
+                batches_free_peer(srv, srv->e_event.peer);
                 enet_peer_reset(srv->e_event.peer);
                 //srv->peers--;
             break;
@@ -565,10 +1498,17 @@ void        SENET_API   SESrv_Process (server_t* srv, const uint32 wait_time)
                 debug("ENET_EVENT_TYPE_CONNECT\n");
                 #endif
                 //srv->peers++;
+                enet_peer_queue_limit(srv->e_event.peer, srv->queue_peer_len, srv->queue_peer_count);
+                batches_add_peer(srv, srv->e_event.peer);
                 if (srv->on_connect != NULL) {
                     srv->on_connect(srv, (peer_t*)srv->e_event.peer, srv->e_event.data);
                 }
             break;
+            case ENET_EVENT_TYPE_WRITABLE:
+                if (srv->on_writable != NULL) {
+                    srv->on_writable(srv, (peer_t*)srv->e_event.peer);
+                }
+            break;
             case ENET_EVENT_TYPE_NONE:
             break;
         }